@@ -0,0 +1,109 @@
+#include "benchmarks.hpp"
+
+#include "react/react.hpp"
+
+/*
+ * Cost of activation and deactivation of thread context and of stats insertion
+ */
+const size_t SAMPLES_NUMBER = 30;
+const size_t CALLS_NUMBER = 10000;
+const size_t STATS_NUMBER = 10;
+
+/*!
+ * Aggregator which takes trees and drops them
+ */
+class null_aggregator_t : public react::aggregator_t {
+public:
+	void aggregate(const react::call_tree_t &call_tree) {
+		celero::DoNotOptimizeAway(call_tree.get_nodes_number());
+	}
+};
+
+static null_aggregator_t null_aggregator;
+
+BASELINE(Context, Vanilla, SAMPLES_NUMBER, CALLS_NUMBER)
+{
+	celero::DoNotOptimizeAway(react_is_active());
+}
+
+BENCHMARK(Context, ActivateDeactivate, SAMPLES_NUMBER, CALLS_NUMBER)
+{
+	react_activate(NULL);
+	react_deactivate();
+}
+
+BENCHMARK(Context, ActivateDeactivateAggregated, SAMPLES_NUMBER, CALLS_NUMBER)
+{
+	react_activate(&null_aggregator);
+	react_deactivate();
+}
+
+BENCHMARK(Context, NestedActivateDeactivate, SAMPLES_NUMBER, CALLS_NUMBER)
+{
+	react_activate(NULL);
+	react_activate(NULL);
+	react_deactivate();
+	react_deactivate();
+}
+
+BASELINE(Stats, Vanilla, SAMPLES_NUMBER, CALLS_NUMBER)
+{
+	react_activate(NULL);
+	react_deactivate();
+}
+
+BENCHMARK(Stats, AddStatInt, SAMPLES_NUMBER, CALLS_NUMBER)
+{
+	static const char *KEYS[STATS_NUMBER] = {"0", "1", "2", "3", "4", "5", "6", "7", "8", "9"};
+
+	react_activate(NULL);
+	for (size_t i = 0; i < STATS_NUMBER; ++i) {
+		react_add_stat_int(KEYS[i], i);
+	}
+	react_deactivate();
+}
+
+BENCHMARK(Stats, AddStatString, SAMPLES_NUMBER, CALLS_NUMBER)
+{
+	static const char *KEYS[STATS_NUMBER] = {"0", "1", "2", "3", "4", "5", "6", "7", "8", "9"};
+
+	react_activate(NULL);
+	for (size_t i = 0; i < STATS_NUMBER; ++i) {
+		react_add_stat_string(KEYS[i], "value");
+	}
+	react_deactivate();
+}
+
+BENCHMARK(Stats, AddKeyStatInt, SAMPLES_NUMBER, CALLS_NUMBER)
+{
+	static const char *KEYS[STATS_NUMBER] = {"0", "1", "2", "3", "4", "5", "6", "7", "8", "9"};
+	static int keys[STATS_NUMBER] = {-1};
+	if (keys[0] < 0) {
+		for (size_t i = 0; i < STATS_NUMBER; ++i) {
+			keys[i] = react_define_stat_key(KEYS[i]);
+		}
+	}
+
+	react_activate(NULL);
+	for (size_t i = 0; i < STATS_NUMBER; ++i) {
+		react_add_key_stat_int(keys[i], i);
+	}
+	react_deactivate();
+}
+
+BENCHMARK(Stats, AddKeyStatString, SAMPLES_NUMBER, CALLS_NUMBER)
+{
+	static const char *KEYS[STATS_NUMBER] = {"0", "1", "2", "3", "4", "5", "6", "7", "8", "9"};
+	static int keys[STATS_NUMBER] = {-1};
+	if (keys[0] < 0) {
+		for (size_t i = 0; i < STATS_NUMBER; ++i) {
+			keys[i] = react_define_stat_key(KEYS[i]);
+		}
+	}
+
+	react_activate(NULL);
+	for (size_t i = 0; i < STATS_NUMBER; ++i) {
+		react_add_key_stat_string(keys[i], "value");
+	}
+	react_deactivate();
+}
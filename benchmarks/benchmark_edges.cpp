@@ -0,0 +1,172 @@
+#include "benchmarks.hpp"
+
+#include "react/react.hpp"
+
+/*
+ * Cost of a single start/stop pair (an edge of call tree) on different paths.
+ * Each call does EDGES_NUMBER edges, so cost of one edge is
+ * (time of call - time of baseline call) / EDGES_NUMBER.
+ */
+const size_t EDGES_NUMBER = 1000;
+const size_t SAMPLES_NUMBER = 30;
+const size_t CALLS_NUMBER = 1000;
+
+REACT_ACTION(EDGE_ACTION);
+
+/*
+ * React is not active in benchmark thread: inline fast path, library call and guards
+ */
+
+BASELINE(InactiveEdge, Vanilla, SAMPLES_NUMBER, CALLS_NUMBER)
+{
+	for (size_t i = 0; i < EDGES_NUMBER; ++i) {
+		celero::DoNotOptimizeAway(i);
+	}
+}
+
+BENCHMARK(InactiveEdge, StartStop, SAMPLES_NUMBER, CALLS_NUMBER)
+{
+	int action_code = EDGE_ACTION.code();
+	for (size_t i = 0; i < EDGES_NUMBER; ++i) {
+		react_start_action(action_code);
+		celero::DoNotOptimizeAway(i);
+		react_stop_action(action_code);
+	}
+}
+
+BENCHMARK(InactiveEdge, StartStopLibraryCall, SAMPLES_NUMBER, CALLS_NUMBER)
+{
+	int action_code = EDGE_ACTION.code();
+	for (size_t i = 0; i < EDGES_NUMBER; ++i) {
+		(react_start_action)(action_code);
+		celero::DoNotOptimizeAway(i);
+		(react_stop_action)(action_code);
+	}
+}
+
+BENCHMARK(InactiveEdge, Guard, SAMPLES_NUMBER, CALLS_NUMBER)
+{
+	int action_code = EDGE_ACTION.code();
+	for (size_t i = 0; i < EDGES_NUMBER; ++i) {
+		react::action_guard guard(action_code);
+		celero::DoNotOptimizeAway(i);
+	}
+}
+
+BENCHMARK(InactiveEdge, TypedGuard, SAMPLES_NUMBER, CALLS_NUMBER)
+{
+	for (size_t i = 0; i < EDGES_NUMBER; ++i) {
+		react::action_guard guard(EDGE_ACTION);
+		celero::DoNotOptimizeAway(i);
+	}
+}
+
+/*
+ * React is active: every edge adds a node to the context's tree
+ */
+
+BASELINE(ActiveEdge, Vanilla, SAMPLES_NUMBER, CALLS_NUMBER)
+{
+	react_activate(NULL);
+	for (size_t i = 0; i < EDGES_NUMBER; ++i) {
+		celero::DoNotOptimizeAway(i);
+	}
+	react_deactivate();
+}
+
+BENCHMARK(ActiveEdge, StartStop, SAMPLES_NUMBER, CALLS_NUMBER)
+{
+	int action_code = EDGE_ACTION.code();
+	react_activate(NULL);
+	for (size_t i = 0; i < EDGES_NUMBER; ++i) {
+		react_start_action(action_code);
+		celero::DoNotOptimizeAway(i);
+		react_stop_action(action_code);
+	}
+	react_deactivate();
+}
+
+BENCHMARK(ActiveEdge, Guard, SAMPLES_NUMBER, CALLS_NUMBER)
+{
+	int action_code = EDGE_ACTION.code();
+	react_activate(NULL);
+	for (size_t i = 0; i < EDGES_NUMBER; ++i) {
+		react::action_guard guard(action_code);
+		celero::DoNotOptimizeAway(i);
+	}
+	react_deactivate();
+}
+
+BENCHMARK(ActiveEdge, TypedGuard, SAMPLES_NUMBER, CALLS_NUMBER)
+{
+	react_activate(NULL);
+	for (size_t i = 0; i < EDGES_NUMBER; ++i) {
+		react::action_guard guard(EDGE_ACTION);
+		celero::DoNotOptimizeAway(i);
+	}
+	react_deactivate();
+}
+
+/*
+ * Updater used directly, without thread context lookup and code validation
+ */
+
+struct updater_context_t {
+	updater_context_t(): action_code(actions_set.define_new_action("ACTION")),
+		call_tree(actions_set), updater(call_tree) {}
+
+	void reset() {
+		call_tree.get_call_tree().reset();
+		updater.set_call_tree(call_tree);
+	}
+
+	react::actions_set_t actions_set;
+	int action_code;
+	react::concurrent_call_tree_t call_tree;
+	react::call_tree_updater_t updater;
+};
+
+BASELINE(UpdaterEdge, Vanilla, SAMPLES_NUMBER, CALLS_NUMBER)
+{
+	static updater_context_t context;
+	context.reset();
+	for (size_t i = 0; i < EDGES_NUMBER; ++i) {
+		celero::DoNotOptimizeAway(i);
+	}
+}
+
+BENCHMARK(UpdaterEdge, StartStop, SAMPLES_NUMBER, CALLS_NUMBER)
+{
+	static updater_context_t context;
+	context.reset();
+	for (size_t i = 0; i < EDGES_NUMBER; ++i) {
+		context.updater.start(context.action_code);
+		celero::DoNotOptimizeAway(i);
+		context.updater.stop(context.action_code);
+	}
+}
+
+BENCHMARK(UpdaterEdge, StartStopUnchecked, SAMPLES_NUMBER, CALLS_NUMBER)
+{
+	static updater_context_t context;
+	context.reset();
+	for (size_t i = 0; i < EDGES_NUMBER; ++i) {
+		context.updater.start_unchecked(context.action_code);
+		celero::DoNotOptimizeAway(i);
+		context.updater.stop_unchecked(context.action_code);
+	}
+}
+
+BENCHMARK(UpdaterEdge, StartStopEventLog, SAMPLES_NUMBER, CALLS_NUMBER)
+{
+	static updater_context_t context;
+	static react::event_log_t event_log(2 * EDGES_NUMBER);
+	context.reset();
+	event_log.clear();
+	context.updater.set_event_log(&event_log);
+	for (size_t i = 0; i < EDGES_NUMBER; ++i) {
+		context.updater.start(context.action_code);
+		celero::DoNotOptimizeAway(i);
+		context.updater.stop(context.action_code);
+	}
+}
@@ -0,0 +1,117 @@
+#include "benchmarks.hpp"
+
+#include <map>
+#include <ostream>
+#include <streambuf>
+
+#include "react/react.hpp"
+#include "react/binary.hpp"
+#include "react/profile_aggregator.hpp"
+
+/*
+ * Cost of merging and exporting finished trees of different sizes
+ */
+const size_t SAMPLES_NUMBER = 30;
+const size_t CHILDREN_NUMBER = 4;
+
+static react::actions_set_t &get_actions_set() {
+	static react::actions_set_t actions_set;
+	return actions_set;
+}
+
+/*!
+ * Returns tree with \a nodes_number nodes, each node has up to CHILDREN_NUMBER children
+ */
+static const react::call_tree_t &get_call_tree(size_t nodes_number) {
+	static std::map<size_t, react::call_tree_t> call_trees;
+
+	auto it = call_trees.find(nodes_number);
+	if (it != call_trees.end()) {
+		return it->second;
+	}
+
+	react::actions_set_t &actions_set = get_actions_set();
+	int actions_codes[] = {
+		actions_set.define_new_action("READ"),
+		actions_set.define_new_action("FIND"),
+		actions_set.define_new_action("LOAD FROM DISK"),
+		actions_set.define_new_action("PUT INTO CACHE")
+	};
+
+	react::call_tree_t call_tree(actions_set);
+	call_tree.add_stat("complete", true);
+	call_tree.add_stat("id", "0123456789abcdef");
+	for (size_t i = 1; i < nodes_number; ++i) {
+		react::call_tree_t::p_node_t parent = (i - 1) / CHILDREN_NUMBER;
+		react::call_tree_t::p_node_t node = call_tree.add_new_link(parent, actions_codes[i % CHILDREN_NUMBER]);
+		call_tree.set_node_start_time(node, 1000 * i);
+		call_tree.set_node_stop_time(node, 1000 * i + 500);
+	}
+
+	return call_trees.insert(std::make_pair(nodes_number, std::move(call_tree))).first->second;
+}
+
+/*!
+ * Stream buffer which drops everything written to it
+ */
+class null_buffer_t : public std::streambuf {
+protected:
+	std::streamsize xsputn(const char *, std::streamsize size) {
+		return size;
+	}
+
+	int overflow(int c) {
+		return c;
+	}
+};
+
+#define EXPORT_BENCHMARKS(group, nodes_number, calls_number)                     \
+BASELINE(group, Copy, SAMPLES_NUMBER, calls_number)                              \
+{                                                                                \
+	react::call_tree_t call_tree(get_call_tree(nodes_number));                   \
+	celero::DoNotOptimizeAway(call_tree.get_nodes_number());                     \
+}                                                                                \
+                                                                                 \
+BENCHMARK(group, MergeInto, SAMPLES_NUMBER, calls_number)                        \
+{                                                                                \
+	react::call_tree_t call_tree(get_actions_set());                             \
+	get_call_tree(nodes_number).merge_into(call_tree.root, call_tree);           \
+	celero::DoNotOptimizeAway(call_tree.get_nodes_number());                     \
+}                                                                                \
+                                                                                 \
+BENCHMARK(group, WriteJson, SAMPLES_NUMBER, calls_number)                        \
+{                                                                                \
+	rapidjson::StringBuffer buffer;                                              \
+	rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);                   \
+	get_call_tree(nodes_number).write_json(writer);                              \
+	celero::DoNotOptimizeAway(buffer.Size());                                    \
+}                                                                                \
+                                                                                 \
+BENCHMARK(group, ToJsonDom, SAMPLES_NUMBER, calls_number)                        \
+{                                                                                \
+	rapidjson::Document document;                                                \
+	document.SetObject();                                                        \
+	get_call_tree(nodes_number).to_json(document, document.GetAllocator());      \
+	rapidjson::StringBuffer buffer;                                              \
+	rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);                   \
+	document.Accept(writer);                                                     \
+	celero::DoNotOptimizeAway(buffer.Size());                                    \
+}                                                                                \
+                                                                                 \
+BENCHMARK(group, WriteBinary, SAMPLES_NUMBER, calls_number)                      \
+{                                                                                \
+	null_buffer_t buffer;                                                        \
+	std::ostream stream(&buffer);                                                \
+	react::binary_writer_t writer(stream);                                       \
+	writer.write(get_call_tree(nodes_number));                                   \
+}                                                                                \
+                                                                                 \
+BENCHMARK(group, FoldIntoProfile, SAMPLES_NUMBER, calls_number)                  \
+{                                                                                \
+	static react::call_graph_profile_t profile;                                  \
+	profile.add(get_call_tree(nodes_number));                                    \
+}
+
+EXPORT_BENCHMARKS(Export10, 10, 10000)
+EXPORT_BENCHMARKS(Export1000, 1000, 1000)
+EXPORT_BENCHMARKS(Export100000, 100000, 10)
@@ -1,39 +1,43 @@
 #include "benchmarks.hpp"
 
-#include <iostream>
-
 #include "react/react.hpp"
 
+/*
+ * Each call starts and stops FOR_ITERATIONS_NUMBER sibling actions in one context,
+ * baseline is the same loop without react calls.
+ */
 const size_t FOR_ITERATIONS_NUMBER = 1000;
-const size_t SAMPLES_NUMBER = 10;
-const size_t USEC_SLEEP_TIME = 1000;
+const size_t SAMPLES_NUMBER = 30;
+const size_t CALLS_NUMBER = 100;
 
-BASELINE(ForLoop, Vanilla, 1, SAMPLES_NUMBER)
+BASELINE(ForLoop, Vanilla, SAMPLES_NUMBER, CALLS_NUMBER)
 {
+	react_activate(NULL);
 	for(size_t i = 0; i < FOR_ITERATIONS_NUMBER; ++i) {
-		usleep(USEC_SLEEP_TIME);
+		celero::DoNotOptimizeAway(i);
 	}
+	react_deactivate();
 }
 
-BENCHMARK(ForLoop, StartStop, 1, SAMPLES_NUMBER)
+BENCHMARK(ForLoop, StartStop, SAMPLES_NUMBER, CALLS_NUMBER)
 {
 	int action_code = react_define_new_action("ACTION");
 	react_activate(NULL);
 	for(size_t i = 0; i < FOR_ITERATIONS_NUMBER; ++i) {
 		react_start_action(action_code);
-		usleep(USEC_SLEEP_TIME);
+		celero::DoNotOptimizeAway(i);
 		react_stop_action(action_code);
 	}
 	react_deactivate();
 }
 
-BENCHMARK(ForLoop, Guarded, 1, SAMPLES_NUMBER)
+BENCHMARK(ForLoop, Guarded, SAMPLES_NUMBER, CALLS_NUMBER)
 {
 	int action_code = react_define_new_action("ACTION");
 	react_activate(NULL);
 	for(size_t i = 0; i < FOR_ITERATIONS_NUMBER; ++i) {
 		react::action_guard guard(action_code);
-		usleep(USEC_SLEEP_TIME);
+		celero::DoNotOptimizeAway(i);
 	}
 	react_deactivate();
 }
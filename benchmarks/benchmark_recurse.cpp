@@ -1,12 +1,14 @@
 #include "benchmarks.hpp"
 
-#include <iostream>
-
 #include "react/react.hpp"
 
+/*
+ * Each call builds a chain of MAX_DEPTH nested actions in one context,
+ * baseline is the same recursion without react calls.
+ */
 const size_t MAX_DEPTH = 1000;
-const size_t SAMPLES_NUMBER = 10;
-const size_t USEC_SLEEP_TIME = 1000;
+const size_t SAMPLES_NUMBER = 30;
+const size_t CALLS_NUMBER = 100;
 
 int action_code = react_define_new_action("ACTION");
 
@@ -14,8 +16,9 @@ void recurseVanilla(size_t depth) {
 	if (depth > MAX_DEPTH) {
 		return;
 	}
-	usleep(USEC_SLEEP_TIME);
+	celero::DoNotOptimizeAway(depth);
 	recurseVanilla(depth + 1);
+	celero::DoNotOptimizeAway(depth);
 }
 
 void recurseStartStop(size_t depth) {
@@ -23,7 +26,6 @@ void recurseStartStop(size_t depth) {
 		return;
 	}
 	react_start_action(action_code);
-	usleep(USEC_SLEEP_TIME);
 	recurseStartStop(depth + 1);
 	react_stop_action(action_code);
 }
@@ -33,23 +35,24 @@ void recurseGuarded(size_t depth) {
 		return;
 	}
 	react::action_guard guard(action_code);
-	usleep(USEC_SLEEP_TIME);
 	recurseGuarded(depth + 1);
 }
 
-BASELINE(Recurse, Vanilla, 1, SAMPLES_NUMBER)
+BASELINE(Recurse, Vanilla, SAMPLES_NUMBER, CALLS_NUMBER)
 {
+	react_activate(NULL);
 	recurseVanilla(0);
+	react_deactivate();
 }
 
-BENCHMARK(Recurse, StartStop, 1, SAMPLES_NUMBER)
+BENCHMARK(Recurse, StartStop, SAMPLES_NUMBER, CALLS_NUMBER)
 {
 	react_activate(NULL);
 	recurseStartStop(0);
 	react_deactivate();
 }
 
-BENCHMARK(Recurse, Recurse, 1, SAMPLES_NUMBER)
+BENCHMARK(Recurse, Guarded, SAMPLES_NUMBER, CALLS_NUMBER)
 {
 	react_activate(NULL);
 	recurseGuarded(0);
@@ -1,4 +1,5 @@
 #include <iostream>
+#include <chrono>
 
 #include "react/react.h"
 
@@ -16,20 +17,22 @@ void recurse(size_t depth) {
 
 int main() {
 
-	size_t start_time = clock();
+	auto start_time = std::chrono::steady_clock::now();
 
 	react_activate(NULL);
 	recurse(0);
 	react_deactivate();
 
-	size_t stop_time = clock();
+	auto stop_time = std::chrono::steady_clock::now();
 
-	double total_time = double(stop_time - start_time) / CLOCKS_PER_SEC * 1000;
-	std::cerr << "Total time: " << total_time << "ms" << std::endl;
+	double total_time = std::chrono::duration_cast<std::chrono::nanoseconds>(stop_time - start_time).count();
 	double time_per_operation = total_time / MAX_DEPTH;
-	std::cerr << "Time per operation: " << time_per_operation << "ms" << std::endl;
-	int operations_per_sec = 1000 / time_per_operation;
-	std::cerr << "Operations per sec: " << operations_per_sec << std::endl;
+	std::cerr << "Total time: " << total_time / 1000000 << "ms" << std::endl;
+	std::cerr << "Time per operation: " << time_per_operation << "ns" << std::endl;
+	std::cerr << "Operations per sec: " << size_t(1000000000 / time_per_operation) << std::endl;
+
+	// Machine-readable result: benchmark,operations,total_ns,ns_per_operation
+	std::cout << "recurse," << MAX_DEPTH << "," << total_time << "," << time_per_operation << std::endl;
 
 	return 0;
 }
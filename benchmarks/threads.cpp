@@ -0,0 +1,133 @@
+#include <algorithm>
+#include <iostream>
+#include <chrono>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "react/react.hpp"
+#include "react/histogram_aggregator.hpp"
+#include "react/profile_aggregator.hpp"
+
+/*
+ * Each worker thread runs requests: activate -> nested start/stop -> deactivate
+ * into an aggregator shared by all workers. Number of workers grows from 1
+ * to number of cores, throughput and latency of requests are reported for each step.
+ *
+ * Usage: react-benchmarks-threads [max_threads_number] [requests_number]
+ */
+
+size_t CHILDREN_NUMBER = 4;
+
+int REQUEST_ACTION = react_define_new_action("REQUEST");
+int OUTER_ACTION = react_define_new_action("OUTER");
+int INNER_ACTION = react_define_new_action("INNER");
+
+/*!
+ * Stream buffer which drops everything written to it
+ */
+class null_buffer_t : public std::streambuf {
+protected:
+	std::streamsize xsputn(const char *, std::streamsize size) {
+		return size;
+	}
+
+	int overflow(int c) {
+		return c;
+	}
+};
+
+/*!
+ * Runs \a requests_number requests and records their latencies
+ */
+void run_requests(react::aggregator_t *aggregator, size_t requests_number,
+		react::latency_histogram_t &latencies) {
+	for (size_t i = 0; i < requests_number; ++i) {
+		auto start_time = std::chrono::steady_clock::now();
+
+		react_activate(aggregator);
+		react_start_action(REQUEST_ACTION);
+		for (size_t j = 0; j < CHILDREN_NUMBER; ++j) {
+			react_start_action(OUTER_ACTION);
+			for (size_t k = 0; k < CHILDREN_NUMBER; ++k) {
+				react_start_action(INNER_ACTION);
+				react_stop_action(INNER_ACTION);
+			}
+			react_stop_action(OUTER_ACTION);
+		}
+		react_add_stat_int("request", i);
+		react_stop_action(REQUEST_ACTION);
+		react_deactivate();
+
+		auto stop_time = std::chrono::steady_clock::now();
+		latencies.record(std::chrono::duration_cast<std::chrono::nanoseconds>(stop_time - start_time).count());
+	}
+}
+
+/*!
+ * Runs requests in \a threads_number threads and prints results
+ */
+void run_benchmark(const std::string &aggregator_name, react::aggregator_t *aggregator,
+		size_t threads_number, size_t requests_number) {
+	std::vector<react::latency_histogram_t> latencies(threads_number);
+	std::vector<std::thread> threads;
+
+	auto start_time = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < threads_number; ++i) {
+		threads.push_back(std::thread(run_requests, aggregator, requests_number, std::ref(latencies[i])));
+	}
+	for (size_t i = 0; i < threads_number; ++i) {
+		threads[i].join();
+	}
+	auto stop_time = std::chrono::steady_clock::now();
+
+	react::latency_histogram_t total_latencies;
+	for (size_t i = 0; i < threads_number; ++i) {
+		total_latencies.merge(latencies[i]);
+	}
+
+	double total_time = std::chrono::duration_cast<std::chrono::nanoseconds>(stop_time - start_time).count();
+	size_t total_requests_number = threads_number * requests_number;
+
+	std::cout << aggregator_name << "," << threads_number << "," << total_requests_number << ","
+		<< size_t(total_requests_number / total_time * 1000000000) << ","
+		<< total_latencies.get_quantile(0.5) << "," << total_latencies.get_quantile(0.99) << ","
+		<< total_latencies.get_quantile(1.) << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+	size_t max_threads_number = std::max(1u, std::thread::hardware_concurrency());
+	size_t requests_number = 100000;
+	if (argc > 1) {
+		max_threads_number = std::stoul(argv[1]);
+	}
+	if (argc > 2) {
+		requests_number = std::stoul(argv[2]);
+	}
+
+	null_buffer_t null_buffer;
+	std::ostream null_stream(&null_buffer);
+	react::stream_aggregator_t stream_aggregator(null_stream);
+	react::histogram_aggregator_t histogram_aggregator;
+	react::profile_aggregator_t profile_aggregator;
+
+	std::vector<std::pair<std::string, react::aggregator_t*>> aggregators;
+	aggregators.push_back(std::make_pair(std::string("none"), static_cast<react::aggregator_t*>(NULL)));
+	aggregators.push_back(std::make_pair(std::string("stream"), &stream_aggregator));
+	aggregators.push_back(std::make_pair(std::string("histogram"), &histogram_aggregator));
+	aggregators.push_back(std::make_pair(std::string("profile"), &profile_aggregator));
+
+	std::cout << "aggregator,threads,requests,requests_per_sec,p50_ns,p99_ns,max_ns" << std::endl;
+	for (size_t i = 0; i < aggregators.size(); ++i) {
+		for (size_t threads_number = 1; ; threads_number *= 2) {
+			threads_number = std::min(threads_number, max_threads_number);
+			run_benchmark(aggregators[i].first, aggregators[i].second, threads_number, requests_number);
+			if (threads_number == max_threads_number) {
+				break;
+			}
+		}
+	}
+
+	return 0;
+}
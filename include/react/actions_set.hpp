@@ -17,14 +17,272 @@
 #define REACT_ACTIONS_SET_HPP
 
 #include <iostream>
-#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstring>
 #include <stdexcept>
-#include <algorithm>
+#include <mutex>
+#include <atomic>
 
 namespace react {
 
+/*!
+ * \brief Registry of names, assigns consecutive codes to distinct names
+ *
+ * Names can be defined from any thread. Names are stored in append-only chunks
+ * that are never moved, so resolving names and checking codes is wait-free.
+ * Codes of names are found in open-addressing hash table without locking,
+ * only definition of new name takes the lock. Names are never removed,
+ * so registry grows with every distinct name.
+ */
+class names_registry_t {
+public:
+	/*!
+	 * \brief Initializes empty registry
+	 * \param kind What names are, used in error messages
+	 */
+	names_registry_t(const char *kind): kind(kind), names_number(0) {
+		for (size_t i = 0; i < MAX_CHUNKS_NUMBER; ++i) {
+			chunks[i].store(NULL, std::memory_order_relaxed);
+		}
+		table.store(new codes_table_t(FIRST_CHUNK_SIZE * 2, NULL), std::memory_order_relaxed);
+	}
+
+	names_registry_t(const names_registry_t &other) = delete;
+
+	/*!
+	 * \brief Frees memory consumed by registry
+	 */
+	~names_registry_t() {
+		for (size_t i = 0; i < MAX_CHUNKS_NUMBER; ++i) {
+			delete[] chunks[i].load(std::memory_order_relaxed);
+		}
+		delete table.load(std::memory_order_relaxed);
+	}
+
+	names_registry_t &operator =(const names_registry_t &other) = delete;
+
+	/*!
+	 * \brief Defines new name if it doesn't exist
+	 * \param name New name
+	 * \return Newly assigned code or code of already existing \a name
+	 */
+	int define(const char *name, size_t size) {
+		size_t hash = hash_name(name, size);
+		int code = find(name, size, hash);
+		if (code >= 0) {
+			return code;
+		}
+
+		std::lock_guard<std::mutex> guard(define_mutex);
+		code = find(name, size, hash);
+		if (code >= 0) {
+			return code;
+		}
+
+		code = names_number.load(std::memory_order_relaxed);
+		get_name_slot(code).assign(name, size);
+		codes_table_t *codes = reserve_code(code);
+		// Code must be valid before lock-free lookups can return it
+		names_number.store(code + 1, std::memory_order_release);
+		store_code(codes, hash, code);
+		return code;
+	}
+
+	int define(const std::string &name) {
+		return define(name.data(), name.size());
+	}
+
+	/*!
+	 * \brief Returns code of \a name or -1 if it is not defined
+	 */
+	int find(const char *name, size_t size) const {
+		return find(name, size, hash_name(name, size));
+	}
+
+	int find(const std::string &name) const {
+		return find(name.data(), name.size());
+	}
+
+	/*!
+	 * \brief Gets name by its \a code, which must be valid
+	 * \return Name, reference stays valid for the whole registry lifetime
+	 */
+	const std::string &get_name(int code) const {
+		size_t chunk, offset;
+		locate(code, chunk, offset);
+		return chunks[chunk].load(std::memory_order_relaxed)[offset];
+	}
+
+	/*!
+	 * \brief Checks whether \a code is assigned to some name
+	 */
+	bool code_is_valid(int code) const {
+		return code >= 0 && code < names_number.load(std::memory_order_acquire);
+	}
+
+private:
+	/*!
+	 * \brief Size of the first chunk, each next chunk is twice bigger
+	 */
+	static const size_t FIRST_CHUNK_SIZE = 64;
+
+	/*!
+	 * \brief Max number of chunks, limits number of names to FIRST_CHUNK_SIZE * (2^MAX_CHUNKS_NUMBER - 1)
+	 */
+	static const size_t MAX_CHUNKS_NUMBER = 24;
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Hash table of codes, slot keeps code + 1 or 0 if it is empty
+	 *
+	 * Table is filled at most by half. When it is grown, the new table
+	 * is published and the old one is kept for readers which still probe it.
+	 */
+	struct codes_table_t {
+		codes_table_t(size_t size, codes_table_t *previous):
+			mask(size - 1), slots(new std::atomic<int>[size]), previous(previous) {
+			for (size_t i = 0; i < size; ++i) {
+				slots[i].store(0, std::memory_order_relaxed);
+			}
+		}
+
+		~codes_table_t() {
+			delete[] slots;
+			delete previous;
+		}
+
+		const size_t mask;
+		std::atomic<int> *slots;
+		codes_table_t *previous;
+	};
+
+	/*!
+	 * \internal
+	 *
+	 * \brief FNV-1a hash of name
+	 */
+	static size_t hash_name(const char *name, size_t size) {
+		uint64_t hash = 14695981039346656037ULL;
+		for (size_t i = 0; i < size; ++i) {
+			hash = (hash ^ static_cast<unsigned char>(name[i])) * 1099511628211ULL;
+		}
+		return hash;
+	}
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Probes the current table for \a name with precomputed \a hash, doesn't lock
+	 */
+	int find(const char *name, size_t size, size_t hash) const {
+		const codes_table_t *codes = table.load(std::memory_order_acquire);
+		for (size_t i = hash & codes->mask;; i = (i + 1) & codes->mask) {
+			int slot = codes->slots[i].load(std::memory_order_acquire);
+			if (slot == 0) {
+				return -1;
+			}
+
+			const std::string &slot_name = get_name(slot - 1);
+			if (slot_name.size() == size && memcmp(slot_name.data(), name, size) == 0) {
+				return slot - 1;
+			}
+		}
+	}
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Grows hash table if needed, so that \a code fits in it
+	 * \return Table where \a code is to be stored.
+	 * Must be called under \a define_mutex.
+	 */
+	codes_table_t *reserve_code(int code) {
+		codes_table_t *codes = table.load(std::memory_order_relaxed);
+		if (2 * (static_cast<size_t>(code) + 1) > codes->mask + 1) {
+			codes_table_t *grown = new codes_table_t(2 * (codes->mask + 1), codes);
+			for (int i = 0; i < code; ++i) {
+				const std::string &name = get_name(i);
+				store_code(grown, hash_name(name.data(), name.size()), i);
+			}
+			table.store(grown, std::memory_order_release);
+			codes = grown;
+		}
+		return codes;
+	}
+
+	static void store_code(codes_table_t *codes, size_t hash, int code) {
+		size_t i = hash & codes->mask;
+		while (codes->slots[i].load(std::memory_order_relaxed) != 0) {
+			i = (i + 1) & codes->mask;
+		}
+		codes->slots[i].store(code + 1, std::memory_order_release);
+	}
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Finds chunk and offset in it where name of \a code is stored
+	 */
+	static void locate(int code, size_t &chunk, size_t &offset) {
+		size_t position = code / FIRST_CHUNK_SIZE + 1;
+		chunk = 8 * sizeof(unsigned long) - 1 - __builtin_clzl(position);
+		offset = code - FIRST_CHUNK_SIZE * ((size_t(1) << chunk) - 1);
+	}
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Returns storage for name of \a code, allocates chunk if needed.
+	 * Must be called under \a define_mutex.
+	 */
+	std::string &get_name_slot(int code) {
+		size_t chunk, offset;
+		locate(code, chunk, offset);
+		if (chunk >= MAX_CHUNKS_NUMBER) {
+			throw std::length_error(std::string("Can't define new ") + kind + ": too many names");
+		}
+
+		std::string *names = chunks[chunk].load(std::memory_order_relaxed);
+		if (!names) {
+			names = new std::string[FIRST_CHUNK_SIZE << chunk];
+			chunks[chunk].store(names, std::memory_order_release);
+		}
+		return names[offset];
+	}
+
+	/*!
+	 * \brief What names are, used in error messages
+	 */
+	const char *kind;
+
+	/*!
+	 * \brief Number of defined names, published after name is stored
+	 */
+	std::atomic<int> names_number;
+
+	/*!
+	 * \brief Chunks of names indexed by codes
+	 */
+	std::atomic<std::string*> chunks[MAX_CHUNKS_NUMBER];
+
+	/*!
+	 * \brief Current hash table of codes, older tables are chained to it
+	 */
+	std::atomic<codes_table_t*> table;
+
+	/*!
+	 * \brief Serializes definitions of new names
+	 */
+	mutable std::mutex define_mutex;
+};
+
 /*!
  * \brief Represents set of actions that allows defining new actions and resolving action's names by their codes
+ *
+ * Actions can be defined from any thread, resolving names and checking codes is wait-free.
+ * Set also interns keys of stats, so that trees store stats by integer keys.
  */
 class actions_set_t {
 public:
@@ -34,14 +292,18 @@ public:
 	static const int NO_ACTION = -1;
 
 	/*!
-	 * \brief Initializes empty actions set
+	 * \brief Value for representing unknown stat key
 	 */
-	actions_set_t() {}
+	static const int NO_STAT_KEY = -1;
 
 	/*!
-	 * \brief Frees memory consumed by actions set
+	 * \brief Initializes empty actions set
 	 */
-	~actions_set_t() {}
+	actions_set_t(): actions("action"), stat_keys("stat key") {}
+
+	actions_set_t(const actions_set_t &other) = delete;
+
+	actions_set_t &operator =(const actions_set_t &other) = delete;
 
 	/*!
 	 * \brief Defines new action if action with the same name doesn't exist
@@ -49,26 +311,20 @@ public:
 	 * \return Newly created action's code or code of already existing action with \a action_name
 	 */
 	int define_new_action(const std::string& action_name) {
-		auto it = std::find(actions_names.begin(), actions_names.end(), action_name);
-		if (it != actions_names.end()) {
-			return std::distance(actions_names.begin(), it);
-		}
-
-		int action_code = actions_names.size();
-		actions_names.push_back(action_name);
-		return action_code;
+		return actions.define(action_name);
 	}
 
 	/*!
 	 * \brief Gets action's name by its \a action_code
 	 * \param action_code Action's code
-	 * \return Action's name
+	 * \return Action's name, reference stays valid for the whole actions set lifetime
 	 */
-	std::string get_action_name(int action_code) const {
+	const std::string &get_action_name(int action_code) const {
 		if (!code_is_valid(action_code)) {
 			throw std::invalid_argument("Can't get name: action_code is invalid");
 		}
-		return actions_names.at(action_code);
+
+		return actions.get_name(action_code);
 	}
 
 	/*!
@@ -77,17 +333,64 @@ public:
 	 * \return True if \a action_code is registred, false otherwise
 	 */
 	bool code_is_valid(int action_code) const {
-		if (action_code == NO_ACTION) {
-			return false;
+		return actions.code_is_valid(action_code);
+	}
+
+	/*!
+	 * \brief Interns stat key \a key_name
+	 *
+	 * Interning doesn't change meaning of existing keys, so it is allowed on const set.
+	 * Lookup of already interned key doesn't lock. Keys are permanent: they are kept
+	 * for the whole actions set lifetime, so keys should come from a bounded set of names,
+	 * not from request data.
+	 *
+	 * \param key_name Name of stat key
+	 * \return Code of stat key
+	 */
+	int define_stat_key(const std::string &key_name) const {
+		return stat_keys.define(key_name);
+	}
+
+	int define_stat_key(const char *key_name) const {
+		return stat_keys.define(key_name, strlen(key_name));
+	}
+
+	/*!
+	 * \brief Returns code of stat key \a key_name or NO_STAT_KEY if it was never interned
+	 */
+	int find_stat_key(const std::string &key_name) const {
+		return stat_keys.find(key_name);
+	}
+
+	/*!
+	 * \brief Gets name of stat key by its \a key code
+	 * \return Name of stat key, reference stays valid for the whole actions set lifetime
+	 */
+	const std::string &get_stat_key_name(int key) const {
+		if (!stat_key_is_valid(key)) {
+			throw std::invalid_argument("Can't get name: stat key is invalid");
 		}
-		return static_cast<size_t>(action_code) < actions_names.size();
+
+		return stat_keys.get_name(key);
+	}
+
+	/*!
+	 * \brief Checks whether stat \a key is interned in actions_set
+	 */
+	bool stat_key_is_valid(int key) const {
+		return stat_keys.code_is_valid(key);
 	}
 
 private:
 	/*!
-	 * \brief Map between actions codes and actions names
+	 * \brief Names of actions
+	 */
+	names_registry_t actions;
+
+	/*!
+	 * \brief Names of stat keys
 	 */
-	std::vector<std::string> actions_names;
+	mutable names_registry_t stat_keys;
 };
 
 } // namespace react
@@ -16,7 +16,16 @@
 #ifndef REACT_AGGREGATOR_HPP
 #define REACT_AGGREGATOR_HPP
 
-#include <list>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
 
 #include "call_tree.hpp"
 #include "utils.hpp"
@@ -43,18 +52,379 @@ public:
 	 * \param Call tree for aggregation
 	 */
 	virtual void aggregate(const call_tree_t &call_tree) = 0;
+
+	/*!
+	 * \brief Aggregates call tree which is no longer needed by the caller
+	 *
+	 * Aggregator may take contents of \a call_tree instead of copying them.
+	 * By default tree is aggregated by aggregate(const call_tree_t &).
+	 *
+	 * \param call_tree Call tree for aggregation
+	 */
+	virtual void aggregate_owned(call_tree_t &&call_tree) {
+		aggregate(call_tree);
+	}
+
+	/*!
+	 * \brief Decides at activation whether request will be traced (head-based sampling)
+	 *
+	 * Unsampled request is not traced at all: its actions and stats are ignored
+	 * and nothing is aggregated. By default all requests are sampled.
+	 *
+	 * \return Whether request should be traced
+	 */
+	virtual bool sample() {
+		return true;
+	}
+};
+
+/*!
+ * \brief Returns unique id for thread_shards_t, which is never reused unlike its address
+ */
+inline uint64_t next_thread_shards_id() {
+	static std::atomic<uint64_t> last_id(0);
+	return ++last_id;
+}
+
+/*!
+ * \brief Set of per-thread instances of \a Shard
+ *
+ * Each thread gets its own shard on the first call to local(), later calls find it
+ * in a thread-local list without any locking. When thread exits its shards are marked
+ * as retired, values written by them are kept until reclaim_retired() hands them over.
+ * Set is meant to be long-lived, since every thread remembers each set it has touched
+ * until it creates a shard after the set is destroyed.
+ */
+template<typename Shard>
+class thread_shards_t {
+public:
+	thread_shards_t(): id(next_thread_shards_id()) {}
+
+	thread_shards_t(const thread_shards_t &) = delete;
+	thread_shards_t &operator =(const thread_shards_t &) = delete;
+
+	/*!
+	 * \brief Tells threads which still own shards of the set that it is destroyed
+	 */
+	~thread_shards_t() {
+		std::lock_guard<std::mutex> guard(shards_mutex);
+		for (auto it = shards.begin(); it != shards.end(); ++it) {
+			(*it)->set_is_destroyed.store(true, std::memory_order_relaxed);
+		}
+	}
+
+	/*!
+	 * \brief Returns shard of calling thread, creates it on first call
+	 */
+	Shard &local() {
+		thread_entries_t &thread_entries = get_thread_entries();
+		for (auto it = thread_entries.entries.begin(); it != thread_entries.entries.end(); ++it) {
+			if (it->first == id) {
+				return it->second->shard;
+			}
+		}
+
+		return add_local_shard(thread_entries);
+	}
+
+	/*!
+	 * \brief Calls \a function for shards of all threads, including exited but not yet reclaimed ones
+	 *
+	 * Shards are created concurrently with the call, but \a function
+	 * must synchronize access to shard contents with their owners itself.
+	 */
+	template<typename Function>
+	void for_each(Function function) {
+		std::lock_guard<std::mutex> guard(shards_mutex);
+		for (auto it = shards.begin(); it != shards.end(); ++it) {
+			function((*it)->shard);
+		}
+	}
+
+	/*!
+	 * \brief Removes shards of exited threads
+	 *
+	 * \a function is called for each of them before removal, so their values
+	 * can be moved elsewhere. Owner's writes are visible to \a function.
+	 */
+	template<typename Function>
+	void reclaim_retired(Function function) {
+		std::lock_guard<std::mutex> guard(shards_mutex);
+		auto it = shards.begin();
+		while (it != shards.end()) {
+			if ((*it)->is_retired.load(std::memory_order_acquire)) {
+				function((*it)->shard);
+				it = shards.erase(it);
+			} else {
+				++it;
+			}
+		}
+	}
+
+private:
+	/*!
+	 * \internal
+	 *
+	 * \brief Shard shared by owner thread and the set, freed by the last of them
+	 */
+	struct entry_t {
+		entry_t(): is_retired(false), set_is_destroyed(false) {}
+
+		Shard shard;
+
+		/*!
+		 * \brief Whether owner thread has exited
+		 */
+		std::atomic<bool> is_retired;
+
+		/*!
+		 * \brief Whether set is destroyed, so owner thread may forget the entry
+		 */
+		std::atomic<bool> set_is_destroyed;
+	};
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Shards of one thread from all sets, retires them on thread exit
+	 */
+	struct thread_entries_t {
+		~thread_entries_t() {
+			for (auto it = entries.begin(); it != entries.end(); ++it) {
+				it->second->is_retired.store(true, std::memory_order_release);
+			}
+		}
+
+		std::vector<std::pair<uint64_t, std::shared_ptr<entry_t>>> entries;
+	};
+
+	static thread_entries_t &get_thread_entries() {
+		static thread_local thread_entries_t thread_entries;
+		return thread_entries;
+	}
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Creates shard of calling thread, slow path of local()
+	 */
+	Shard &add_local_shard(thread_entries_t &thread_entries) {
+		std::vector<std::pair<uint64_t, std::shared_ptr<entry_t>>> &entries = thread_entries.entries;
+		entries.erase(std::remove_if(entries.begin(), entries.end(),
+				[] (const std::pair<uint64_t, std::shared_ptr<entry_t>> &entry) {
+					return entry.second->set_is_destroyed.load(std::memory_order_relaxed);
+				}), entries.end());
+
+		std::shared_ptr<entry_t> entry = std::make_shared<entry_t>();
+		{
+			std::lock_guard<std::mutex> guard(shards_mutex);
+			shards.push_back(entry);
+		}
+		entries.push_back(std::make_pair(id, entry));
+		return entry->shard;
+	}
+
+	/*!
+	 * \brief Identifies this set in threads' lists of shards
+	 */
+	const uint64_t id;
+
+	/*!
+	 * \brief Protects list of shards
+	 */
+	std::mutex shards_mutex;
+
+	/*!
+	 * \brief Shards of all threads which are not reclaimed yet
+	 */
+	std::vector<std::shared_ptr<entry_t>> shards;
+};
+
+/*!
+ * \brief Base class for summary aggregators with per-thread state
+ *
+ * Trees are aggregated into shard of the calling thread without any locking.
+ * Each thread owns two buffers of its shard and writes into the one selected by
+ * shard's epoch. collect() flips the epoch, waits for the owner to leave the
+ * call which may still use the old buffer and folds that buffer into the global view,
+ * so the hot path never waits for collector or other workers.
+ * Shards of exited threads are folded and freed by collect().
+ * collect() is called by readers and may be called periodically by periodic_collector_t.
+ */
+template<typename Shard>
+class sharded_aggregator_t : public aggregator_t {
+public:
+	/*!
+	 * \brief Aggregates \a call_tree into shard of calling thread
+	 * \param call_tree Tree for aggregation
+	 */
+	void aggregate(const call_tree_t &call_tree) {
+		double_buffered_shard_t &shard = shards.local();
+		uint32_t sequence = shard.sequence.load(std::memory_order_relaxed);
+		shard.sequence.store(sequence + 1, std::memory_order_relaxed);
+		// Either collector sees odd sequence and waits or we see its new epoch
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		uint32_t epoch = shard.epoch.load(std::memory_order_relaxed);
+		aggregate_shard(shard.buffers[epoch & 1], call_tree);
+		shard.sequence.store(sequence + 2, std::memory_order_release);
+	}
+
+	/*!
+	 * \brief Moves contents of all shards into the global view
+	 */
+	void collect() {
+		std::lock_guard<std::mutex> guard(collect_mutex);
+		shards.reclaim_retired([this] (double_buffered_shard_t &shard) {
+			collect_shard(shard.buffers[0]);
+			collect_shard(shard.buffers[1]);
+		});
+		shards.for_each([this] (double_buffered_shard_t &shard) {
+			uint32_t epoch = shard.epoch.load(std::memory_order_relaxed);
+			shard.epoch.store(epoch + 1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			uint32_t sequence = shard.sequence.load(std::memory_order_acquire);
+			if (sequence & 1) {
+				// Owner may still write into the old buffer
+				while (shard.sequence.load(std::memory_order_acquire) == sequence) {
+					std::this_thread::yield();
+				}
+			}
+			collect_shard(shard.buffers[epoch & 1]);
+		});
+	}
+
+protected:
+	/*!
+	 * \brief Aggregates \a call_tree into \a shard, called by owner of the shard
+	 */
+	virtual void aggregate_shard(Shard &shard, const call_tree_t &call_tree) = 0;
+
+	/*!
+	 * \brief Moves contents of \a shard into the global view and clears it
+	 *
+	 * Calls are serialized by collect(), so the global view
+	 * needs its own lock only to be read concurrently.
+	 */
+	virtual void collect_shard(Shard &shard) = 0;
+
+private:
+	/*!
+	 * \internal
+	 *
+	 * \brief Pair of shards: owner writes into one of them while collector drains the other
+	 */
+	struct double_buffered_shard_t {
+		double_buffered_shard_t(): epoch(0), sequence(0) {}
+
+		Shard buffers[2];
+
+		/*!
+		 * \brief Selects buffer written by owner, changed only by collector
+		 */
+		std::atomic<uint32_t> epoch;
+
+		/*!
+		 * \brief Odd while owner is inside aggregate(), changed only by owner
+		 */
+		std::atomic<uint32_t> sequence;
+	};
+
+	/*!
+	 * \brief Serializes collections
+	 */
+	std::mutex collect_mutex;
+
+	/*!
+	 * \brief Per-thread shards
+	 */
+	thread_shards_t<double_buffered_shard_t> shards;
+};
+
+/*!
+ * \brief Background thread that periodically calls collection function
+ *
+ * Usually used with sharded_aggregator_t::collect, so that global view
+ * is kept fresh and shards don't grow between reads.
+ */
+class periodic_collector_t {
+public:
+	/*!
+	 * \brief Starts background thread
+	 * \param collect Function which is called every \a interval
+	 * \param interval Time between calls
+	 */
+	periodic_collector_t(std::function<void ()> collect, std::chrono::milliseconds interval):
+		collect(collect), interval(interval), is_stopping(false),
+		worker(&periodic_collector_t::run, this) {}
+
+	/*!
+	 * \brief Calls collection function for the last time and stops background thread
+	 */
+	~periodic_collector_t() {
+		{
+			std::lock_guard<std::mutex> guard(mutex);
+			is_stopping = true;
+		}
+		condition.notify_one();
+		worker.join();
+	}
+
+private:
+	/*!
+	 * \internal
+	 *
+	 * \brief Background thread loop
+	 */
+	void run() {
+		std::unique_lock<std::mutex> lock(mutex);
+		while (!is_stopping) {
+			condition.wait_for(lock, interval, [this] () { return is_stopping; });
+			lock.unlock();
+			collect();
+			lock.lock();
+		}
+	}
+
+	/*!
+	 * \brief Collection function
+	 */
+	std::function<void ()> collect;
+
+	/*!
+	 * \brief Time between calls of collection function
+	 */
+	const std::chrono::milliseconds interval;
+
+	std::mutex mutex;
+	std::condition_variable condition;
+
+	/*!
+	 * \brief Shows whether collector is being destroyed
+	 */
+	bool is_stopping;
+
+	/*!
+	 * \brief Background thread, started last when all other members are initialized
+	 */
+	std::thread worker;
 };
 
 /*!
  * \brief Aggregator that outputs aggregated trees to stream
+ *
+ * Each tree is written as compact json on a separate line. Trees are serialized
+ * straight into a reusable buffer, without building json DOM.
  */
 class stream_aggregator_t : public aggregator_t {
 public:
 	/*!
 	 * \brief Constructs aggregator
 	 * \param os Stream where aggregated trees will be outputed
+	 * \param flush_each_tree Whether stream should be flushed after each tree,
+	 *        otherwise flushing is left to the stream
 	 */
-	stream_aggregator_t(std::ostream &os): os(os) {}
+	stream_aggregator_t(std::ostream &os, bool flush_each_tree = false):
+		os(os), flush_each_tree(flush_each_tree), writer(buffer) {}
 
 	/*!
 	 * \brief Frees memory consumed by stream_aggregator
@@ -66,7 +436,16 @@ public:
 	 * \param call_tree Tree that will be outputed
 	 */
 	void aggregate(const call_tree_t &call_tree) {
-		os << print_json_to_string(call_tree) << std::endl;
+		std::lock_guard<std::mutex> guard(buffer_mutex);
+
+		buffer.Clear();
+		call_tree.write_json(writer);
+		buffer.Put('\n');
+
+		os.write(buffer.GetString(), buffer.Size());
+		if (flush_each_tree) {
+			os.flush();
+		}
 	}
 
 private:
@@ -74,6 +453,26 @@ private:
 	 * \brief Target stream where aggregated trees will be outputed
 	 */
 	std::ostream &os;
+
+	/*!
+	 * \brief Shows whether stream is flushed after each tree
+	 */
+	bool flush_each_tree;
+
+	/*!
+	 * \brief Serializes trees aggregated from different threads
+	 */
+	std::mutex buffer_mutex;
+
+	/*!
+	 * \brief Reusable buffer for serialized tree
+	 */
+	rapidjson::StringBuffer buffer;
+
+	/*!
+	 * \brief Json writer targeted to \a buffer
+	 */
+	rapidjson::Writer<rapidjson::StringBuffer> writer;
 };
 
 } // namespace react
@@ -0,0 +1,262 @@
+/*
+* 2013+ Copyright (c) Andrey Kashin <kashin.andrej@gmail.com>
+* All rights reserved.
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*/
+
+#ifndef REACT_ASYNC_AGGREGATOR_HPP
+#define REACT_ASYNC_AGGREGATOR_HPP
+
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <iostream>
+
+#include "aggregator.hpp"
+
+namespace react {
+
+/*!
+ * \brief Aggregator that passes trees to another aggregator in background thread
+ *
+ * Trees are moved into a bounded queue, which is drained by a dedicated thread,
+ * so serialization and output of trees don't add to latency of traced threads.
+ * Queue may be filled by any number of threads.
+ */
+class async_aggregator_t : public aggregator_t {
+public:
+	/*!
+	 * \brief Defines what happens with new tree when queue is full
+	 */
+	enum overflow_policy_t {
+		/*!
+		 * \brief New tree is dropped
+		 */
+		DROP_NEWEST,
+
+		/*!
+		 * \brief Oldest queued tree is dropped to free space for the new one
+		 */
+		DROP_OLDEST,
+
+		/*!
+		 * \brief Caller waits until there is free space in the queue
+		 */
+		BLOCK
+	};
+
+	/*!
+	 * \brief Default max number of queued trees
+	 */
+	static const size_t DEFAULT_QUEUE_CAPACITY = 1024;
+
+	/*!
+	 * \brief Constructs aggregator and starts background thread
+	 * \param target Aggregator which will receive trees in background thread
+	 * \param queue_capacity Max number of queued trees
+	 * \param overflow_policy Defines what happens with new tree when queue is full
+	 */
+	async_aggregator_t(aggregator_t &target,
+			size_t queue_capacity = DEFAULT_QUEUE_CAPACITY,
+			overflow_policy_t overflow_policy = DROP_NEWEST):
+		target(target), queue_capacity(queue_capacity), overflow_policy(overflow_policy),
+		is_stopping(false), is_busy(false), dropped_trees_number(0), aggregated_trees_number(0),
+		worker(&async_aggregator_t::run, this) {}
+
+	/*!
+	 * \brief Aggregates all queued trees and stops background thread
+	 */
+	~async_aggregator_t() {
+		{
+			std::lock_guard<std::mutex> guard(queue_mutex);
+			is_stopping = true;
+		}
+		queue_not_empty.notify_one();
+		queue_not_full.notify_all();
+		worker.join();
+	}
+
+	/*!
+	 * \brief Queues copy of call tree for aggregation
+	 *
+	 * Tree which would be dropped by DROP_NEWEST policy is not copied.
+	 *
+	 * \param call_tree Tree for aggregation
+	 */
+	void aggregate(const call_tree_t &call_tree) {
+		if (overflow_policy == DROP_NEWEST) {
+			std::lock_guard<std::mutex> guard(queue_mutex);
+			if (queue.size() >= queue_capacity) {
+				dropped_trees_number.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+		}
+
+		push(call_tree_t(call_tree));
+	}
+
+	/*!
+	 * \brief Moves call tree into queue for aggregation
+	 * \param call_tree Tree for aggregation
+	 */
+	void aggregate_owned(call_tree_t &&call_tree) {
+		push(std::move(call_tree));
+	}
+
+	/*!
+	 * \brief Lets target aggregator decide whether request will be traced
+	 */
+	bool sample() {
+		return target.sample();
+	}
+
+	/*!
+	 * \brief Blocks until all queued trees are aggregated
+	 */
+	void flush() {
+		std::unique_lock<std::mutex> lock(queue_mutex);
+		queue_drained.wait(lock, [this] () { return queue.empty() && !is_busy; });
+	}
+
+	/*!
+	 * \brief Returns number of trees dropped due to queue overflow
+	 * \return Number of dropped trees
+	 */
+	size_t get_dropped_trees_number() const {
+		return dropped_trees_number.load(std::memory_order_relaxed);
+	}
+
+	/*!
+	 * \brief Returns number of trees passed to target aggregator
+	 * \return Number of aggregated trees
+	 */
+	size_t get_aggregated_trees_number() const {
+		return aggregated_trees_number.load(std::memory_order_relaxed);
+	}
+
+private:
+	/*!
+	 * \internal
+	 *
+	 * \brief Puts tree into queue according to overflow policy
+	 */
+	void push(call_tree_t &&call_tree) {
+		{
+			std::unique_lock<std::mutex> lock(queue_mutex);
+			if (queue.size() >= queue_capacity) {
+				switch (overflow_policy) {
+				case DROP_NEWEST:
+					dropped_trees_number.fetch_add(1, std::memory_order_relaxed);
+					return;
+				case DROP_OLDEST:
+					queue.pop_front();
+					dropped_trees_number.fetch_add(1, std::memory_order_relaxed);
+					break;
+				case BLOCK:
+					queue_not_full.wait(lock, [this] () {
+						return queue.size() < queue_capacity || is_stopping;
+					});
+					break;
+				}
+			}
+			queue.push_back(std::move(call_tree));
+		}
+		queue_not_empty.notify_one();
+	}
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Background thread loop, passes queued trees to target aggregator
+	 */
+	void run() {
+		std::unique_lock<std::mutex> lock(queue_mutex);
+		while (true) {
+			queue_not_empty.wait(lock, [this] () { return !queue.empty() || is_stopping; });
+			if (queue.empty()) {
+				return;
+			}
+
+			call_tree_t call_tree(std::move(queue.front()));
+			queue.pop_front();
+			is_busy = true;
+			lock.unlock();
+			queue_not_full.notify_one();
+
+			try {
+				target.aggregate_owned(std::move(call_tree));
+			} catch (std::exception &e) {
+				std::cerr << e.what() << std::endl;
+			}
+			aggregated_trees_number.fetch_add(1, std::memory_order_relaxed);
+
+			lock.lock();
+			is_busy = false;
+			if (queue.empty()) {
+				queue_drained.notify_all();
+			}
+		}
+	}
+
+	/*!
+	 * \brief Aggregator which receives trees in background thread
+	 */
+	aggregator_t &target;
+
+	/*!
+	 * \brief Max number of queued trees
+	 */
+	const size_t queue_capacity;
+
+	/*!
+	 * \brief Defines what happens with new tree when queue is full
+	 */
+	const overflow_policy_t overflow_policy;
+
+	/*!
+	 * \brief Trees waiting for aggregation
+	 */
+	std::deque<call_tree_t> queue;
+
+	/*!
+	 * \brief Protects queue and flags
+	 */
+	std::mutex queue_mutex;
+
+	std::condition_variable queue_not_empty;
+	std::condition_variable queue_not_full;
+	std::condition_variable queue_drained;
+
+	/*!
+	 * \brief Shows whether aggregator is being destroyed
+	 */
+	bool is_stopping;
+
+	/*!
+	 * \brief Shows whether background thread is aggregating a tree
+	 */
+	bool is_busy;
+
+	std::atomic<size_t> dropped_trees_number;
+	std::atomic<size_t> aggregated_trees_number;
+
+	/*!
+	 * \brief Background thread, started last when all other members are initialized
+	 */
+	std::thread worker;
+};
+
+} // namespace react
+
+#endif // REACT_ASYNC_AGGREGATOR_HPP
@@ -0,0 +1,661 @@
+/*
+* 2013+ Copyright (c) Andrey Kashin <kashin.andrej@gmail.com>
+* All rights reserved.
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*/
+
+#ifndef REACT_BINARY_HPP
+#define REACT_BINARY_HPP
+
+#include <istream>
+#include <ostream>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+
+#include "aggregator.hpp"
+
+namespace react {
+
+/*!
+ * \brief Compact binary format of call trees stream
+ *
+ * Stream starts with header: magic bytes "RCT" and format version byte.
+ * Header is followed by records, each starting with record type byte:
+ * - ACTION_RECORD: action code and name, emitted once per stream before first use of the action
+ * - TREE_RECORD: call tree
+ * - STAT_KEY_RECORD: stat key code and name, emitted once per stream before first use of the key
+ *
+ * Tree record contains number of stats and stats themselves (key code, type byte and value),
+ * number of collapsed actions, followed by nodes in preorder. Root is stored as number
+ * of its children, every other node as action code, start time delta from parent's start time,
+ * duration and number of children shifted left by two bits. Lowest bit of the last field shows
+ * that node has summary, which follows as number of calls, total, min and max time.
+ * Next bit shows that node has stats, which follow as their number and stats themselves
+ * (key code, type byte and value).
+ * Times are in nanoseconds since epoch (parent's start time of top-level nodes is zero).
+ * Integers are LEB128 varints, signed ones are zigzag encoded, doubles are 8 bytes little-endian.
+ */
+namespace binary {
+
+/*!
+ * \brief Stream magic bytes
+ */
+static const char MAGIC[] = {'R', 'C', 'T'};
+
+/*!
+ * \brief Format version
+ */
+static const unsigned char VERSION = 1;
+
+/*!
+ * \brief Types of records
+ */
+enum record_type_t {
+	ACTION_RECORD = 1,
+	TREE_RECORD = 2,
+	STAT_KEY_RECORD = 3
+};
+
+/*!
+ * \brief Types of stats values
+ */
+enum stat_type_t {
+	BOOL_STAT = 0,
+	INT_STAT = 1,
+	DOUBLE_STAT = 2,
+	STRING_STAT = 3,
+	COUNTER_STAT = 4
+};
+
+/*!
+ * \brief Appends unsigned varint to \a buffer
+ */
+inline void put_varint(std::string &buffer, uint64_t value) {
+	while (value >= 0x80) {
+		buffer.push_back(static_cast<char>((value & 0x7f) | 0x80));
+		value >>= 7;
+	}
+	buffer.push_back(static_cast<char>(value));
+}
+
+/*!
+ * \brief Appends zigzag encoded signed varint to \a buffer
+ */
+inline void put_signed_varint(std::string &buffer, int64_t value) {
+	put_varint(buffer, (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+}
+
+/*!
+ * \brief Appends length-prefixed string to \a buffer
+ */
+inline void put_string(std::string &buffer, const std::string &value) {
+	put_varint(buffer, value.size());
+	buffer.append(value);
+}
+
+/*!
+ * \brief Appends little-endian double to \a buffer
+ */
+inline void put_double(std::string &buffer, double value) {
+	uint64_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	for (size_t i = 0; i < sizeof(bits); ++i) {
+		buffer.push_back(static_cast<char>((bits >> (8 * i)) & 0xff));
+	}
+}
+
+/*!
+ * \brief Appends typed value of \a stat of \a call_tree to \a buffer
+ */
+inline void put_stat_value(std::string &buffer, const call_tree_t &call_tree, const stat_t &stat) {
+	switch (stat.type) {
+	case stat_t::BOOL:
+		buffer.push_back(BOOL_STAT);
+		buffer.push_back(stat.bool_value ? 1 : 0);
+		break;
+	case stat_t::INT:
+		buffer.push_back(INT_STAT);
+		put_signed_varint(buffer, stat.int_value);
+		break;
+	case stat_t::DOUBLE:
+		buffer.push_back(DOUBLE_STAT);
+		put_double(buffer, stat.double_value);
+		break;
+	case stat_t::STRING:
+		buffer.push_back(STRING_STAT);
+		put_varint(buffer, stat.string_size);
+		buffer.append(call_tree.get_stat_string(stat), stat.string_size);
+		break;
+	case stat_t::COUNTER:
+		buffer.push_back(COUNTER_STAT);
+		put_signed_varint(buffer, stat.int_value);
+		break;
+	}
+}
+
+} // namespace binary
+
+/*!
+ * \brief Encodes call trees into binary stream
+ *
+ * Writer remembers which actions were already written to the stream,
+ * so all trees written by the same writer must use the same actions set.
+ */
+class binary_writer_t {
+public:
+	/*!
+	 * \brief Initializes writer and writes stream header to \a os
+	 * \param os Target stream
+	 */
+	binary_writer_t(std::ostream &os): os(os) {
+		os.write(binary::MAGIC, sizeof(binary::MAGIC));
+		os.put(binary::VERSION);
+	}
+
+	/*!
+	 * \brief Encodes \a call_tree and writes it to stream
+	 * \param call_tree Tree to write
+	 */
+	void write(const call_tree_t &call_tree) {
+		buffer.clear();
+		write_new_actions(call_tree);
+
+		buffer.push_back(binary::TREE_RECORD);
+		const std::vector<stat_t> &stats = call_tree.get_stats();
+		binary::put_varint(buffer, stats.size());
+		for (auto it = stats.begin(); it != stats.end(); ++it) {
+			binary::put_varint(buffer, it->key);
+			binary::put_stat_value(buffer, call_tree, *it);
+		}
+		binary::put_varint(buffer, call_tree.get_collapsed_actions_number());
+
+		write_nodes(call_tree);
+		os.write(buffer.data(), buffer.size());
+	}
+
+private:
+	typedef call_tree_t::p_node_t p_node_t;
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Children of a node that are being written and start time of this node
+	 */
+	struct frame_t {
+		frame_t(const node_links_t &links, int64_t start_time):
+			next_child(links.begin()), end(links.end()), start_time(start_time) {}
+
+		node_links_t::const_iterator next_child;
+		node_links_t::const_iterator end;
+		int64_t start_time;
+	};
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Writes definitions of actions and stats keys used in tree that were not written yet
+	 */
+	void write_new_actions(const call_tree_t &call_tree) {
+		const actions_set_t &actions_set = call_tree.get_actions_set();
+		const std::vector<stat_t> &stats = call_tree.get_stats();
+		for (auto it = stats.begin(); it != stats.end(); ++it) {
+			write_new_stat_key(actions_set, it->key);
+		}
+
+		for (p_node_t node = 0; node < call_tree.get_nodes_number(); ++node) {
+			if (node == call_tree.root) {
+				continue;
+			}
+
+			call_tree.for_each_node_stat(node, [&] (const stat_t &stat) {
+				write_new_stat_key(actions_set, stat.key);
+			});
+
+			size_t action_code = call_tree.get_node_action_code(node);
+			if (action_code >= written_actions.size()) {
+				written_actions.resize(action_code + 1, false);
+			}
+			if (written_actions[action_code]) {
+				continue;
+			}
+
+			buffer.push_back(binary::ACTION_RECORD);
+			binary::put_varint(buffer, action_code);
+			binary::put_string(buffer, actions_set.get_action_name(action_code));
+			written_actions[action_code] = true;
+		}
+	}
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Writes definition of stat \a key if it was not written yet
+	 */
+	void write_new_stat_key(const actions_set_t &actions_set, size_t key) {
+		if (key >= written_stat_keys.size()) {
+			written_stat_keys.resize(key + 1, false);
+		}
+		if (!written_stat_keys[key]) {
+			buffer.push_back(binary::STAT_KEY_RECORD);
+			binary::put_varint(buffer, key);
+			binary::put_string(buffer, actions_set.get_stat_key_name(key));
+			written_stat_keys[key] = true;
+		}
+	}
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Writes tree nodes in preorder without recursion
+	 */
+	void write_nodes(const call_tree_t &call_tree) {
+		node_links_t root_links = call_tree.get_node_links(call_tree.root);
+		binary::put_varint(buffer, root_links.size());
+
+		frames.clear();
+		frames.push_back(frame_t(root_links, 0));
+
+		while (!frames.empty()) {
+			frame_t &frame = frames.back();
+			if (frame.next_child == frame.end) {
+				frames.pop_back();
+				continue;
+			}
+
+			p_node_t node = *frame.next_child++;
+			int64_t start_time = tick_clock_t::to_nanoseconds(call_tree.get_node_start_time(node));
+			int64_t stop_time = tick_clock_t::to_nanoseconds(call_tree.get_node_stop_time(node));
+			node_links_t links = call_tree.get_node_links(node);
+
+			binary::put_varint(buffer, call_tree.get_node_action_code(node));
+			binary::put_signed_varint(buffer, start_time - frame.start_time);
+			binary::put_signed_varint(buffer, stop_time - start_time);
+			const node_summary_t *summary = call_tree.get_node_summary(node);
+			bool has_stats = call_tree.node_has_stats(node);
+			binary::put_varint(buffer, (links.size() << 2) | (has_stats ? 2 : 0) | (summary ? 1 : 0));
+			if (summary) {
+				binary::put_varint(buffer, summary->calls);
+				binary::put_signed_varint(buffer, tick_clock_t::duration_to_nanoseconds(summary->total_time));
+				binary::put_signed_varint(buffer, summary->calls ?
+						tick_clock_t::duration_to_nanoseconds(summary->min_time) : 0);
+				binary::put_signed_varint(buffer, tick_clock_t::duration_to_nanoseconds(summary->max_time));
+			}
+			if (has_stats) {
+				size_t stats_number = 0;
+				call_tree.for_each_node_stat(node, [&] (const stat_t &) {
+					++stats_number;
+				});
+				binary::put_varint(buffer, stats_number);
+				call_tree.for_each_node_stat(node, [&] (const stat_t &stat) {
+					binary::put_varint(buffer, stat.key);
+					binary::put_stat_value(buffer, call_tree, stat);
+				});
+			}
+
+			if (!links.empty()) {
+				frames.push_back(frame_t(links, start_time));
+			}
+		}
+	}
+
+	/*!
+	 * \brief Target stream
+	 */
+	std::ostream &os;
+
+	/*!
+	 * \brief Reusable buffer for encoded records
+	 */
+	std::string buffer;
+
+	/*!
+	 * \brief Reusable stack of nodes being written
+	 */
+	std::vector<frame_t> frames;
+
+	/*!
+	 * \brief Shows which actions were already written to stream
+	 */
+	std::vector<bool> written_actions;
+
+	/*!
+	 * \brief Shows which stats keys were already written to stream
+	 */
+	std::vector<bool> written_stat_keys;
+};
+
+/*!
+ * \brief Aggregator that writes trees into stream in compact binary format
+ *
+ * Resulting stream can be converted back to json by binary_reader_t
+ * or react_decode tool.
+ */
+class binary_aggregator_t : public aggregator_t {
+public:
+	/*!
+	 * \brief Constructs aggregator and writes stream header
+	 * \param os Stream where aggregated trees will be outputed
+	 */
+	binary_aggregator_t(std::ostream &os): writer(os) {}
+
+	/*!
+	 * \brief Outputs call tree into stream
+	 * \param call_tree Tree that will be outputed
+	 */
+	void aggregate(const call_tree_t &call_tree) {
+		std::lock_guard<std::mutex> guard(writer_mutex);
+		writer.write(call_tree);
+	}
+
+private:
+	/*!
+	 * \brief Serializes trees aggregated from different threads
+	 */
+	std::mutex writer_mutex;
+
+	/*!
+	 * \brief Encoder of trees
+	 */
+	binary_writer_t writer;
+};
+
+/*!
+ * \brief Decodes binary stream written by binary_writer_t
+ *
+ * Trees are written into SAX-style json writer with the same layout
+ * as produced by call_tree_t::write_json().
+ */
+class binary_reader_t {
+public:
+	/*!
+	 * \brief Initializes reader and checks stream header
+	 * \param is Source stream
+	 * \throws std::runtime_error if stream is not a binary trace
+	 */
+	binary_reader_t(std::istream &is): is(is) {
+		char magic[sizeof(binary::MAGIC)];
+		if (!is.read(magic, sizeof(magic)) || memcmp(magic, binary::MAGIC, sizeof(magic))) {
+			throw std::runtime_error("Not a binary react trace");
+		}
+		if (read_byte() != binary::VERSION) {
+			throw std::runtime_error("Unsupported binary react trace version");
+		}
+	}
+
+	/*!
+	 * \brief Reads next tree from stream and writes it as json
+	 * \param writer Json writer, e.g. rapidjson::Writer
+	 * \return False if stream has ended and there are no more trees
+	 * \throws std::runtime_error if stream is truncated or malformed
+	 */
+	template<typename Writer>
+	bool read_tree(Writer &writer) {
+		while (true) {
+			int record_type = is.get();
+			if (record_type == std::istream::traits_type::eof()) {
+				return false;
+			}
+
+			if (record_type == binary::ACTION_RECORD) {
+				read_action();
+			} else if (record_type == binary::STAT_KEY_RECORD) {
+				read_stat_key();
+			} else if (record_type == binary::TREE_RECORD) {
+				break;
+			} else {
+				throw std::runtime_error("Unknown record type in binary react trace");
+			}
+		}
+
+		writer.StartObject();
+		read_stats(writer);
+		if (uint64_t collapsed_actions_number = read_varint()) {
+			writer.String("collapsed_actions");
+			writer.Uint64(collapsed_actions_number);
+		}
+
+		frames.clear();
+		start_children(read_varint(), 0, writer);
+
+		while (!frames.empty()) {
+			frame_t &frame = frames.back();
+			if (frame.remaining_children == 0) {
+				frames.pop_back();
+				writer.EndArray();
+				writer.EndObject();
+				continue;
+			}
+			--frame.remaining_children;
+
+			uint64_t action_code = read_varint();
+			int64_t start_time = frame.start_time + read_signed_varint();
+			int64_t stop_time = start_time + read_signed_varint();
+			if (action_code >= actions_names.size()) {
+				throw std::runtime_error("Undefined action in binary react trace");
+			}
+
+			const std::string &name = actions_names[action_code];
+			writer.StartObject();
+			writer.String("name");
+			writer.String(name.c_str(), name.size());
+			writer.String("start_time");
+			writer.Int64(start_time);
+			writer.String("stop_time");
+			writer.Int64(stop_time);
+
+			uint64_t children_number = read_varint();
+			if (children_number & 1) {
+				writer.String("calls");
+				writer.Uint64(read_varint());
+				writer.String("total_time");
+				writer.Int64(read_signed_varint());
+				writer.String("min_time");
+				writer.Int64(read_signed_varint());
+				writer.String("max_time");
+				writer.Int64(read_signed_varint());
+			}
+			if (children_number & 2) {
+				read_node_stats(writer);
+			}
+			start_children(children_number >> 2, start_time, writer);
+		}
+
+		return true;
+	}
+
+private:
+	/*!
+	 * \internal
+	 *
+	 * \brief Node which children are being read
+	 */
+	struct frame_t {
+		frame_t(uint64_t remaining_children, int64_t start_time):
+			remaining_children(remaining_children), start_time(start_time) {}
+
+		uint64_t remaining_children;
+		int64_t start_time;
+	};
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Opens children array of current node or closes the node if it has no children
+	 */
+	template<typename Writer>
+	void start_children(uint64_t children_number, int64_t start_time, Writer &writer) {
+		if (children_number == 0) {
+			writer.EndObject();
+			return;
+		}
+
+		writer.String("actions");
+		writer.StartArray();
+		frames.push_back(frame_t(children_number, start_time));
+	}
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Reads action definition
+	 */
+	void read_action() {
+		uint64_t action_code = read_varint();
+		if (action_code >= actions_names.size()) {
+			actions_names.resize(action_code + 1);
+		}
+		read_string(actions_names[action_code]);
+	}
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Reads stat key definition
+	 */
+	void read_stat_key() {
+		uint64_t key = read_varint();
+		if (key >= stat_keys_names.size()) {
+			stat_keys_names.resize(key + 1);
+		}
+		read_string(stat_keys_names[key]);
+	}
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Reads stats of node and writes them as json object
+	 */
+	template<typename Writer>
+	void read_node_stats(Writer &writer) {
+		writer.String("stats");
+		writer.StartObject();
+		read_stats(writer);
+		writer.EndObject();
+	}
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Reads number of stats and stats themselves, writes them as members of current json object
+	 */
+	template<typename Writer>
+	void read_stats(Writer &writer) {
+		for (uint64_t stats_number = read_varint(); stats_number > 0; --stats_number) {
+			uint64_t key = read_varint();
+			if (key >= stat_keys_names.size()) {
+				throw std::runtime_error("Undefined stat key in binary react trace");
+			}
+			writer.String(stat_keys_names[key].c_str(), stat_keys_names[key].size());
+			read_stat(writer);
+		}
+	}
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Reads typed stat value and writes it as json
+	 */
+	template<typename Writer>
+	void read_stat(Writer &writer) {
+		switch (read_byte()) {
+		case binary::BOOL_STAT:
+			writer.Bool(read_byte() != 0);
+			break;
+		case binary::INT_STAT:
+		case binary::COUNTER_STAT:
+			writer.Int64(read_signed_varint());
+			break;
+		case binary::DOUBLE_STAT:
+			writer.Double(read_double());
+			break;
+		case binary::STRING_STAT:
+			read_string(string_buffer);
+			writer.String(string_buffer.c_str(), string_buffer.size());
+			break;
+		default:
+			throw std::runtime_error("Unknown stat type in binary react trace");
+		}
+	}
+
+	unsigned char read_byte() {
+		int byte = is.get();
+		if (byte == std::istream::traits_type::eof()) {
+			throw std::runtime_error("Unexpected end of binary react trace");
+		}
+		return static_cast<unsigned char>(byte);
+	}
+
+	uint64_t read_varint() {
+		uint64_t value = 0;
+		for (int shift = 0; shift < 64; shift += 7) {
+			unsigned char byte = read_byte();
+			value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+			if (!(byte & 0x80)) {
+				return value;
+			}
+		}
+		throw std::runtime_error("Malformed varint in binary react trace");
+	}
+
+	int64_t read_signed_varint() {
+		uint64_t value = read_varint();
+		return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+	}
+
+	double read_double() {
+		uint64_t bits = 0;
+		for (size_t i = 0; i < sizeof(bits); ++i) {
+			bits |= static_cast<uint64_t>(read_byte()) << (8 * i);
+		}
+		double value;
+		memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+
+	void read_string(std::string &value) {
+		uint64_t size = read_varint();
+		value.resize(size);
+		if (size > 0 && !is.read(&value[0], size)) {
+			throw std::runtime_error("Unexpected end of binary react trace");
+		}
+	}
+
+	/*!
+	 * \brief Source stream
+	 */
+	std::istream &is;
+
+	/*!
+	 * \brief Names of actions defined so far, indexed by action code
+	 */
+	std::vector<std::string> actions_names;
+
+	/*!
+	 * \brief Names of stats keys defined so far, indexed by key code
+	 */
+	std::vector<std::string> stat_keys_names;
+
+	/*!
+	 * \brief Reusable stack of nodes being read
+	 */
+	std::vector<frame_t> frames;
+
+	/*!
+	 * \brief Reusable buffer for string values of stats
+	 */
+	std::string string_buffer;
+};
+
+} // namespace react
+
+#endif // REACT_BINARY_HPP
@@ -22,79 +22,97 @@
 #include "rapidjson/stringbuffer.h"
 
 #include "actions_set.hpp"
+#include "clock.hpp"
 
 #include <unordered_map>
 #include <vector>
+#include <iterator>
+#include <cstdint>
+#include <cstring>
+#include <limits>
 #include <mutex>
-
-#include <boost/variant.hpp>
+#include <atomic>
+#include <utility>
 
 namespace react {
 
 /*!
- * \brief Types that can be stored in react call tree key-value storage
+ * \brief Stat of call tree: interned key and typed value
+ *
+ * Stats are plain fixed-size records, short strings are stored inline
+ * and longer ones in call tree's strings pool.
  */
-typedef boost::variant<
-	bool,
-	int,
-	double,
-	std::string
-> stat_value_t;
+struct stat_t {
+	/*!
+	 * \brief Types of stats values
+	 */
+	enum type_t {
+		BOOL = 0,
+		INT = 1,
+		DOUBLE = 2,
+		STRING = 3,
 
-/*!
- * \brief Helper structure for printing stats stored in stat_value_t to json
- */
-struct JsonRenderer : boost::static_visitor<>
-{
-	JsonRenderer(const std::string &key, rapidjson::Value &stat_value,
-			 rapidjson::Document::AllocatorType &allocator):
-		key(key), stat_value(stat_value), allocator(allocator) {}
+		/*!
+		 * \brief Integer which accumulates quantity processed by action, e.g. bytes or items
+		 */
+		COUNTER = 4
+	};
 
-	void operator () (bool value) const
-	{
-		stat_value.AddMember(key.c_str(), value, allocator);
-	}
+	/*!
+	 * \brief Max size of string stored inline
+	 */
+	static const size_t INLINE_STRING_CAPACITY = 16;
 
-	void operator () (int value) const
-	{
-		stat_value.AddMember(key.c_str(), value, allocator);
-	}
+	/*!
+	 * \brief Key code interned in actions set
+	 */
+	int key;
 
-	void operator () (double value) const
-	{
-		stat_value.AddMember(key.c_str(), value, allocator);
-	}
+	type_t type;
 
-	void operator () (const std::string& value) const
-	{
-		stat_value.AddMember(key.c_str(), value.c_str(), allocator);
-	}
+	/*!
+	 * \brief Size of string value
+	 */
+	uint32_t string_size;
 
-private:
-	std::string key;
-	rapidjson::Value &stat_value;
-	rapidjson::Document::AllocatorType &allocator;
+	union {
+		bool bool_value;
+		int64_t int_value;
+		double double_value;
+		char inline_string[INLINE_STRING_CAPACITY];
+
+		/*!
+		 * \brief Index of string value in call tree's strings pool if it is not stored inline
+		 */
+		uint32_t string_index;
+	};
 };
 
 /*!
  * \brief Represents node of call tree
+ *
+ * Nodes are plain fixed-size records stored in one contiguous array.
+ * Children of a node form a singly linked list: parent points to its first
+ * and last children and each child points to its next sibling.
  */
 struct node_t {
 	/*!
-	 * \brief Type of container where child nodes are stored
+	 * \brief Pointer to node type, index of node in call tree
 	 */
-	typedef std::vector<std::pair<int, size_t>> Container;
+	typedef uint32_t pointer;
 
 	/*!
-	 * \brief Pointer to node type
+	 * \brief Value for representing null node pointer
 	 */
-	typedef size_t pointer;
+	static const pointer NO_NODE = -1;
 
 	/*!
-	 * \brief Initializes node with \a action_code and zero start and stop times
+	 * \brief Initializes node with \a action_code, zero start and stop times and no children
 	 * \param action_code Action code of the node
 	 */
-	node_t(int action_code): action_code(action_code), start_time(0), stop_time(0) {}
+	node_t(int action_code): action_code(action_code),
+		first_child(NO_NODE), last_child(NO_NODE), next_sibling(NO_NODE),
+		start_time(0), stop_time(0) {}
 
 	/*!
 	 * \brief Action which this node represents
@@ -102,19 +120,134 @@ struct node_t {
 	int action_code;
 
 	/*!
-	 * \brief Time when node action was started
+	 * \brief First child node, first action that happened inside this action
+	 */
+	pointer first_child;
+
+	/*!
+	 * \brief Last child node, makes appending new child O(1)
+	 */
+	pointer last_child;
+
+	/*!
+	 * \brief Next child of this node's parent
+	 */
+	pointer next_sibling;
+
+	/*!
+	 * \brief Time when node action was started, in tick_clock_t ticks
 	 */
 	int64_t start_time;
 
 	/*!
-	 * \brief Time when node action was stopped
+	 * \brief Time when node action was stopped, in tick_clock_t ticks
 	 */
 	int64_t stop_time;
+};
+
+/*!
+ * \brief Accumulated durations of several calls represented by a single node
+ *
+ * Node has a summary when more than one call of its action were folded into it.
+ * Node's start time is then start of the first call and stop time is stop of the last one.
+ */
+struct node_summary_t {
+	node_summary_t(): calls(0), total_time(0),
+		min_time(std::numeric_limits<int64_t>::max()), max_time(0) {}
+
+	/*!
+	 * \brief Adds call which took \a duration ticks
+	 */
+	void add(int64_t duration) {
+		++calls;
+		total_time += duration;
+		min_time = std::min(min_time, duration);
+		max_time = std::max(max_time, duration);
+	}
+
+	/*!
+	 * \brief Number of finished calls
+	 */
+	uint64_t calls;
+
+	/*!
+	 * \brief Sum of durations of calls, in tick_clock_t ticks
+	 */
+	int64_t total_time;
+
+	int64_t min_time;
+	int64_t max_time;
+};
+
+/*!
+ * \brief Range of node's children, allows iterating over links from node
+ */
+class node_links_t {
+public:
+	/*!
+	 * \brief Forward iterator over child nodes, dereferences to child's pointer
+	 */
+	class const_iterator : public std::iterator<std::forward_iterator_tag, node_t::pointer> {
+	public:
+		const_iterator(const node_t *nodes, node_t::pointer node): nodes(nodes), node(node) {}
+
+		node_t::pointer operator *() const {
+			return node;
+		}
+
+		const_iterator &operator ++() {
+			node = nodes[node].next_sibling;
+			return *this;
+		}
+
+		const_iterator operator ++(int) {
+			const_iterator previous = *this;
+			++*this;
+			return previous;
+		}
+
+		bool operator ==(const const_iterator &other) const {
+			return node == other.node;
+		}
+
+		bool operator !=(const const_iterator &other) const {
+			return node != other.node;
+		}
+
+	private:
+		const node_t *nodes;
+		node_t::pointer node;
+	};
+
+	/*!
+	 * \brief Initializes range of children of \a parent
+	 * \param nodes Nodes array of call tree
+	 * \param parent Parent node
+	 */
+	node_links_t(const node_t *nodes, node_t::pointer parent): nodes(nodes), parent(parent) {}
+
+	const_iterator begin() const {
+		return const_iterator(nodes, nodes[parent].first_child);
+	}
+
+	const_iterator end() const {
+		return const_iterator(nodes, +node_t::NO_NODE);
+	}
+
+	bool empty() const {
+		return nodes[parent].first_child == node_t::NO_NODE;
+	}
 
 	/*!
-	 * \brief Child nodes, actions that happen inside this action
+	 * \brief Counts children, takes linear time
 	 */
-	Container links;
+	size_t size() const {
+		return std::distance(begin(), end());
+	}
+
+private:
+	const node_t *nodes;
+	node_t::pointer parent;
 };
 
 /*!
@@ -132,7 +265,7 @@ public:
 	/*!
 	 * \brief Value for representing null node pointer
 	 */
-	static const p_node_t NO_NODE = -1;
+	static const p_node_t NO_NODE = node_t::NO_NODE;
 
 	/*!
 	 * \brief Pointer to the root of call tree
@@ -143,30 +276,150 @@ public:
 	 * \brief Initializes call tree with single root node and specified actions set
 	 * \param actions_set Set of available actions for monitoring in call tree
 	 */
-	call_tree_t(const actions_set_t &actions_set): actions_set(actions_set) {
+	call_tree_t(const actions_set_t &actions_set): nodes_number(0), actions_set(&actions_set),
+		strings_number(0), collapsed_actions_number(0) {
 		root = new_node(+actions_set_t::NO_ACTION);
 	}
 
+	/*!
+	 * \brief Copies \a other call tree, only used nodes are copied
+	 * \param other Call tree to copy
+	 */
+	call_tree_t(const call_tree_t &other):
+		root(other.root),
+		nodes(other.nodes.begin(), other.nodes.begin() + other.nodes_number),
+		nodes_number(other.nodes_number), actions_set(other.actions_set), stats(other.stats),
+		strings(other.strings.begin(), other.strings.begin() + other.strings_number),
+		strings_number(other.strings_number), summaries(other.summaries), collapsed_links(other.collapsed_links),
+		collapsed_actions_number(other.collapsed_actions_number),
+		node_stats(other.node_stats), node_stats_heads(other.node_stats_heads) {}
+
+	/*!
+	 * \brief Moves contents of \a other call tree without copying
+	 *
+	 * \a other is left without nodes and must be reset() before it is used again.
+	 *
+	 * \param other Call tree to move from
+	 */
+	call_tree_t(call_tree_t &&other) noexcept:
+		root(other.root), nodes(std::move(other.nodes)),
+		nodes_number(other.nodes_number), actions_set(other.actions_set), stats(std::move(other.stats)),
+		strings(std::move(other.strings)), strings_number(other.strings_number),
+		summaries(std::move(other.summaries)), collapsed_links(std::move(other.collapsed_links)),
+		collapsed_actions_number(other.collapsed_actions_number),
+		node_stats(std::move(other.node_stats)), node_stats_heads(std::move(other.node_stats_heads)) {
+		other.root = NO_NODE;
+		other.nodes_number = 0;
+		other.strings_number = 0;
+		other.collapsed_actions_number = 0;
+	}
+
 	/*!
 	 * \brief Frees memory consumed by call tree
 	 */
 	~call_tree_t() {}
 
+	/*!
+	 * \brief Replaces contents of this tree with copy of \a other, reuses memory of nodes pool
+	 * \param other Call tree to copy
+	 */
+	call_tree_t &operator =(const call_tree_t &other) {
+		if (this != &other) {
+			root = other.root;
+			nodes.assign(other.nodes.begin(), other.nodes.begin() + other.nodes_number);
+			nodes_number = other.nodes_number;
+			actions_set = other.actions_set;
+			stats = other.stats;
+			strings.assign(other.strings.begin(), other.strings.begin() + other.strings_number);
+			strings_number = other.strings_number;
+			summaries = other.summaries;
+			collapsed_links = other.collapsed_links;
+			collapsed_actions_number = other.collapsed_actions_number;
+			node_stats = other.node_stats;
+			node_stats_heads = other.node_stats_heads;
+		}
+		return *this;
+	}
+
+	/*!
+	 * \brief Replaces contents of this tree with contents of \a other without copying
+	 *
+	 * Memory of both trees is exchanged, so \a other keeps nodes pool of this tree
+	 * and must be reset() before it is used again.
+	 *
+	 * \param other Call tree to move from
+	 */
+	call_tree_t &operator =(call_tree_t &&other) noexcept {
+		swap(other);
+		return *this;
+	}
+
+	/*!
+	 * \brief Exchanges contents of this tree and \a other in constant time
+	 * \param other Call tree to swap with
+	 */
+	void swap(call_tree_t &other) noexcept {
+		std::swap(root, other.root);
+		nodes.swap(other.nodes);
+		std::swap(nodes_number, other.nodes_number);
+		std::swap(actions_set, other.actions_set);
+		stats.swap(other.stats);
+		strings.swap(other.strings);
+		std::swap(strings_number, other.strings_number);
+		summaries.swap(other.summaries);
+		collapsed_links.swap(other.collapsed_links);
+		std::swap(collapsed_actions_number, other.collapsed_actions_number);
+		node_stats.swap(other.node_stats);
+		node_stats_heads.swap(other.node_stats_heads);
+	}
+
+	/*!
+	 * \brief Removes all nodes except root and all stats including nodes' ones
+	 *
+	 * Memory allocated for nodes, stats and long string values is kept and reused by subsequent
+	 * updates, so tree that is reset after each request stops allocating once it reaches its usual size.
+	 * Side tables of summaries (nodes budget, siblings coalescing) and of nodes' stats are hash maps,
+	 * they free their entries here, so trees that use them allocate on every request.
+	 */
+	void reset() {
+		nodes_number = 0;
+		stats.clear();
+		strings_number = 0;
+		if (!summaries.empty()) {
+			summaries.clear();
+			collapsed_links.clear();
+		}
+		collapsed_actions_number = 0;
+		if (!node_stats.empty()) {
+			node_stats.clear();
+			node_stats_heads.clear();
+		}
+		root = new_node(+actions_set_t::NO_ACTION);
+	}
+
+	/*!
+	 * \brief Returns number of nodes in the tree including root
+	 * \return Number of nodes in the tree
+	 */
+	size_t get_nodes_number() const {
+		return nodes_number;
+	}
+
 	/*!
 	 * \brief Returns actions set monitored by this tree
 	 * \return Actions set monitored by this tree
 	 */
 	const actions_set_t& get_actions_set() const {
-		return actions_set;
+		return *actions_set;
 	}
 
 	/*!
 	 * \brief Returns links from \a node
 	 * \param node Target node
-	 * \return Links from target node
+	 * \return Range of target node's children
 	 */
-	const node_t::Container &get_node_links(p_node_t node) const {
-		return nodes[node].links;
+	node_links_t get_node_links(p_node_t node) const {
+		return node_links_t(nodes.data(), node);
 	}
 
 	/*!
@@ -214,6 +467,21 @@ public:
 		return nodes[node].stop_time;
 	}
 
+	/*!
+	 * \brief Checks whether action represented by \a node was stopped
+	 *
+	 * Start time of action is set when it starts and stop time when it stops,
+	 * so action that is still running has stop time less than its start time.
+	 * Node that represents several calls is finished once its first call is finished,
+	 * its summary accumulates only finished calls.
+	 *
+	 * \param node Action's node
+	 * \return False if action was started but not stopped yet
+	 */
+	bool node_is_finished(p_node_t node) const {
+		return nodes[node].stop_time >= nodes[node].start_time;
+	}
+
 	/*!
 	 * \brief Adds new child with \a action_code to \a node
 	 * \param node Target parent node
@@ -221,195 +489,1133 @@ public:
 	 * \return Pointer to newly created child
 	 */
 	p_node_t add_new_link(p_node_t node, int action_code) {
-		if (!actions_set.code_is_valid(action_code)) {
+		if (!actions_set->code_is_valid(action_code)) {
 			throw std::invalid_argument("Can't add new link: action code is invalid");
 		}
 
+		return add_new_link_unchecked(node, action_code);
+	}
+
+	/*!
+	 * \brief Adds new child with \a action_code that is known to be valid to \a node
+	 * \param node Target parent node
+	 * \param action_code Child's action code, must be registered in tree's actions set
+	 * \return Pointer to newly created child
+	 */
+	p_node_t add_new_link_unchecked(p_node_t node, int action_code) {
 		p_node_t action_node = new_node(action_code);
-		nodes[node].links.push_back(std::make_pair(action_code, action_node));
+		node_t &parent = nodes[node];
+		if (parent.last_child == NO_NODE) {
+			parent.first_child = action_node;
+		} else {
+			nodes[parent.last_child].next_sibling = action_node;
+		}
+		parent.last_child = action_node;
 		return action_node;
 	}
 
-	template<typename T>
-	void add_stat(const std::string &key, T value) {
-		stats[key] = value;
+	/*!
+	 * \brief Returns child of \a node with \a action_code which accumulates collapsed calls
+	 *
+	 * Used when tree is over its nodes budget: all further calls of action under the same parent
+	 * are folded into one node with summary, so number of nodes depends only on number
+	 * of distinct actions. Every call increments number of collapsed actions.
+	 *
+	 * \param node Target parent node
+	 * \param action_code Child's action code, must be registered in tree's actions set
+	 * \return Pointer to collapsed child, it always has summary
+	 */
+	p_node_t add_collapsed_link(p_node_t node, int action_code) {
+		++collapsed_actions_number;
+
+		uint64_t key = (static_cast<uint64_t>(node) << 32) | static_cast<uint32_t>(action_code);
+		auto it = collapsed_links.find(key);
+		if (it != collapsed_links.end()) {
+			return it->second;
+		}
+
+		p_node_t action_node = add_new_link_unchecked(node, action_code);
+		summaries[action_node];
+		collapsed_links[key] = action_node;
+		return action_node;
 	}
 
-	void add_stat(const std::string &key, const char *value) {
-		stats[key] = std::string(value);
+	/*!
+	 * \brief Returns last child of \a node if next call of \a action_code can be folded into it
+	 *
+	 * Call can be folded into the last child if it has the same action
+	 * and is finished (see node_is_finished()).
+	 *
+	 * \param node Target parent node
+	 * \param action_code Action code of the next call
+	 * \return Pointer to the last child or NO_NODE
+	 */
+	p_node_t get_coalescable_link(p_node_t node, int action_code) const {
+		p_node_t last_child = nodes[node].last_child;
+		if (last_child == NO_NODE || nodes[last_child].action_code != action_code ||
+				!node_is_finished(last_child)) {
+			return NO_NODE;
+		}
+		return last_child;
 	}
 
-	bool has_stat(const std::string &key) const {
-		return stats.find(key) != stats.end();
+	/*!
+	 * \brief Returns summary of \a node, creates it from node's own call if needed
+	 * \param node Finished node
+	 * \return Summary which accumulates all calls folded into \a node
+	 */
+	node_summary_t &add_node_summary(p_node_t node) {
+		auto it = summaries.find(node);
+		if (it != summaries.end()) {
+			return it->second;
+		}
+
+		node_summary_t &summary = summaries[node];
+		summary.add(nodes[node].stop_time - nodes[node].start_time);
+		return summary;
 	}
 
-	template<typename T>
-	const T &get_stat(const std::string &key) const {
-		return boost::get<T>(stats.at(key));
+	/*!
+	 * \brief Returns summary of \a node or NULL if node represents single call
+	 */
+	node_summary_t *get_node_summary(p_node_t node) {
+		if (summaries.empty()) {
+			return NULL;
+		}
+
+		auto it = summaries.find(node);
+		return it != summaries.end() ? &it->second : NULL;
 	}
 
 	/*!
-	 * \brief Converts call tree to json
-	 * \param stat_value Json node for writing
-	 * \param allocator Json allocator
-	 * \return Modified json node
+	 * \brief Returns summary of \a node or NULL if node represents single call
 	 */
-	rapidjson::Value& to_json(rapidjson::Value &stat_value,
-							  rapidjson::Document::AllocatorType &allocator) const {
-		return to_json(root, stat_value, allocator);
+	const node_summary_t *get_node_summary(p_node_t node) const {
+		return const_cast<call_tree_t*>(this)->get_node_summary(node);
 	}
 
 	/*!
-	 * \brief Recursively merges this tree into \a rhs_node
-	 * \param rhs_node Node in which this tree will be merged
-	 * \param rhs_tree Tree in which this tree will be merged
+	 * \brief Returns number of actions that were collapsed because of nodes budget
 	 */
-	void merge_into(call_tree_t::p_node_t rhs_node, call_tree_t& rhs_tree) const {
-		merge_into(root, rhs_node, rhs_tree);
+	uint64_t get_collapsed_actions_number() const {
+		return collapsed_actions_number;
 	}
 
-private:
 	/*!
-	 * \internal
-	 *
-	 * \brief Recursively converts subtree to json
-	 * \param current_node Node which subtree will be converted
-	 * \param stat_value Json node for writing
-	 * \param allocator Json allocator
-	 * \return Modified json node
+	 * \brief Sets stat with interned \a key to \a value, replaces previous value of any type
+	 * \param key Stat key code, see actions_set_t::define_stat_key()
+	 * \param value Value of stat
 	 */
-	rapidjson::Value& to_json(p_node_t current_node, rapidjson::Value &stat_value,
-							  rapidjson::Document::AllocatorType &allocator) const {
-		if (current_node != root) {
-			stat_value.AddMember("name", actions_set.get_action_name(get_node_action_code(current_node)).c_str(), allocator);
-			stat_value.AddMember("start_time", get_node_start_time(current_node), allocator);
-			stat_value.AddMember("stop_time", get_node_stop_time(current_node), allocator);
-		} else {
-			for (auto it = stats.begin(); it != stats.end(); ++it) {
-				boost::apply_visitor(JsonRenderer(it->first, stat_value, allocator), it->second);
-			}
-		}
+	void add_stat(int key, bool value) {
+		set_stat_value(get_stat_slot(key), value);
+	}
 
-		if (!nodes[current_node].links.empty()) {
-			rapidjson::Value subtree_actions(rapidjson::kArrayType);
+	void add_stat(int key, int value) {
+		add_stat(key, static_cast<int64_t>(value));
+	}
 
-			for (auto it = nodes[current_node].links.begin(); it != nodes[current_node].links.end(); ++it) {
-				p_node_t next_node = it->second;
-				rapidjson::Value subtree_value(rapidjson::kObjectType);
-				to_json(next_node, subtree_value, allocator);
-				subtree_actions.PushBack(subtree_value, allocator);
-			}
+	void add_stat(int key, int64_t value) {
+		set_stat_value(get_stat_slot(key), value);
+	}
 
-			stat_value.AddMember("actions", subtree_actions, allocator);
-		}
+	void add_stat(int key, double value) {
+		set_stat_value(get_stat_slot(key), value);
+	}
 
-		return stat_value;
+	void add_stat(int key, const char *value, size_t size) {
+		set_stat_value(get_stat_slot(key), value, size);
 	}
 
-	/*!
-	 * \internal
-	 *
-	 * \brief Recursively merges \a lhs_node into \a rhs_node
-	 * \param lhs_node Node which will be merged
-	 * \param rhs_node Node in which this tree will be merged
-	 * \param rhs_tree Tree in which this tree will be merged
-	 */
-	void merge_into(p_node_t lhs_node, call_tree_t::p_node_t rhs_node, call_tree_t& rhs_tree) const {
-		if (lhs_node != root) {
-			rhs_tree.set_node_start_time(rhs_node, get_node_start_time(lhs_node));
-			rhs_tree.set_node_stop_time(rhs_node, get_node_stop_time(lhs_node));
-		}
+	void add_stat(int key, const char *value) {
+		add_stat(key, value, strlen(value));
+	}
 
-		for (auto it = nodes[lhs_node].links.begin(); it != nodes[lhs_node].links.end(); ++it) {
-			int action_code = it->first;
-			p_node_t lhs_next_node = it->second;
-			p_node_t rhs_next_node = rhs_tree.add_new_link(rhs_node, action_code);
-			merge_into(lhs_next_node, rhs_next_node, rhs_tree);
-		}
+	void add_stat(int key, const std::string &value) {
+		add_stat(key, value.data(), value.size());
 	}
 
 	/*!
-	 * \internal
+	 * \brief Sets stat with \a key to \a value, interns \a key on the way
 	 *
-	 * \brief Allocates space for new node
-	 * \param action_code Action code of new node
-	 * \return Pointer to newly created node
+	 * Prefer overloads with interned keys on hot paths.
+	 * Interned keys are never released, see actions_set_t::define_stat_key().
 	 */
-	p_node_t new_node(int action_code) {
-		nodes.emplace_back(action_code);
-		return nodes.size() - 1;
+	template<typename T>
+	void add_stat(const std::string &key, const T &value) {
+		add_stat(actions_set->define_stat_key(key), value);
 	}
 
 	/*!
-	 * \brief Tree nodes
+	 * \brief Adds \a value to counter of the tree with interned \a key
+	 * \param key Stat key code, see actions_set_t::define_stat_key()
+	 * \param value Value added to counter, counter of another type is reset to zero first
 	 */
-	std::vector<node_t> nodes;
+	void add_counter(int key, int64_t value) {
+		add_counter_value(get_stat_slot(key), value);
+	}
 
-	/*!
-	 * \brief Available actions for monitoring
-	 */
-	const actions_set_t &actions_set;
+	bool has_stat(int key) const {
+		return find_stat(key) != NULL;
+	}
 
-	/*!
-	 * \brief Key-Value map for storing arbitary user stats
-	 */
-	std::unordered_map<std::string, stat_value_t> stats;
-};
+	bool has_stat(const std::string &key) const {
+		return has_stat(actions_set->find_stat_key(key));
+	}
 
-/*!
- * \brief Concurrent version of time stats tree to handle simultanious updates
- */
-class concurrent_call_tree_t {
-public:
 	/*!
-	 * \brief Initializes call_tree with \a actions_set
-	 * \param actions_set Set of available action for monitoring
+	 * \brief Returns value of stat with \a key
+	 * \tparam T Type of value: bool, int, int64_t, double or std::string
+	 * \throws std::out_of_range if there is no such stat
+	 * \throws std::invalid_argument if stat has another type
 	 */
-	concurrent_call_tree_t(actions_set_t &actions_set): call_tree(actions_set) {}
+	template<typename T>
+	T get_stat(int key) const {
+		const stat_t *stat = find_stat(key);
+		if (!stat) {
+			throw std::out_of_range("Can't get stat: there is no such stat");
+		}
+		return get_stat_value(*stat, static_cast<T*>(NULL));
+	}
 
-	/*!
-	 * \brief Gets ownership of time stats tree
-	 */
-	void lock() const {
-		tree_mutex.lock();
+	template<typename T>
+	T get_stat(const std::string &key) const {
+		return get_stat<T>(actions_set->find_stat_key(key));
 	}
 
 	/*!
-	 * \brief Releases ownership of time stats tree
+	 * \brief Returns all user stats of the tree in order of their addition
+	 * \return Flat array of stats
 	 */
-	void unlock() const {
-		tree_mutex.unlock();
+	const std::vector<stat_t> &get_stats() const {
+		return stats;
 	}
 
 	/*!
-	 * \brief Returns inner time stats tree
-	 * \return Inner time stats tree
+	 * \brief Returns characters of string value of \a stat, its size is stat.string_size
 	 */
-	call_tree_t& get_call_tree() {
-		return call_tree;
+	const char *get_stat_string(const stat_t &stat) const {
+		if (stat.string_size <= stat_t::INLINE_STRING_CAPACITY) {
+			return stat.inline_string;
+		}
+		return strings[stat.string_index].data();
 	}
 
 	/*!
-	 * \brief Returns copy of inner time stats tree
-	 * \return Copy of inner time stats tree
+	 * \brief Sets stat of \a node with interned \a key to \a value, replaces previous value of any type
+	 *
+	 * Node stats are kept in a side table, so nodes without them cost nothing.
+	 *
+	 * \param node Annotated node, it must not be root: stats of root are stats of the tree
+	 * \param key Stat key code, see actions_set_t::define_stat_key()
+	 * \param value Value of stat
 	 */
-	call_tree_t copy_call_tree() const {
-		lock();
-		call_tree_t call_tree_copy = call_tree;
-		unlock();
-		return call_tree_copy;
+	void add_node_stat(p_node_t node, int key, bool value) {
+		set_stat_value(get_node_stat_slot(node, key), value);
 	}
 
-private:
-	/*!
-	 * \brief Lock to handle concurrency during updates
-	 */
-	mutable std::mutex tree_mutex;
+	void add_node_stat(p_node_t node, int key, int value) {
+		add_node_stat(node, key, static_cast<int64_t>(value));
+	}
+
+	void add_node_stat(p_node_t node, int key, int64_t value) {
+		set_stat_value(get_node_stat_slot(node, key), value);
+	}
+
+	void add_node_stat(p_node_t node, int key, double value) {
+		set_stat_value(get_node_stat_slot(node, key), value);
+	}
+
+	void add_node_stat(p_node_t node, int key, const char *value, size_t size) {
+		set_stat_value(get_node_stat_slot(node, key), value, size);
+	}
+
+	void add_node_stat(p_node_t node, int key, const char *value) {
+		add_node_stat(node, key, value, strlen(value));
+	}
+
+	void add_node_stat(p_node_t node, int key, const std::string &value) {
+		add_node_stat(node, key, value.data(), value.size());
+	}
+
+	template<typename T>
+	void add_node_stat(p_node_t node, const std::string &key, const T &value) {
+		add_node_stat(node, actions_set->define_stat_key(key), value);
+	}
+
+	/*!
+	 * \brief Adds \a value to counter of \a node with interned \a key
+	 *
+	 * Counters accumulate quantities processed by action, e.g. bytes or items,
+	 * so aggregators can report throughput of actions. Counter of node which represents
+	 * several calls is the sum over all of them.
+	 *
+	 * \param node Annotated node, it must not be root
+	 * \param key Stat key code, see actions_set_t::define_stat_key()
+	 * \param value Value added to counter, counter of another type is reset to zero first
+	 */
+	void add_node_counter(p_node_t node, int key, int64_t value) {
+		add_counter_value(get_node_stat_slot(node, key), value);
+	}
+
+	bool has_node_stat(p_node_t node, int key) const {
+		return find_node_stat(node, key) != NULL;
+	}
+
+	bool has_node_stat(p_node_t node, const std::string &key) const {
+		return has_node_stat(node, actions_set->find_stat_key(key));
+	}
+
+	/*!
+	 * \brief Returns value of stat of \a node with \a key
+	 * \tparam T Type of value: bool, int, int64_t, double or std::string
+	 * \throws std::out_of_range if there is no such stat
+	 * \throws std::invalid_argument if stat has another type
+	 */
+	template<typename T>
+	T get_node_stat(p_node_t node, int key) const {
+		const stat_t *stat = find_node_stat(node, key);
+		if (!stat) {
+			throw std::out_of_range("Can't get node stat: there is no such stat");
+		}
+		return get_stat_value(*stat, static_cast<T*>(NULL));
+	}
+
+	template<typename T>
+	T get_node_stat(p_node_t node, const std::string &key) const {
+		return get_node_stat<T>(node, actions_set->find_stat_key(key));
+	}
+
+	/*!
+	 * \brief Checks whether \a node has any stats
+	 */
+	bool node_has_stats(p_node_t node) const {
+		return get_node_stats_head(node) != NO_NODE;
+	}
+
+	/*!
+	 * \brief Calls \a func for each stat of \a node in order of their addition
+	 * \param node Annotated node
+	 * \param func Functor which accepts const stat_t&
+	 */
+	template<typename Func>
+	void for_each_node_stat(p_node_t node, Func func) const {
+		for (uint32_t index = get_node_stats_head(node); index != NO_NODE; index = node_stats[index].next) {
+			func(node_stats[index].stat);
+		}
+	}
+
+	/*!
+	 * \brief Converts call tree to json
+	 *
+	 * Actions' times are written in nanoseconds since epoch.
+	 *
+	 * \param stat_value Json node for writing
+	 * \param allocator Json allocator
+	 * \return Modified json node
+	 */
+	rapidjson::Value& to_json(rapidjson::Value &stat_value,
+							  rapidjson::Document::AllocatorType &allocator) const {
+		return to_json(root, stat_value, allocator);
+	}
+
+	/*!
+	 * \brief Writes call tree directly into SAX-style json \a writer without building DOM
+	 *
+	 * Output is the same as produced by to_json(). Tree is walked iteratively,
+	 * so deep trees don't exhaust the stack.
+	 *
+	 * \param writer Json writer, e.g. rapidjson::Writer
+	 */
+	template<typename Writer>
+	void write_json(Writer &writer) const {
+		std::vector<p_node_t> parents;
+		p_node_t current_node = root;
+		write_json_node_fields(current_node, writer);
+
+		while (true) {
+			if (nodes[current_node].first_child != NO_NODE) {
+				writer.String("actions");
+				writer.StartArray();
+				parents.push_back(current_node);
+				current_node = nodes[current_node].first_child;
+				write_json_node_fields(current_node, writer);
+				continue;
+			}
+
+			writer.EndObject();
+			while (current_node != root && nodes[current_node].next_sibling == NO_NODE) {
+				writer.EndArray();
+				current_node = parents.back();
+				parents.pop_back();
+				writer.EndObject();
+			}
+
+			if (current_node == root) {
+				return;
+			}
+
+			current_node = nodes[current_node].next_sibling;
+			write_json_node_fields(current_node, writer);
+		}
+	}
+
+	/*!
+	 * \brief Recursively merges this tree into \a rhs_node
+	 * \param rhs_node Node in which this tree will be merged
+	 * \param rhs_tree Tree in which this tree will be merged
+	 */
+	void merge_into(call_tree_t::p_node_t rhs_node, call_tree_t& rhs_tree) const {
+		merge_into(root, rhs_node, rhs_tree);
+	}
+
+private:
+	/*!
+	 * \internal
+	 *
+	 * \brief Recursively converts subtree to json
+	 * \param current_node Node which subtree will be converted
+	 * \param stat_value Json node for writing
+	 * \param allocator Json allocator
+	 * \return Modified json node
+	 */
+	rapidjson::Value& to_json(p_node_t current_node, rapidjson::Value &stat_value,
+							  rapidjson::Document::AllocatorType &allocator) const {
+		if (current_node != root) {
+			stat_value.AddMember("name", actions_set->get_action_name(get_node_action_code(current_node)).c_str(), allocator);
+			stat_value.AddMember("start_time", tick_clock_t::to_nanoseconds(get_node_start_time(current_node)), allocator);
+			stat_value.AddMember("stop_time", tick_clock_t::to_nanoseconds(get_node_stop_time(current_node)), allocator);
+			if (const node_summary_t *summary = get_node_summary(current_node)) {
+				stat_value.AddMember("calls", summary->calls, allocator);
+				stat_value.AddMember("total_time", tick_clock_t::duration_to_nanoseconds(summary->total_time), allocator);
+				stat_value.AddMember("min_time", get_summary_min_time(*summary), allocator);
+				stat_value.AddMember("max_time", tick_clock_t::duration_to_nanoseconds(summary->max_time), allocator);
+			}
+			if (node_has_stats(current_node)) {
+				rapidjson::Value node_stats_value(rapidjson::kObjectType);
+				for_each_node_stat(current_node, [&] (const stat_t &stat) {
+					add_json_stat(stat, node_stats_value, allocator);
+				});
+				stat_value.AddMember("stats", node_stats_value, allocator);
+			}
+		} else {
+			for (auto it = stats.begin(); it != stats.end(); ++it) {
+				add_json_stat(*it, stat_value, allocator);
+			}
+			if (collapsed_actions_number) {
+				stat_value.AddMember("collapsed_actions", collapsed_actions_number, allocator);
+			}
+		}
+
+		if (nodes[current_node].first_child != NO_NODE) {
+			rapidjson::Value subtree_actions(rapidjson::kArrayType);
+
+			for (p_node_t next_node = nodes[current_node].first_child; next_node != NO_NODE;
+					next_node = nodes[next_node].next_sibling) {
+				rapidjson::Value subtree_value(rapidjson::kObjectType);
+				to_json(next_node, subtree_value, allocator);
+				subtree_actions.PushBack(subtree_value, allocator);
+			}
+
+			stat_value.AddMember("actions", subtree_actions, allocator);
+		}
+
+		return stat_value;
+	}
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Opens json object of \a current_node and writes its fields except children
+	 * \param current_node Node which will be written
+	 * \param writer Json writer
+	 */
+	template<typename Writer>
+	void write_json_node_fields(p_node_t current_node, Writer &writer) const {
+		writer.StartObject();
+
+		if (current_node != root) {
+			const std::string &name = actions_set->get_action_name(get_node_action_code(current_node));
+			writer.String("name");
+			writer.String(name.c_str(), name.size());
+			writer.String("start_time");
+			writer.Int64(tick_clock_t::to_nanoseconds(get_node_start_time(current_node)));
+			writer.String("stop_time");
+			writer.Int64(tick_clock_t::to_nanoseconds(get_node_stop_time(current_node)));
+			if (const node_summary_t *summary = get_node_summary(current_node)) {
+				writer.String("calls");
+				writer.Uint64(summary->calls);
+				writer.String("total_time");
+				writer.Int64(tick_clock_t::duration_to_nanoseconds(summary->total_time));
+				writer.String("min_time");
+				writer.Int64(get_summary_min_time(*summary));
+				writer.String("max_time");
+				writer.Int64(tick_clock_t::duration_to_nanoseconds(summary->max_time));
+			}
+			if (node_has_stats(current_node)) {
+				writer.String("stats");
+				writer.StartObject();
+				for_each_node_stat(current_node, [&] (const stat_t &stat) {
+					write_json_stat(stat, writer);
+				});
+				writer.EndObject();
+			}
+		} else {
+			for (auto it = stats.begin(); it != stats.end(); ++it) {
+				write_json_stat(*it, writer);
+			}
+			if (collapsed_actions_number) {
+				writer.String("collapsed_actions");
+				writer.Uint64(collapsed_actions_number);
+			}
+		}
+	}
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Adds \a stat as member of json object \a value
+	 */
+	void add_json_stat(const stat_t &stat, rapidjson::Value &value,
+					   rapidjson::Document::AllocatorType &allocator) const {
+		const std::string &key = actions_set->get_stat_key_name(stat.key);
+		rapidjson::Value name(key.c_str(), key.size(), allocator);
+		rapidjson::Value stat_value;
+		switch (stat.type) {
+		case stat_t::BOOL:
+			stat_value.SetBool(stat.bool_value);
+			break;
+		case stat_t::INT:
+		case stat_t::COUNTER:
+			stat_value.SetInt64(stat.int_value);
+			break;
+		case stat_t::DOUBLE:
+			stat_value.SetDouble(stat.double_value);
+			break;
+		case stat_t::STRING:
+			stat_value.SetString(get_stat_string(stat), stat.string_size, allocator);
+			break;
+		}
+		value.AddMember(name, stat_value, allocator);
+	}
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Writes key and value of \a stat into opened json object
+	 */
+	template<typename Writer>
+	void write_json_stat(const stat_t &stat, Writer &writer) const {
+		const std::string &key = actions_set->get_stat_key_name(stat.key);
+		writer.String(key.c_str(), key.size());
+		switch (stat.type) {
+		case stat_t::BOOL:
+			writer.Bool(stat.bool_value);
+			break;
+		case stat_t::INT:
+		case stat_t::COUNTER:
+			writer.Int64(stat.int_value);
+			break;
+		case stat_t::DOUBLE:
+			writer.Double(stat.double_value);
+			break;
+		case stat_t::STRING:
+			writer.String(get_stat_string(stat), stat.string_size);
+			break;
+		}
+	}
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Returns min duration of summary in nanoseconds, 0 if there were no finished calls
+	 */
+	static int64_t get_summary_min_time(const node_summary_t &summary) {
+		return summary.calls ? tick_clock_t::duration_to_nanoseconds(summary.min_time) : 0;
+	}
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Recursively merges \a lhs_node into \a rhs_node
+	 * \param lhs_node Node which will be merged
+	 * \param rhs_node Node in which this tree will be merged
+	 * \param rhs_tree Tree in which this tree will be merged
+	 */
+	void merge_into(p_node_t lhs_node, call_tree_t::p_node_t rhs_node, call_tree_t& rhs_tree) const {
+		if (lhs_node != root) {
+			rhs_tree.set_node_start_time(rhs_node, get_node_start_time(lhs_node));
+			rhs_tree.set_node_stop_time(rhs_node, get_node_stop_time(lhs_node));
+			if (const node_summary_t *summary = get_node_summary(lhs_node)) {
+				rhs_tree.summaries[rhs_node] = *summary;
+			}
+			for_each_node_stat(lhs_node, [&] (const stat_t &stat) {
+				rhs_tree.copy_stat_value(rhs_tree.get_node_stat_slot(rhs_node, stat.key), stat, *this);
+			});
+		} else {
+			rhs_tree.collapsed_actions_number += collapsed_actions_number;
+		}
+
+		for (p_node_t lhs_next_node = nodes[lhs_node].first_child; lhs_next_node != NO_NODE;
+				lhs_next_node = nodes[lhs_next_node].next_sibling) {
+			int action_code = get_node_action_code(lhs_next_node);
+			p_node_t rhs_next_node = rhs_tree.add_new_link(rhs_node, action_code);
+			merge_into(lhs_next_node, rhs_next_node, rhs_tree);
+		}
+	}
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Returns stat with \a key or NULL
+	 */
+	const stat_t *find_stat(int key) const {
+		for (auto it = stats.begin(); it != stats.end(); ++it) {
+			if (it->key == key) {
+				return &*it;
+			}
+		}
+		return NULL;
+	}
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Returns stat with \a key, adds it if needed
+	 */
+	stat_t &get_stat_slot(int key) {
+		for (auto it = stats.begin(); it != stats.end(); ++it) {
+			if (it->key == key) {
+				return *it;
+			}
+		}
+
+		if (!actions_set->stat_key_is_valid(key)) {
+			throw std::invalid_argument("Can't add stat: stat key is invalid");
+		}
+
+		stats.emplace_back();
+		init_stat(stats.back(), key);
+		return stats.back();
+	}
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Returns index of the first stat of \a node in node stats table or NO_NODE
+	 */
+	uint32_t get_node_stats_head(p_node_t node) const {
+		if (node_stats_heads.empty()) {
+			return NO_NODE;
+		}
+
+		auto it = node_stats_heads.find(node);
+		return it != node_stats_heads.end() ? it->second : +NO_NODE;
+	}
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Returns stat of \a node with \a key or NULL
+	 */
+	const stat_t *find_node_stat(p_node_t node, int key) const {
+		for (uint32_t index = get_node_stats_head(node); index != NO_NODE; index = node_stats[index].next) {
+			if (node_stats[index].stat.key == key) {
+				return &node_stats[index].stat;
+			}
+		}
+		return NULL;
+	}
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Returns stat of \a node with \a key, appends it to the node's list if needed
+	 */
+	stat_t &get_node_stat_slot(p_node_t node, int key) {
+		if (!actions_set->stat_key_is_valid(key)) {
+			throw std::invalid_argument("Can't add node stat: stat key is invalid");
+		}
+
+		auto head = node_stats_heads.insert(std::make_pair(node, +NO_NODE)).first;
+		uint32_t last_index = NO_NODE;
+		for (uint32_t index = head->second; index != NO_NODE; index = node_stats[index].next) {
+			if (node_stats[index].stat.key == key) {
+				return node_stats[index].stat;
+			}
+			last_index = index;
+		}
+
+		uint32_t index = node_stats.size();
+		node_stats.emplace_back();
+		node_stats.back().next = NO_NODE;
+		init_stat(node_stats.back().stat, key);
+		if (last_index == NO_NODE) {
+			head->second = index;
+		} else {
+			node_stats[last_index].next = index;
+		}
+		return node_stats.back().stat;
+	}
+
+	static void init_stat(stat_t &stat, int key) {
+		stat.key = key;
+		stat.type = stat_t::BOOL;
+		stat.string_size = 0;
+	}
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Helpers for add_stat() and add_node_stat(), replace value of \a stat
+	 */
+	static void set_stat_value(stat_t &stat, bool value) {
+		stat.type = stat_t::BOOL;
+		stat.bool_value = value;
+	}
+
+	static void set_stat_value(stat_t &stat, int64_t value) {
+		stat.type = stat_t::INT;
+		stat.int_value = value;
+	}
+
+	static void set_stat_value(stat_t &stat, double value) {
+		stat.type = stat_t::DOUBLE;
+		stat.double_value = value;
+	}
+
+	static void add_counter_value(stat_t &stat, int64_t value) {
+		if (stat.type != stat_t::COUNTER) {
+			stat.type = stat_t::COUNTER;
+			stat.int_value = 0;
+		}
+		stat.int_value += value;
+	}
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Sets string value of \a stat, reuses pool slot of its previous long string
+	 */
+	void set_stat_value(stat_t &stat, const char *value, size_t size) {
+		uint32_t string_index = -1;
+		if (stat.type == stat_t::STRING && stat.string_size > stat_t::INLINE_STRING_CAPACITY) {
+			string_index = stat.string_index;
+		}
+
+		stat.type = stat_t::STRING;
+		stat.string_size = size;
+		if (size <= stat_t::INLINE_STRING_CAPACITY) {
+			memcpy(stat.inline_string, value, size);
+			return;
+		}
+
+		if (string_index == static_cast<uint32_t>(-1)) {
+			string_index = strings_number++;
+			if (string_index == strings.size()) {
+				strings.emplace_back();
+			}
+		}
+		strings[string_index].assign(value, size);
+		stat.string_index = string_index;
+	}
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Sets value of \a stat to value of \a other stat of \a other_tree
+	 */
+	void copy_stat_value(stat_t &stat, const stat_t &other, const call_tree_t &other_tree) {
+		switch (other.type) {
+		case stat_t::BOOL:
+			set_stat_value(stat, other.bool_value);
+			break;
+		case stat_t::INT:
+			set_stat_value(stat, other.int_value);
+			break;
+		case stat_t::DOUBLE:
+			set_stat_value(stat, other.double_value);
+			break;
+		case stat_t::STRING:
+			set_stat_value(stat, other_tree.get_stat_string(other), other.string_size);
+			break;
+		case stat_t::COUNTER:
+			set_stat_value(stat, other.int_value);
+			stat.type = stat_t::COUNTER;
+			break;
+		}
+	}
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Helpers for get_stat(), check type of \a stat and convert its value
+	 */
+	static void check_stat_type(const stat_t &stat, stat_t::type_t type) {
+		if (stat.type != type) {
+			throw std::invalid_argument("Can't get stat: stat has another type");
+		}
+	}
+
+	static bool get_stat_value(const stat_t &stat, bool *) {
+		check_stat_type(stat, stat_t::BOOL);
+		return stat.bool_value;
+	}
+
+	static int get_stat_value(const stat_t &stat, int *) {
+		return static_cast<int>(get_stat_value(stat, static_cast<int64_t*>(NULL)));
+	}
+
+	static int64_t get_stat_value(const stat_t &stat, int64_t *) {
+		if (stat.type != stat_t::COUNTER) {
+			check_stat_type(stat, stat_t::INT);
+		}
+		return stat.int_value;
+	}
+
+	static double get_stat_value(const stat_t &stat, double *) {
+		check_stat_type(stat, stat_t::DOUBLE);
+		return stat.double_value;
+	}
+
+	std::string get_stat_value(const stat_t &stat, std::string *) const {
+		check_stat_type(stat, stat_t::STRING);
+		return std::string(get_stat_string(stat), stat.string_size);
+	}
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Allocates space for new node
+	 * \param action_code Action code of new node
+	 * \return Pointer to newly created node
+	 */
+	p_node_t new_node(int action_code) {
+		if (nodes_number == NO_NODE) {
+			throw std::length_error("Can't add new node: call tree is full");
+		}
+
+		if (nodes_number < nodes.size()) {
+			nodes[nodes_number] = node_t(action_code);
+		} else {
+			nodes.emplace_back(action_code);
+		}
+		return nodes_number++;
+	}
+
+	/*!
+	 * \brief Tree nodes pool, first \a nodes_number of them are in use
+	 */
+	std::vector<node_t> nodes;
+
+	/*!
+	 * \brief Number of used nodes in the pool
+	 */
+	size_t nodes_number;
+
+	/*!
+	 * \brief Available actions for monitoring
+	 */
+	const actions_set_t *actions_set;
+
+	/*!
+	 * \brief User stats, few per tree, so they are searched linearly
+	 */
+	std::vector<stat_t> stats;
+
+	/*!
+	 * \brief Pool of string values of stats that don't fit inline
+	 */
+	std::vector<std::string> strings;
+
+	/*!
+	 * \brief Number of used strings in the pool, the rest keep their memory for reuse
+	 */
+	size_t strings_number;
+
+	/*!
+	 * \brief Summaries of nodes that represent several calls, keyed by node
+	 */
+	std::unordered_map<p_node_t, node_summary_t> summaries;
+
+	/*!
+	 * \brief Collapsed children keyed by parent node (high 32 bits) and action code
+	 */
+	std::unordered_map<uint64_t, p_node_t> collapsed_links;
+
+	/*!
+	 * \brief Number of actions that were collapsed because of nodes budget
+	 */
+	uint64_t collapsed_actions_number;
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Stat of a node, stats of the same node are linked in order of their addition
+	 */
+	struct node_stat_t {
+		uint32_t next;
+		stat_t stat;
+	};
+
+	/*!
+	 * \brief Stats of all nodes, few nodes are annotated, so they share one flat table
+	 */
+	std::vector<node_stat_t> node_stats;
+
+	/*!
+	 * \brief Index of the first stat in \a node_stats keyed by node
+	 */
+	std::unordered_map<p_node_t, uint32_t> node_stats_heads;
+};
+
+/*!
+ * \brief Concurrent version of time stats tree to handle simultanious updates
+ *
+ * Tree is owned by a single writer thread (usually the thread that activated react),
+ * which updates it without any synchronization. Other threads never touch the tree
+ * directly: they hand their updates off with merge_later(), and the owner applies
+ * them with apply_pending_merges() when it is about to publish the tree.
+ * Other threads read the tree by snapshot handoff: request_snapshot() raises a flag,
+ * the owner copies the tree under the lock at its next safe point (publish_snapshot()),
+ * and get_snapshot() returns the last published copy.
+ */
+class concurrent_call_tree_t {
+public:
+	typedef call_tree_t::p_node_t p_node_t;
+
+	/*!
+	 * \brief Initializes call_tree with \a actions_set
+	 * \param actions_set Set of available action for monitoring
+	 */
+	concurrent_call_tree_t(actions_set_t &actions_set):
+		call_tree(actions_set), has_pending_merges_flag(false), generation(0),
+		snapshot(actions_set), snapshot_epoch(0), snapshot_requested(false) {}
+
+	/*!
+	 * \brief Value of merge_later() \a generation which matches any generation of the tree
+	 */
+	static const uint64_t ANY_GENERATION = -1;
+
+	/*!
+	 * \brief Locks state shared with other threads: pending merges and published snapshot
+	 */
+	void lock() const {
+		tree_mutex.lock();
+	}
+
+	/*!
+	 * \brief Unlocks state shared with other threads
+	 */
+	void unlock() const {
+		tree_mutex.unlock();
+	}
+
+	/*!
+	 * \brief Clears inner tree for the next request and drops merges scheduled for the previous one
+	 *
+	 * Must be called by the owner thread. Starts new generation of the tree,
+	 * so merges scheduled for the previous generation are rejected.
+	 */
+	void reset() {
+		std::lock_guard<std::mutex> guard(tree_mutex);
+		call_tree.reset();
+		pending_merges.clear();
+		has_pending_merges_flag.store(false, std::memory_order_relaxed);
+		++generation;
+	}
+
+	/*!
+	 * \brief Returns number of resets of the tree
+	 *
+	 * Must be called by the owner thread, it is the only thread which changes generation.
+	 */
+	uint64_t get_generation() const {
+		return generation;
+	}
+
+	/*!
+	 * \brief Returns inner time stats tree
+	 *
+	 * Inner tree must be modified only by the owner thread.
+	 *
+	 * \return Inner time stats tree
+	 */
+	call_tree_t& get_call_tree() {
+		return call_tree;
+	}
+
+	/*!
+	 * \brief Returns copy of inner time stats tree
+	 *
+	 * Must be called by the owner thread, other threads use request_snapshot() and get_snapshot().
+	 *
+	 * \return Copy of inner time stats tree
+	 */
+	call_tree_t copy_call_tree() const {
+		return call_tree;
+	}
+
+	/*!
+	 * \brief Takes inner time stats tree without copying and leaves empty tree in its place
+	 *
+	 * Must be called by the owner thread and there must be no unfinished actions in the tree.
+	 *
+	 * \return Inner time stats tree
+	 */
+	call_tree_t take_call_tree() {
+		call_tree_t taken_call_tree(std::move(call_tree));
+		call_tree.reset();
+		return taken_call_tree;
+	}
+
+	/*!
+	 * \brief Asks the owner to publish snapshot of the tree at its next safe point
+	 *
+	 * Safe to call from any thread.
+	 */
+	void request_snapshot() {
+		snapshot_requested.store(true, std::memory_order_release);
+	}
+
+	/*!
+	 * \brief Checks whether snapshot was requested, costs one plain load for the owner
+	 */
+	bool snapshot_is_requested() const {
+		return snapshot_requested.load(std::memory_order_relaxed);
+	}
+
+	/*!
+	 * \brief Copies inner tree into published snapshot
+	 *
+	 * Must be called by the owner thread.
+	 */
+	void publish_snapshot() {
+		std::lock_guard<std::mutex> guard(tree_mutex);
+		snapshot = call_tree;
+		++snapshot_epoch;
+		snapshot_requested.store(false, std::memory_order_relaxed);
+	}
+
+	/*!
+	 * \brief Copies the last published snapshot into \a snapshot_copy
+	 *
+	 * Safe to call from any thread.
+	 *
+	 * \param snapshot_copy Target for the snapshot, left unchanged if nothing was published
+	 * \return Number of published snapshots, 0 if nothing was published yet
+	 */
+	uint64_t get_snapshot(call_tree_t &snapshot_copy) const {
+		std::lock_guard<std::mutex> guard(tree_mutex);
+		if (snapshot_epoch) {
+			snapshot_copy = snapshot;
+		}
+		return snapshot_epoch;
+	}
+
+	/*!
+	 * \brief Schedules merge of \a rhs_tree into \a node of inner tree
+	 *
+	 * Safe to call from any thread. Merge is performed later by the owner thread
+	 * in apply_pending_merges().
+	 *
+	 * \param node Node of inner tree in which \a rhs_tree will be merged
+	 * \param rhs_tree Tree which will be merged
+	 * \param generation Generation of the tree that \a node belongs to, see get_generation()
+	 * \return False if the tree was reset since \a generation and merge is dropped
+	 */
+	bool merge_later(p_node_t node, const call_tree_t &rhs_tree, uint64_t generation = ANY_GENERATION) {
+		std::lock_guard<std::mutex> guard(tree_mutex);
+		if (generation != ANY_GENERATION && generation != this->generation) {
+			return false;
+		}
+		pending_merges.emplace_back(node, rhs_tree);
+		has_pending_merges_flag.store(true, std::memory_order_release);
+		return true;
+	}
+
+	/*!
+	 * \brief Schedules merge of \a rhs_tree into \a node of inner tree, takes tree without copying
+	 * \param node Node of inner tree in which \a rhs_tree will be merged
+	 * \param rhs_tree Tree which will be merged
+	 * \param generation Generation of the tree that \a node belongs to, see get_generation()
+	 * \return False if the tree was reset since \a generation and merge is dropped
+	 */
+	bool merge_later(p_node_t node, call_tree_t &&rhs_tree, uint64_t generation = ANY_GENERATION) {
+		std::lock_guard<std::mutex> guard(tree_mutex);
+		if (generation != ANY_GENERATION && generation != this->generation) {
+			return false;
+		}
+		pending_merges.emplace_back(node, std::move(rhs_tree));
+		has_pending_merges_flag.store(true, std::memory_order_release);
+		return true;
+	}
+
+	/*!
+	 * \brief Checks whether there are merges scheduled by other threads
+	 * \return True if apply_pending_merges() has work to do
+	 */
+	bool has_pending_merges() const {
+		return has_pending_merges_flag.load(std::memory_order_acquire);
+	}
+
+	/*!
+	 * \brief Merges trees scheduled by merge_later() into inner tree
+	 *
+	 * Must be called by the owner thread.
+	 */
+	void apply_pending_merges() {
+		if (!has_pending_merges()) {
+			return;
+		}
+
+		std::lock_guard<std::mutex> guard(tree_mutex);
+		for (auto it = pending_merges.begin(); it != pending_merges.end(); ++it) {
+			it->second.merge_into(it->first, call_tree);
+		}
+		pending_merges.clear();
+		has_pending_merges_flag.store(false, std::memory_order_relaxed);
+	}
+
+private:
+	/*!
+	 * \brief Lock of state shared between owner and other threads, inner tree is not guarded by it
+	 */
+	mutable std::mutex tree_mutex;
 
 	/*!
 	 * \brief Inner call_tree
 	 */
 	call_tree_t call_tree;
+
+	/*!
+	 * \brief Trees scheduled for merge by other threads and nodes they will be merged into
+	 */
+	std::vector<std::pair<p_node_t, call_tree_t>> pending_merges;
+
+	/*!
+	 * \brief Shows whether \a pending_merges is not empty, readable without lock
+	 */
+	std::atomic<bool> has_pending_merges_flag;
+
+	/*!
+	 * \brief Number of resets, changed by the owner under \a tree_mutex
+	 */
+	uint64_t generation;
+
+	/*!
+	 * \brief Copy of inner tree published by the owner, guarded by \a tree_mutex
+	 */
+	call_tree_t snapshot;
+
+	/*!
+	 * \brief Number of published snapshots, guarded by \a tree_mutex
+	 */
+	uint64_t snapshot_epoch;
+
+	/*!
+	 * \brief Set by readers to ask the owner for snapshot
+	 */
+	std::atomic<bool> snapshot_requested;
 };
 
 
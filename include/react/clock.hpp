@@ -0,0 +1,230 @@
+/*
+* 2013+ Copyright (c) Andrey Kashin <kashin.andrej@gmail.com>
+* All rights reserved.
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*/
+
+#ifndef REACT_CLOCK_HPP
+#define REACT_CLOCK_HPP
+
+#include <chrono>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+
+#if defined(__i386__) || defined(__x86_64__)
+#  include <x86intrin.h>
+#  include <cpuid.h>
+#  define REACT_HAVE_TSC 1
+#endif
+
+namespace react {
+
+/*!
+ * \brief Clock used for timestamping actions
+ *
+ * Timestamps are stored in raw ticks of the selected clock source
+ * and converted to nanoseconds since epoch only when call tree is exported.
+ * Available sources are std::chrono::steady_clock and invariant TSC.
+ */
+class tick_clock_t {
+public:
+	/*!
+	 * \brief Raw clock value type
+	 */
+	typedef int64_t ticks_t;
+
+	/*!
+	 * \brief Available clock sources
+	 */
+	enum source_t {
+		/*!
+		 * \brief std::chrono::steady_clock, one tick is one nanosecond
+		 */
+		STEADY_CLOCK,
+
+		/*!
+		 * \brief Invariant time stamp counter read by rdtsc
+		 */
+		TSC_CLOCK
+	};
+
+	/*!
+	 * \brief Returns current time in ticks of selected clock source
+	 * \return Current time in ticks
+	 */
+	static ticks_t now() {
+#ifdef REACT_HAVE_TSC
+		if (get_state().source.load(std::memory_order_relaxed) == TSC_CLOCK) {
+			return __rdtsc();
+		}
+#endif
+		return read_steady_clock();
+	}
+
+	/*!
+	 * \brief Returns selected clock source
+	 * \return Selected clock source
+	 */
+	static source_t get_source() {
+		return static_cast<source_t>(get_state().source.load(std::memory_order_relaxed));
+	}
+
+	/*!
+	 * \brief Checks whether cpu provides invariant TSC
+	 * \return True if TSC can be used as clock source
+	 */
+	static bool tsc_is_available() {
+#ifdef REACT_HAVE_TSC
+		unsigned int eax, ebx, ecx, edx;
+		if (!__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) || eax < 0x80000007) {
+			return false;
+		}
+		__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+		return (edx & (1 << 8)) != 0;
+#else
+		return false;
+#endif
+	}
+
+	/*!
+	 * \brief Selects clock source and calibrates it against system clock
+	 *
+	 * Must be called before any actions are traced, since ticks of different
+	 * sources are not comparable. Falls back to STEADY_CLOCK if \a source is unavailable.
+	 *
+	 * \param source Requested clock source
+	 */
+	static void calibrate(source_t source) {
+		state_t &state = get_state();
+
+		if (source == TSC_CLOCK && !tsc_is_available()) {
+			source = STEADY_CLOCK;
+		}
+
+		double ns_per_tick = 1.;
+#ifdef REACT_HAVE_TSC
+		if (source == TSC_CLOCK) {
+			const int64_t CALIBRATION_TIME = 5000000;
+
+			int64_t steady_start = read_steady_clock();
+			ticks_t tsc_start = __rdtsc();
+			int64_t steady_stop = steady_start;
+			while (steady_stop - steady_start < CALIBRATION_TIME) {
+				steady_stop = read_steady_clock();
+			}
+			ticks_t tsc_stop = __rdtsc();
+
+			ns_per_tick = double(steady_stop - steady_start) / double(tsc_stop - tsc_start);
+		}
+#endif
+
+		state.source.store(source, std::memory_order_relaxed);
+		state.ns_per_tick = ns_per_tick;
+		state.base_ticks = now();
+		state.base_nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(
+					std::chrono::system_clock::now().time_since_epoch()
+		).count();
+	}
+
+	/*!
+	 * \brief Calibrates clock with the best available source if it was not calibrated yet
+	 */
+	static void initialize() {
+		static std::once_flag calibrated;
+		std::call_once(calibrated, calibrate, TSC_CLOCK);
+	}
+
+	/*!
+	 * \brief Converts time point in ticks to nanoseconds since epoch
+	 *
+	 * Time point 0 means that time was never set and stays 0.
+	 *
+	 * \param ticks Time point in ticks
+	 * \return Nanoseconds since epoch
+	 */
+	static int64_t to_nanoseconds(ticks_t ticks) {
+		if (ticks == 0) {
+			return 0;
+		}
+
+		const state_t &state = get_state();
+		return state.base_nanoseconds + duration_to_nanoseconds(ticks - state.base_ticks);
+	}
+
+	/*!
+	 * \brief Converts duration in ticks to nanoseconds
+	 * \param ticks Duration in ticks
+	 * \return Duration in nanoseconds
+	 */
+	static int64_t duration_to_nanoseconds(ticks_t ticks) {
+		return static_cast<int64_t>(ticks * get_state().ns_per_tick);
+	}
+
+private:
+	/*!
+	 * \internal
+	 *
+	 * \brief Calibration results shared by all threads
+	 */
+	struct state_t {
+		/*!
+		 * \brief Initializes uncalibrated steady clock, which is constant-initialized
+		 */
+		constexpr state_t(): source(STEADY_CLOCK), ns_per_tick(1.), base_ticks(0), base_nanoseconds(0) {}
+
+		/*!
+		 * \brief Selected clock source
+		 */
+		std::atomic<int> source;
+
+		/*!
+		 * \brief Tick duration in nanoseconds
+		 */
+		double ns_per_tick;
+
+		/*!
+		 * \brief Ticks at the moment of calibration
+		 */
+		ticks_t base_ticks;
+
+		/*!
+		 * \brief Nanoseconds since epoch at the moment of calibration
+		 */
+		int64_t base_nanoseconds;
+	};
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Returns process-wide clock state
+	 */
+	static state_t &get_state() {
+		static state_t state;
+		return state;
+	}
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Reads steady clock in nanoseconds
+	 */
+	static int64_t read_steady_clock() {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+					std::chrono::steady_clock::now().time_since_epoch()
+		).count();
+	}
+};
+
+} // namespace react
+
+#endif // REACT_CLOCK_HPP
@@ -0,0 +1,189 @@
+/*
+* 2013+ Copyright (c) Andrey Kashin <kashin.andrej@gmail.com>
+* All rights reserved.
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*/
+
+#ifndef REACT_EVENT_LOG_HPP
+#define REACT_EVENT_LOG_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "call_tree.hpp"
+
+namespace react {
+
+/*!
+ * \brief Start or stop of action recorded by event log
+ *
+ * Events are plain 16-byte records, so appending one is a couple of stores.
+ */
+struct event_t {
+	/*!
+	 * \brief Kinds of events
+	 */
+	enum kind_t {
+		START = 0,
+		STOP = 1
+	};
+
+	/*!
+	 * \brief Action which was started or stopped
+	 */
+	int32_t action_code;
+
+	uint32_t kind;
+
+	/*!
+	 * \brief Time of event, in tick_clock_t ticks
+	 */
+	int64_t time;
+};
+
+/*!
+ * \brief Preallocated ring of start/stop events of one thread
+ *
+ * Event log is a cheaper alternative to building call tree on every start/stop:
+ * events are only appended, and tree is reconstructed from them when it is exported.
+ * When ring is full, the oldest events are overwritten.
+ * Event log must be used from a single thread.
+ */
+class event_log_t {
+public:
+	/*!
+	 * \brief Initializes log which keeps at least \a capacity last events
+	 * \param capacity Min number of kept events, rounded up to power of two
+	 */
+	event_log_t(size_t capacity = 0): events_number(0) {
+		set_capacity(capacity);
+	}
+
+	/*!
+	 * \brief Changes number of kept events and removes all events
+	 * \param capacity Min number of kept events, rounded up to power of two
+	 */
+	void set_capacity(size_t capacity) {
+		size_t ring_size = 1;
+		while (ring_size < capacity) {
+			ring_size <<= 1;
+		}
+		events.assign(ring_size, event_t());
+		mask = ring_size - 1;
+		events_number = 0;
+	}
+
+	/*!
+	 * \brief Returns max number of kept events
+	 */
+	size_t get_capacity() const {
+		return events.size();
+	}
+
+	/*!
+	 * \brief Appends event, overwrites the oldest one if log is full
+	 * \param action_code Action which was started or stopped
+	 * \param kind Kind of event
+	 * \param time Time of event in tick_clock_t ticks
+	 */
+	void append(int action_code, event_t::kind_t kind, int64_t time) {
+		event_t &event = events[events_number & mask];
+		event.action_code = action_code;
+		event.kind = kind;
+		event.time = time;
+		++events_number;
+	}
+
+	/*!
+	 * \brief Returns number of kept events
+	 */
+	size_t size() const {
+		return std::min<uint64_t>(events_number, events.size());
+	}
+
+	bool empty() const {
+		return events_number == 0;
+	}
+
+	/*!
+	 * \brief Returns number of events that were overwritten since last clear()
+	 */
+	uint64_t get_dropped_events_number() const {
+		return events_number - size();
+	}
+
+	/*!
+	 * \brief Returns \a index-th kept event, 0 is the oldest one
+	 */
+	const event_t &operator [](size_t index) const {
+		return events[(events_number - size() + index) & mask];
+	}
+
+	/*!
+	 * \brief Removes all events, memory is kept
+	 */
+	void clear() {
+		events_number = 0;
+	}
+
+	/*!
+	 * \brief Reconstructs actions from kept events as children of \a node of \a call_tree
+	 *
+	 * Stops whose starts were overwritten and stops that don't match the last started action
+	 * are skipped. Actions that are not stopped yet are added as unfinished ones.
+	 *
+	 * \param call_tree Target call tree, its actions set must contain all logged actions
+	 * \param node Node which logged actions will be added to
+	 */
+	void replay(call_tree_t &call_tree, call_tree_t::p_node_t node) {
+		parents.clear();
+		call_tree_t::p_node_t current_node = node;
+		for (size_t i = 0; i < size(); ++i) {
+			const event_t &event = (*this)[i];
+			if (event.kind == event_t::START) {
+				parents.push_back(current_node);
+				current_node = call_tree.add_new_link_unchecked(current_node, event.action_code);
+				call_tree.set_node_start_time(current_node, event.time);
+			} else if (!parents.empty() && call_tree.get_node_action_code(current_node) == event.action_code) {
+				call_tree.set_node_stop_time(current_node, event.time);
+				current_node = parents.back();
+				parents.pop_back();
+			}
+		}
+	}
+
+private:
+	/*!
+	 * \brief Ring of events, its size is power of two
+	 */
+	std::vector<event_t> events;
+
+	/*!
+	 * \brief Ring size minus one, maps number of event to its position
+	 */
+	size_t mask;
+
+	/*!
+	 * \brief Number of events appended since last clear()
+	 */
+	uint64_t events_number;
+
+	/*!
+	 * \brief Reusable stack of started actions' parents used by replay()
+	 */
+	std::vector<call_tree_t::p_node_t> parents;
+};
+
+} // namespace react
+
+#endif // REACT_EVENT_LOG_HPP
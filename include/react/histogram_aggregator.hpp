@@ -0,0 +1,514 @@
+/*
+* 2013+ Copyright (c) Andrey Kashin <kashin.andrej@gmail.com>
+* All rights reserved.
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*/
+
+#ifndef REACT_HISTOGRAM_AGGREGATOR_HPP
+#define REACT_HISTOGRAM_AGGREGATOR_HPP
+
+#include <atomic>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "aggregator.hpp"
+
+namespace react {
+
+/*!
+ * \brief Log-linear histogram of durations in nanoseconds
+ *
+ * Also used for throughput of actions, then values are units per second.
+ * Values below 2^SUB_BUCKET_BITS have own buckets, every next power of two is split
+ * into 2^SUB_BUCKET_BITS equal buckets, so relative error of quantiles is below 1/16.
+ * Values above 2^MAX_VALUE_BITS nanoseconds (about 18 minutes) fall into the last bucket.
+ * Histograms of the same layout are merged by adding bucket counts.
+ */
+class latency_histogram_t {
+public:
+	static const int SUB_BUCKET_BITS = 4;
+	static const int MAX_VALUE_BITS = 40;
+	static const size_t SUB_BUCKETS_NUMBER = 1 << SUB_BUCKET_BITS;
+	static const size_t BUCKETS_NUMBER = (MAX_VALUE_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKETS_NUMBER;
+
+	latency_histogram_t(): buckets(BUCKETS_NUMBER, 0), count(0) {}
+
+	/*!
+	 * \brief Returns index of bucket which contains \a value
+	 * \param value Duration in nanoseconds, negative durations are counted as zero
+	 */
+	static size_t bucket_index(int64_t value) {
+		if (value < static_cast<int64_t>(SUB_BUCKETS_NUMBER)) {
+			return value > 0 ? value : 0;
+		}
+		if (value >= (int64_t(1) << MAX_VALUE_BITS)) {
+			return BUCKETS_NUMBER - 1;
+		}
+
+		int msb = 63 - __builtin_clzll(value);
+		int shift = msb - SUB_BUCKET_BITS;
+		return ((shift + 1) << SUB_BUCKET_BITS) + ((value >> shift) & (SUB_BUCKETS_NUMBER - 1));
+	}
+
+	/*!
+	 * \brief Returns the largest value which falls into bucket \a index
+	 */
+	static int64_t bucket_upper_bound(size_t index) {
+		if (index < SUB_BUCKETS_NUMBER) {
+			return index;
+		}
+
+		int shift = (index >> SUB_BUCKET_BITS) - 1;
+		int64_t sub_bucket = SUB_BUCKETS_NUMBER + (index & (SUB_BUCKETS_NUMBER - 1));
+		return ((sub_bucket + 1) << shift) - 1;
+	}
+
+	/*!
+	 * \brief Adds \a number values equal to \a value
+	 */
+	void record(int64_t value, uint64_t number = 1) {
+		buckets[bucket_index(value)] += number;
+		count += number;
+	}
+
+	/*!
+	 * \brief Adds all values of \a other histogram
+	 */
+	void merge(const latency_histogram_t &other) {
+		for (size_t i = 0; i < BUCKETS_NUMBER; ++i) {
+			buckets[i] += other.buckets[i];
+		}
+		count += other.count;
+	}
+
+	/*!
+	 * \brief Returns number of recorded values
+	 */
+	uint64_t get_count() const {
+		return count;
+	}
+
+	/*!
+	 * \brief Returns number of recorded values in bucket \a index
+	 */
+	uint64_t get_bucket_count(size_t index) const {
+		return buckets[index];
+	}
+
+	/*!
+	 * \brief Returns upper bound of bucket which contains \a quantile of recorded values
+	 * \param quantile Quantile in range [0, 1]
+	 * \return Duration in nanoseconds, 0 if histogram is empty
+	 */
+	int64_t get_quantile(double quantile) const {
+		if (count == 0) {
+			return 0;
+		}
+
+		uint64_t rank = static_cast<uint64_t>(std::ceil(quantile * count));
+		rank = std::max<uint64_t>(1, std::min(rank, count));
+
+		uint64_t seen = 0;
+		for (size_t i = 0; i < BUCKETS_NUMBER; ++i) {
+			seen += buckets[i];
+			if (seen >= rank) {
+				return bucket_upper_bound(i);
+			}
+		}
+		return bucket_upper_bound(BUCKETS_NUMBER - 1);
+	}
+
+private:
+	std::vector<uint64_t> buckets;
+	uint64_t count;
+};
+
+/*!
+ * \brief Aggregator that records durations of actions into per-action latency histograms
+ *
+ * Each thread records into its own shard of histograms with relaxed atomic increments,
+ * so aggregation takes no locks once the thread has seen the action.
+ * Shards are merged when histograms are read, shards of exited threads
+ * are then folded into aggregator's own histograms and freed.
+ *
+ * For actions with counters (see call_tree_t::add_node_counter()) throughput of every call,
+ * counter per second of its duration, is recorded into per-action and per-counter histogram.
+ */
+class histogram_aggregator_t : public aggregator_t {
+public:
+	/*!
+	 * \brief Histograms of throughput keyed by action code and counter's stat key code
+	 */
+	typedef std::map<std::pair<int, int>, latency_histogram_t> throughput_histograms_t;
+
+	histogram_aggregator_t(): actions_set(nullptr) {}
+
+	/*!
+	 * \brief Records durations of all finished actions of \a call_tree
+	 * \param call_tree Tree for aggregation
+	 */
+	void aggregate(const call_tree_t &call_tree) {
+		const actions_set_t *tree_actions_set = &call_tree.get_actions_set();
+		if (actions_set.load(std::memory_order_relaxed) != tree_actions_set) {
+			// Shared pointer is written only when it changes, so workers don't contend on it
+			actions_set.store(tree_actions_set, std::memory_order_release);
+		}
+
+		shard_t &shard = shards.local();
+		for (call_tree_t::p_node_t node = 0; node < call_tree.get_nodes_number(); ++node) {
+			if (node == call_tree.root || !call_tree.node_is_finished(node)) {
+				continue;
+			}
+			int64_t start_time = call_tree.get_node_start_time(node);
+			int64_t stop_time = call_tree.get_node_stop_time(node);
+
+			int action_code = call_tree.get_node_action_code(node);
+			atomic_histogram_t &histogram = shard.get_histogram(action_code);
+			uint64_t calls = 1;
+			int64_t total_time = stop_time - start_time;
+			if (const node_summary_t *summary = call_tree.get_node_summary(node)) {
+				record_summary(histogram, *summary);
+				calls = summary->calls;
+				total_time = summary->total_time;
+			} else {
+				histogram.record(tick_clock_t::duration_to_nanoseconds(total_time), 1);
+			}
+
+			call_tree.for_each_node_stat(node, [&] (const stat_t &stat) {
+				if (stat.type == stat_t::COUNTER) {
+					record_throughput(shard.get_throughput_histogram(action_code, stat.key),
+							stat.int_value, tick_clock_t::duration_to_nanoseconds(total_time), calls);
+				}
+			});
+		}
+	}
+
+	/*!
+	 * \brief Returns histograms of all actions merged from all threads
+	 * \param reset Whether histograms should be cleared, so next call returns only new values
+	 * \return Histograms indexed by action code
+	 */
+	std::vector<latency_histogram_t> get_histograms(bool reset = false) {
+		std::lock_guard<std::mutex> guard(retired_mutex);
+		reclaim_retired_shards();
+		std::vector<latency_histogram_t> histograms = retired_histograms;
+		if (reset) {
+			retired_histograms.clear();
+		}
+
+		shards.for_each([&] (shard_t &shard) {
+			std::lock_guard<std::mutex> shard_guard(shard.mutex);
+			if (histograms.size() < shard.histograms.size()) {
+				histograms.resize(shard.histograms.size());
+			}
+
+			for (size_t action_code = 0; action_code < shard.histograms.size(); ++action_code) {
+				if (!shard.histograms[action_code]) {
+					continue;
+				}
+
+				shard.histograms[action_code]->load(histograms[action_code], reset);
+			}
+		});
+
+		return histograms;
+	}
+
+	/*!
+	 * \brief Returns throughput histograms of all actions with counters merged from all threads
+	 * \param reset Whether histograms should be cleared, so next call returns only new values
+	 * \return Histograms of units per second keyed by action code and counter's stat key code
+	 */
+	throughput_histograms_t get_throughput_histograms(bool reset = false) {
+		std::lock_guard<std::mutex> guard(retired_mutex);
+		reclaim_retired_shards();
+		throughput_histograms_t histograms = retired_throughput_histograms;
+		if (reset) {
+			retired_throughput_histograms.clear();
+		}
+
+		shards.for_each([&] (shard_t &shard) {
+			std::lock_guard<std::mutex> shard_guard(shard.mutex);
+			for (auto it = shard.throughput_histograms.begin(); it != shard.throughput_histograms.end(); ++it) {
+				std::pair<int, int> key(it->first >> 32, static_cast<int>(it->first & 0xffffffff));
+				it->second->load(histograms[key], reset);
+			}
+		});
+
+		return histograms;
+	}
+
+	/*!
+	 * \brief Returns throughput histogram of counter \a key of action with \a action_code
+	 * \return Histogram of units per second merged from all threads
+	 */
+	latency_histogram_t get_throughput_histogram(int action_code, int key) {
+		throughput_histograms_t histograms = get_throughput_histograms();
+		auto it = histograms.find(std::make_pair(action_code, key));
+		return it != histograms.end() ? it->second : latency_histogram_t();
+	}
+
+	/*!
+	 * \brief Returns histogram of action with \a action_code merged from all threads
+	 */
+	latency_histogram_t get_histogram(int action_code) {
+		std::vector<latency_histogram_t> histograms = get_histograms();
+		if (static_cast<size_t>(action_code) < histograms.size()) {
+			return histograms[action_code];
+		}
+		return latency_histogram_t();
+	}
+
+	/*!
+	 * \brief Returns \a quantile of durations of action with \a action_code in nanoseconds
+	 */
+	int64_t get_quantile(int action_code, double quantile) {
+		return get_histogram(action_code).get_quantile(quantile);
+	}
+
+	/*!
+	 * \brief Writes quantiles of all seen actions into SAX-style json \a writer
+	 *
+	 * Output is an object keyed by action name, each value contains number of calls
+	 * and 50%, 75%, 90%, 95%, 99% quantiles and max in nanoseconds.
+	 * Actions with counters also have "throughput" object keyed by counter name
+	 * with the same quantiles of units per second.
+	 *
+	 * \param writer Json writer, e.g. rapidjson::Writer
+	 * \param reset Whether histograms should be cleared after snapshot
+	 */
+	template<typename Writer>
+	void write_json(Writer &writer, bool reset = false) {
+		std::vector<latency_histogram_t> histograms = get_histograms(reset);
+		throughput_histograms_t throughput_histograms = get_throughput_histograms(reset);
+		const actions_set_t *actions_set = this->actions_set.load(std::memory_order_acquire);
+
+		writer.StartObject();
+		for (size_t action_code = 0; action_code < histograms.size(); ++action_code) {
+			const latency_histogram_t &histogram = histograms[action_code];
+			if (histogram.get_count() == 0) {
+				continue;
+			}
+
+			const std::string &name = actions_set->get_action_name(action_code);
+			writer.String(name.c_str(), name.size());
+			writer.StartObject();
+			write_json_quantiles(histogram, writer);
+
+			auto it = throughput_histograms.lower_bound(std::make_pair(static_cast<int>(action_code), 0));
+			if (it != throughput_histograms.end() && it->first.first == static_cast<int>(action_code)) {
+				writer.String("throughput");
+				writer.StartObject();
+				for (; it != throughput_histograms.end() && it->first.first == static_cast<int>(action_code); ++it) {
+					const std::string &counter_name = actions_set->get_stat_key_name(it->first.second);
+					writer.String(counter_name.c_str(), counter_name.size());
+					writer.StartObject();
+					write_json_quantiles(it->second, writer);
+					writer.EndObject();
+				}
+				writer.EndObject();
+			}
+			writer.EndObject();
+		}
+		writer.EndObject();
+	}
+
+private:
+	/*!
+	 * \internal
+	 *
+	 * \brief Writes number of values and quantiles of \a histogram into opened json object
+	 */
+	template<typename Writer>
+	static void write_json_quantiles(const latency_histogram_t &histogram, Writer &writer) {
+		static const double QUANTILES[] = {0.5, 0.75, 0.9, 0.95, 0.99, 1.};
+		static const char *QUANTILES_NAMES[] = {"50%", "75%", "90%", "95%", "99%", "max"};
+
+		writer.String("calls");
+		writer.Uint64(histogram.get_count());
+		for (size_t i = 0; i < sizeof(QUANTILES) / sizeof(QUANTILES[0]); ++i) {
+			writer.String(QUANTILES_NAMES[i]);
+			writer.Int64(histogram.get_quantile(QUANTILES[i]));
+		}
+	}
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Histogram which buckets are incremented concurrently with reads
+	 */
+	struct atomic_histogram_t {
+		atomic_histogram_t() {
+			for (size_t i = 0; i < latency_histogram_t::BUCKETS_NUMBER; ++i) {
+				buckets[i].store(0, std::memory_order_relaxed);
+			}
+		}
+
+		void record(int64_t value, uint64_t number) {
+			buckets[latency_histogram_t::bucket_index(value)].fetch_add(number, std::memory_order_relaxed);
+		}
+
+		/*!
+		 * \brief Adds recorded values to \a histogram
+		 * \param reset Whether buckets should be cleared
+		 */
+		void load(latency_histogram_t &histogram, bool reset) {
+			for (size_t i = 0; i < latency_histogram_t::BUCKETS_NUMBER; ++i) {
+				uint64_t number = reset ? buckets[i].exchange(0, std::memory_order_relaxed)
+				                        : buckets[i].load(std::memory_order_relaxed);
+				if (number) {
+					histogram.record(latency_histogram_t::bucket_upper_bound(i), number);
+				}
+			}
+		}
+
+		std::atomic<uint64_t> buckets[latency_histogram_t::BUCKETS_NUMBER];
+	};
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Histograms written by one thread
+	 *
+	 * Only the owner thread changes list of histograms and does it under \a mutex,
+	 * so it reads the list without locking.
+	 */
+	struct shard_t {
+		atomic_histogram_t &get_histogram(int action_code) {
+			if (static_cast<size_t>(action_code) >= histograms.size() || !histograms[action_code]) {
+				std::lock_guard<std::mutex> guard(mutex);
+				if (static_cast<size_t>(action_code) >= histograms.size()) {
+					histograms.resize(action_code + 1);
+				}
+				histograms[action_code].reset(new atomic_histogram_t());
+			}
+			return *histograms[action_code];
+		}
+
+		atomic_histogram_t &get_throughput_histogram(int action_code, int key) {
+			uint64_t histogram_key = (static_cast<uint64_t>(action_code) << 32) | static_cast<uint32_t>(key);
+			auto it = throughput_histograms.find(histogram_key);
+			if (it != throughput_histograms.end()) {
+				return *it->second;
+			}
+
+			std::lock_guard<std::mutex> guard(mutex);
+			std::unique_ptr<atomic_histogram_t> &histogram = throughput_histograms[histogram_key];
+			histogram.reset(new atomic_histogram_t());
+			return *histogram;
+		}
+
+		std::mutex mutex;
+		std::vector<std::unique_ptr<atomic_histogram_t>> histograms;
+
+		/*!
+		 * \brief Throughput histograms keyed by action code (high 32 bits) and counter's stat key code
+		 */
+		std::unordered_map<uint64_t, std::unique_ptr<atomic_histogram_t>> throughput_histograms;
+	};
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Folds shards of exited threads into retired histograms, called under \a retired_mutex
+	 */
+	void reclaim_retired_shards() {
+		shards.reclaim_retired([this] (shard_t &shard) {
+			if (retired_histograms.size() < shard.histograms.size()) {
+				retired_histograms.resize(shard.histograms.size());
+			}
+			for (size_t action_code = 0; action_code < shard.histograms.size(); ++action_code) {
+				if (shard.histograms[action_code]) {
+					shard.histograms[action_code]->load(retired_histograms[action_code], false);
+				}
+			}
+
+			for (auto it = shard.throughput_histograms.begin(); it != shard.throughput_histograms.end(); ++it) {
+				std::pair<int, int> key(it->first >> 32, static_cast<int>(it->first & 0xffffffff));
+				it->second->load(retired_throughput_histograms[key], false);
+			}
+		});
+	}
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Records calls represented by node summary
+	 *
+	 * Individual durations are not known, so min and max are recorded as is
+	 * and the rest of calls are recorded with their mean duration.
+	 */
+	static void record_summary(atomic_histogram_t &histogram, const node_summary_t &summary) {
+		if (summary.calls == 0) {
+			return;
+		}
+
+		int64_t min_time = tick_clock_t::duration_to_nanoseconds(summary.min_time);
+		int64_t max_time = tick_clock_t::duration_to_nanoseconds(summary.max_time);
+		histogram.record(min_time, 1);
+		if (summary.calls == 1) {
+			return;
+		}
+		histogram.record(max_time, 1);
+		if (summary.calls > 2) {
+			int64_t rest_time = tick_clock_t::duration_to_nanoseconds(summary.total_time) - min_time - max_time;
+			histogram.record(rest_time / static_cast<int64_t>(summary.calls - 2), summary.calls - 2);
+		}
+	}
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Records throughput of \a calls which processed \a value units in \a total_time nanoseconds
+	 *
+	 * Individual calls are not known, so all of them are recorded with their mean throughput.
+	 */
+	static void record_throughput(atomic_histogram_t &histogram, int64_t value, int64_t total_time, uint64_t calls) {
+		if (calls == 0 || total_time <= 0) {
+			return;
+		}
+
+		histogram.record(static_cast<int64_t>(value * 1e9 / total_time), calls);
+	}
+
+	/*!
+	 * \brief Actions set of aggregated trees, used for names of actions and counters
+	 */
+	std::atomic<const actions_set_t*> actions_set;
+
+	/*!
+	 * \brief Per-thread shards of histograms
+	 */
+	thread_shards_t<shard_t> shards;
+
+	/*!
+	 * \brief Protects histograms of exited threads
+	 */
+	std::mutex retired_mutex;
+
+	/*!
+	 * \brief Latency histograms folded from shards of exited threads, indexed by action code
+	 */
+	std::vector<latency_histogram_t> retired_histograms;
+
+	/*!
+	 * \brief Throughput histograms folded from shards of exited threads
+	 */
+	throughput_histograms_t retired_throughput_histograms;
+};
+
+} // namespace react
+
+#endif // REACT_HISTOGRAM_AGGREGATOR_HPP
@@ -0,0 +1,510 @@
+/*
+* 2013+ Copyright (c) Andrey Kashin <kashin.andrej@gmail.com>
+* All rights reserved.
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*/
+
+#ifndef REACT_PROFILE_AGGREGATOR_HPP
+#define REACT_PROFILE_AGGREGATOR_HPP
+
+#include <limits>
+#include <mutex>
+
+#include "aggregator.hpp"
+
+namespace react {
+
+/*!
+ * \brief Call graph profile which folds call trees by paths of actions
+ *
+ * Every path of actions from the root (e.g. READ -> LOAD FROM DISK -> READ FROM DISK)
+ * is represented by a single profile node, which accumulates number of calls,
+ * total and self time, min and max time of all actions with this path.
+ * Memory consumption depends only on number of distinct paths, not on number of trees.
+ * Unfinished actions are skipped together with their subtrees.
+ * Nodes with summary are counted as all calls they represent.
+ * Counters of actions (see call_tree_t::add_node_counter()) are summed per path,
+ * so throughput of path is its counter divided by its total time.
+ * Profile is not thread-safe.
+ */
+class call_graph_profile_t {
+public:
+	typedef uint32_t p_node_t;
+
+	/*!
+	 * \brief Accumulated stats of one path
+	 */
+	struct profile_node_t {
+		profile_node_t(int action_code): action_code(action_code),
+			first_child(call_tree_t::NO_NODE), next_sibling(call_tree_t::NO_NODE),
+			calls(0), total_time(0), self_time(0),
+			min_time(std::numeric_limits<int64_t>::max()), max_time(0) {}
+
+		/*!
+		 * \brief Adds stats of \a other node with the same path
+		 */
+		void merge(const profile_node_t &other) {
+			calls += other.calls;
+			total_time += other.total_time;
+			self_time += other.self_time;
+			min_time = std::min(min_time, other.min_time);
+			max_time = std::max(max_time, other.max_time);
+			for (auto it = other.counters.begin(); it != other.counters.end(); ++it) {
+				add_counter(it->first, it->second);
+			}
+		}
+
+		/*!
+		 * \brief Adds \a value to counter with \a key
+		 */
+		void add_counter(int key, int64_t value) {
+			for (auto it = counters.begin(); it != counters.end(); ++it) {
+				if (it->first == key) {
+					it->second += value;
+					return;
+				}
+			}
+			counters.push_back(std::make_pair(key, value));
+		}
+
+		/*!
+		 * \brief Returns throughput of counter \a value per second of total time, 0 if time is unknown
+		 */
+		double get_throughput(int64_t value) const {
+			return total_time > 0 ? value * 1e9 / total_time : 0.;
+		}
+
+		/*!
+		 * \brief Action which ends the path, -1 for root
+		 */
+		int action_code;
+
+		p_node_t first_child;
+		p_node_t next_sibling;
+
+		/*!
+		 * \brief Number of finished actions with this path
+		 */
+		uint64_t calls;
+
+		/*!
+		 * \brief Sum of durations of actions in nanoseconds
+		 */
+		int64_t total_time;
+
+		/*!
+		 * \brief Total time minus time spent in child actions, in nanoseconds
+		 */
+		int64_t self_time;
+
+		int64_t min_time;
+		int64_t max_time;
+
+		/*!
+		 * \brief Sums of counters of actions with this path keyed by stat key code, few per path
+		 */
+		std::vector<std::pair<int, int64_t>> counters;
+	};
+
+	/*!
+	 * \brief Root of profile, its calls are number of folded trees
+	 */
+	static const p_node_t root = 0;
+
+	call_graph_profile_t() {
+		clear();
+	}
+
+	/*!
+	 * \brief Folds call tree into profile
+	 * \param call_tree Tree to fold
+	 */
+	void add(const call_tree_t &call_tree) {
+		++nodes[root].calls;
+		frames.clear();
+		frames.push_back(frame_t(call_tree.get_node_links(call_tree.root), root));
+
+		while (!frames.empty()) {
+			frame_t &frame = frames.back();
+			if (frame.next_child == frame.end) {
+				frames.pop_back();
+				continue;
+			}
+
+			call_tree_t::p_node_t tree_node = *frame.next_child++;
+			p_node_t parent = frame.profile_node;
+
+			if (!call_tree.node_is_finished(tree_node)) {
+				continue;
+			}
+			const node_summary_t *summary = call_tree.get_node_summary(tree_node);
+			if (summary && summary->calls == 0) {
+				// Collapsed node without finished calls
+				continue;
+			}
+			int64_t start_time = call_tree.get_node_start_time(tree_node);
+			int64_t stop_time = call_tree.get_node_stop_time(tree_node);
+
+			int action_code = call_tree.get_node_action_code(tree_node);
+			remember_name(actions_names, action_code, call_tree.get_actions_set().get_action_name(action_code));
+			p_node_t node = find_or_add_child(parent, action_code);
+
+			profile_node_t &stats = nodes[node];
+			int64_t duration;
+			if (summary) {
+				duration = tick_clock_t::duration_to_nanoseconds(summary->total_time);
+				stats.calls += summary->calls;
+				stats.min_time = std::min(stats.min_time, tick_clock_t::duration_to_nanoseconds(summary->min_time));
+				stats.max_time = std::max(stats.max_time, tick_clock_t::duration_to_nanoseconds(summary->max_time));
+			} else {
+				duration = tick_clock_t::duration_to_nanoseconds(stop_time - start_time);
+				++stats.calls;
+				stats.min_time = std::min(stats.min_time, duration);
+				stats.max_time = std::max(stats.max_time, duration);
+			}
+			stats.total_time += duration;
+			stats.self_time += duration;
+			call_tree.for_each_node_stat(tree_node, [&] (const stat_t &stat) {
+				if (stat.type == stat_t::COUNTER) {
+					remember_name(counters_names, stat.key, call_tree.get_actions_set().get_stat_key_name(stat.key));
+					stats.add_counter(stat.key, stat.int_value);
+				}
+			});
+
+			if (parent != root) {
+				nodes[parent].self_time -= duration;
+			} else {
+				nodes[root].total_time += duration;
+			}
+
+			node_links_t links = call_tree.get_node_links(tree_node);
+			if (!links.empty()) {
+				frames.push_back(frame_t(links, node));
+			}
+		}
+	}
+
+	/*!
+	 * \brief Adds stats of all paths of \a other profile
+	 * \param other Profile to merge
+	 */
+	void merge(const call_graph_profile_t &other) {
+		for (size_t action_code = 0; action_code < other.actions_names.size(); ++action_code) {
+			if (!other.actions_names[action_code].empty()) {
+				remember_name(actions_names, action_code, other.actions_names[action_code]);
+			}
+		}
+		for (size_t key = 0; key < other.counters_names.size(); ++key) {
+			if (!other.counters_names[key].empty()) {
+				remember_name(counters_names, key, other.counters_names[key]);
+			}
+		}
+
+		nodes[root].calls += other.nodes[root].calls;
+		nodes[root].total_time += other.nodes[root].total_time;
+
+		std::vector<std::pair<p_node_t, p_node_t>> merged_nodes;
+		merged_nodes.push_back(std::make_pair(+root, +root));
+		while (!merged_nodes.empty()) {
+			p_node_t other_parent = merged_nodes.back().first;
+			p_node_t parent = merged_nodes.back().second;
+			merged_nodes.pop_back();
+
+			for (p_node_t other_node = other.nodes[other_parent].first_child; other_node != call_tree_t::NO_NODE;
+					other_node = other.nodes[other_node].next_sibling) {
+				p_node_t node = find_or_add_child(parent, other.nodes[other_node].action_code);
+				nodes[node].merge(other.nodes[other_node]);
+				merged_nodes.push_back(std::make_pair(other_node, node));
+			}
+		}
+	}
+
+	/*!
+	 * \brief Removes all paths from profile
+	 */
+	void clear() {
+		nodes.clear();
+		nodes.push_back(profile_node_t(-1));
+	}
+
+	/*!
+	 * \brief Returns profile nodes, root is at index \a root
+	 */
+	const std::vector<profile_node_t> &get_nodes() const {
+		return nodes;
+	}
+
+	/*!
+	 * \brief Returns name of action with \a action_code seen in folded trees
+	 */
+	const std::string &get_action_name(int action_code) const {
+		return actions_names.at(action_code);
+	}
+
+	/*!
+	 * \brief Returns name of counter with \a key seen in folded trees
+	 */
+	const std::string &get_counter_name(int key) const {
+		return counters_names.at(key);
+	}
+
+	/*!
+	 * \brief Writes profile into SAX-style json \a writer
+	 *
+	 * Root object contains number of folded trees and their total time,
+	 * each action object contains name, calls, total_time, self_time, min_time, max_time,
+	 * counters if there are any and nested actions. Times are in nanoseconds.
+	 * Counters are written as {"bytes": {"total": 8192, "per_second": 4096000}},
+	 * where per_second is throughput over total time of the path.
+	 *
+	 * \param writer Json writer, e.g. rapidjson::Writer
+	 */
+	template<typename Writer>
+	void write_json(Writer &writer) const {
+		writer.StartObject();
+		writer.String("trees");
+		writer.Uint64(nodes[root].calls);
+		writer.String("total_time");
+		writer.Int64(nodes[root].total_time);
+
+		std::vector<p_node_t> parents;
+		p_node_t current_node = root;
+		while (true) {
+			if (nodes[current_node].first_child != call_tree_t::NO_NODE) {
+				writer.String("actions");
+				writer.StartArray();
+				parents.push_back(current_node);
+				current_node = nodes[current_node].first_child;
+				write_json_node_fields(current_node, writer);
+				continue;
+			}
+
+			writer.EndObject();
+			while (current_node != root && nodes[current_node].next_sibling == call_tree_t::NO_NODE) {
+				writer.EndArray();
+				current_node = parents.back();
+				parents.pop_back();
+				writer.EndObject();
+			}
+
+			if (current_node == root) {
+				return;
+			}
+
+			current_node = nodes[current_node].next_sibling;
+			write_json_node_fields(current_node, writer);
+		}
+	}
+
+private:
+	/*!
+	 * \internal
+	 *
+	 * \brief Children of call tree node that are being folded into \a profile_node
+	 */
+	struct frame_t {
+		frame_t(const node_links_t &links, p_node_t profile_node):
+			next_child(links.begin()), end(links.end()), profile_node(profile_node) {}
+
+		node_links_t::const_iterator next_child;
+		node_links_t::const_iterator end;
+		p_node_t profile_node;
+	};
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Returns child of \a parent with \a action_code, creates it if needed
+	 */
+	p_node_t find_or_add_child(p_node_t parent, int action_code) {
+		p_node_t last_child = call_tree_t::NO_NODE;
+		for (p_node_t child = nodes[parent].first_child; child != call_tree_t::NO_NODE;
+				child = nodes[child].next_sibling) {
+			if (nodes[child].action_code == action_code) {
+				return child;
+			}
+			last_child = child;
+		}
+
+		p_node_t child = nodes.size();
+		nodes.push_back(profile_node_t(action_code));
+		if (last_child == call_tree_t::NO_NODE) {
+			nodes[parent].first_child = child;
+		} else {
+			nodes[last_child].next_sibling = child;
+		}
+		return child;
+	}
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Copies name of action or counter when it is seen for the first time
+	 */
+	static void remember_name(std::vector<std::string> &names, size_t code, const std::string &name) {
+		if (code >= names.size()) {
+			names.resize(code + 1);
+		}
+		if (names[code].empty()) {
+			names[code] = name;
+		}
+	}
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Opens json object of \a current_node and writes its fields except children
+	 */
+	template<typename Writer>
+	void write_json_node_fields(p_node_t current_node, Writer &writer) const {
+		const profile_node_t &node = nodes[current_node];
+		const std::string &name = actions_names[node.action_code];
+
+		writer.StartObject();
+		writer.String("name");
+		writer.String(name.c_str(), name.size());
+		writer.String("calls");
+		writer.Uint64(node.calls);
+		writer.String("total_time");
+		writer.Int64(node.total_time);
+		writer.String("self_time");
+		writer.Int64(node.self_time);
+		writer.String("min_time");
+		writer.Int64(node.min_time);
+		writer.String("max_time");
+		writer.Int64(node.max_time);
+
+		if (!node.counters.empty()) {
+			writer.String("counters");
+			writer.StartObject();
+			for (auto it = node.counters.begin(); it != node.counters.end(); ++it) {
+				const std::string &counter_name = counters_names[it->first];
+				writer.String(counter_name.c_str(), counter_name.size());
+				writer.StartObject();
+				writer.String("total");
+				writer.Int64(it->second);
+				writer.String("per_second");
+				writer.Double(node.get_throughput(it->second));
+				writer.EndObject();
+			}
+			writer.EndObject();
+		}
+	}
+
+	/*!
+	 * \brief Profile nodes, children of each node form a linked list
+	 */
+	std::vector<profile_node_t> nodes;
+
+	/*!
+	 * \brief Names of actions seen in folded trees, indexed by action code
+	 */
+	std::vector<std::string> actions_names;
+
+	/*!
+	 * \brief Names of counters seen in folded trees, indexed by stat key code
+	 */
+	std::vector<std::string> counters_names;
+
+	/*!
+	 * \brief Reusable stack of nodes being folded
+	 */
+	std::vector<frame_t> frames;
+};
+
+/*!
+ * \brief Aggregator that folds all trees into one call graph profile
+ *
+ * Trees are folded into per-thread profiles, which are merged
+ * into the global one by collect() and before every read.
+ */
+class profile_aggregator_t : public sharded_aggregator_t<call_graph_profile_t> {
+public:
+	typedef call_graph_profile_t::p_node_t p_node_t;
+	typedef call_graph_profile_t::profile_node_t profile_node_t;
+
+	static const p_node_t root = call_graph_profile_t::root;
+
+	/*!
+	 * \brief Clears accumulated profile
+	 */
+	void reset() {
+		collect();
+		std::lock_guard<std::mutex> guard(profile_mutex);
+		profile.clear();
+	}
+
+	/*!
+	 * \brief Returns copy of accumulated profile nodes, root is at index \a root
+	 * \return Profile nodes
+	 */
+	std::vector<profile_node_t> get_nodes() {
+		collect();
+		std::lock_guard<std::mutex> guard(profile_mutex);
+		return profile.get_nodes();
+	}
+
+	/*!
+	 * \brief Returns name of action with \a action_code seen in aggregated trees
+	 */
+	std::string get_action_name(int action_code) {
+		collect();
+		std::lock_guard<std::mutex> guard(profile_mutex);
+		return profile.get_action_name(action_code);
+	}
+
+	/*!
+	 * \brief Returns name of counter with \a key seen in aggregated trees
+	 */
+	std::string get_counter_name(int key) {
+		collect();
+		std::lock_guard<std::mutex> guard(profile_mutex);
+		return profile.get_counter_name(key);
+	}
+
+	/*!
+	 * \brief Writes snapshot of profile into SAX-style json \a writer
+	 * \param writer Json writer, e.g. rapidjson::Writer
+	 */
+	template<typename Writer>
+	void write_json(Writer &writer) {
+		collect();
+		std::lock_guard<std::mutex> guard(profile_mutex);
+		profile.write_json(writer);
+	}
+
+protected:
+	void aggregate_shard(call_graph_profile_t &shard, const call_tree_t &call_tree) {
+		shard.add(call_tree);
+	}
+
+	void collect_shard(call_graph_profile_t &shard) {
+		std::lock_guard<std::mutex> guard(profile_mutex);
+		profile.merge(shard);
+		shard.clear();
+	}
+
+private:
+	/*!
+	 * \brief Protects global profile from concurrent collection and reads
+	 */
+	std::mutex profile_mutex;
+
+	/*!
+	 * \brief Global profile merged from all threads
+	 */
+	call_graph_profile_t profile;
+};
+
+} // namespace react
+
+#endif // REACT_PROFILE_AGGREGATOR_HPP
@@ -17,6 +17,7 @@
 #define REACT_H
 
 #include <stddef.h>
+#include <stdint.h>
 #include <stdbool.h>
 
 #ifndef Q_EXTERN_C
@@ -37,12 +38,23 @@ Q_EXTERN_C int react_define_new_action(const char *action_name);
 
 /*!
  * \brief Checks whether react monitoring is turned on
+ *
+ * Request which was not sampled by its aggregator is not monitored. It is still active
+ * while flight recorder is turned on, so that its actions are recorded, but its stats are dropped.
+ *
  * \return Returns 1 if react monitoring is on and 0 otherwise
  */
 Q_EXTERN_C int react_is_active();
 
 /*!
  * \brief Creates react thread context for monitoring and sets aggregator as sink
+ *
+ * Aggregator decides whether request is traced at all (head-based sampling).
+ * For unsampled request no context is created and all react calls
+ * are no-ops until matching react_deactivate(). If flight recorder is turned on
+ * (see react_set_flight_recorder()), unsampled request is activated without call tree:
+ * its actions go only to flight recorder and stat calls return without effect.
+ *
  * \param react_aggregator Aggregator that will be used to collect react trace
  * \return Returns error code
  */
@@ -73,14 +85,157 @@ Q_EXTERN_C int react_stop_action(int action_code);
  */
 Q_EXTERN_C int react_add_stat_bool(const char *key, bool value);
 Q_EXTERN_C int react_add_stat_int(const char *key, int value);
+Q_EXTERN_C int react_add_stat_int64(const char *key, int64_t value);
 Q_EXTERN_C int react_add_stat_double(const char *key, double value);
 Q_EXTERN_C int react_add_stat_string(const char *key, const char *value);
 
+/*!
+ * \brief Interns stat key \a key_name and returns its code
+ *
+ * Stats added by key codes don't hash and copy key names, so frequent stats
+ * should be added by codes defined once, like action codes.
+ *
+ * \param key_name Name of stat key
+ * \return Code of stat key
+ */
+Q_EXTERN_C int react_define_stat_key(const char *key_name);
+
+/*!
+ *  Functions that allow to put stats with interned keys into current react context
+ */
+Q_EXTERN_C int react_add_key_stat_bool(int key, bool value);
+Q_EXTERN_C int react_add_key_stat_int(int key, int value);
+Q_EXTERN_C int react_add_key_stat_int64(int key, int64_t value);
+Q_EXTERN_C int react_add_key_stat_double(int key, double value);
+Q_EXTERN_C int react_add_key_stat_string(int key, const char *value);
+
+/*!
+ *  Functions that allow to put stats into node of current action, outside of any action
+ *  they put stats into current react context like react_add_stat_*()
+ */
+Q_EXTERN_C int react_add_node_stat_bool(const char *key, bool value);
+Q_EXTERN_C int react_add_node_stat_int(const char *key, int value);
+Q_EXTERN_C int react_add_node_stat_int64(const char *key, int64_t value);
+Q_EXTERN_C int react_add_node_stat_double(const char *key, double value);
+Q_EXTERN_C int react_add_node_stat_string(const char *key, const char *value);
+
+Q_EXTERN_C int react_add_node_key_stat_bool(int key, bool value);
+Q_EXTERN_C int react_add_node_key_stat_int(int key, int value);
+Q_EXTERN_C int react_add_node_key_stat_int64(int key, int64_t value);
+Q_EXTERN_C int react_add_node_key_stat_double(int key, double value);
+Q_EXTERN_C int react_add_node_key_stat_string(int key, const char *value);
+
+/*!
+ * \brief Adds \a value to counter with \a key of current action
+ *
+ * Counters accumulate quantities processed by actions, e.g. bytes or items,
+ * profile and histogram aggregators report their throughput per second.
+ *
+ * \param key Name of counter
+ * \param value Value added to counter
+ * \return Returns error code
+ */
+Q_EXTERN_C int react_add_node_counter(const char *key, int64_t value);
+
+/*!
+ * \brief Adds \a value to counter with interned \a key of current action
+ * \param key Code of counter, see react_define_stat_key()
+ * \param value Value added to counter
+ * \return Returns error code
+ */
+Q_EXTERN_C int react_add_node_key_counter(int key, int64_t value);
+
 /*!
  * \brief Submits current context to aggregator
  */
 Q_EXTERN_C int react_submit_progress();
 
+/*!
+ * \brief Sets nodes budget of call trees of subsequent activations in all threads
+ *
+ * When call tree reaches \a max_nodes_number nodes, further calls of each action under
+ * the same parent are collapsed into one node with number of calls, total, min and max time.
+ * Number of collapsed calls is reported as "collapsed_actions" field of the tree.
+ *
+ * \param max_nodes_number Max number of nodes of call tree, (size_t)-1 for no limit
+ * \return Returns error code
+ */
+Q_EXTERN_C int react_set_max_nodes_number(size_t max_nodes_number);
+
+/*!
+ * \brief Turns on or off siblings coalescing for subsequent activations in all threads
+ *
+ * With coalescing, consecutive calls of the same action under the same parent are folded
+ * into one node with number of calls, total, min and max time instead of a node per call.
+ *
+ * \param coalesce_siblings Non-zero to turn coalescing on
+ * \return Returns error code
+ */
+Q_EXTERN_C int react_set_coalesce_siblings(int coalesce_siblings);
+
+/*!
+ * \brief Turns on or off event log mode for subsequent activations in all threads
+ *
+ * In event log mode react_start_action() and react_stop_action() only append 16-byte records
+ * to preallocated per-thread ring, and call tree is reconstructed from them at deactivation.
+ * When request makes more than \a capacity starts and stops, its oldest actions are lost
+ * and number of lost events is reported as "dropped_events" stat. Actions recorded this way
+ * can't be annotated with node stats and counters.
+ *
+ * \param capacity Number of events kept per thread, 0 to build call tree directly
+ * \return Returns error code
+ */
+Q_EXTERN_C int react_set_event_log_capacity(size_t capacity);
+
+/*!
+ * \brief Turns on or off flight recorder in all threads
+ *
+ * Flight recorder keeps last \a capacity start/stop events of each thread in preallocated ring,
+ * across requests and including requests which were not sampled by their aggregators.
+ * When dump is triggered, thread's events are replayed into call tree with "flight_recorder"
+ * stat set to trigger name and the tree is passed to \a react_aggregator.
+ * Takes effect on subsequent activations.
+ *
+ * \param capacity Number of events kept per thread, 0 to turn flight recorder off
+ * \param react_aggregator Aggregator for dumped trees, must outlive all activations, NULL to turn off
+ * \return Returns error code
+ */
+Q_EXTERN_C int react_set_flight_recorder(size_t capacity, void *react_aggregator);
+
+/*!
+ * \brief Sets latency of request after which thread dumps its flight recorder
+ *
+ * Latency is checked at deactivation, dumped tree has "flight_recorder" stat set to "latency"
+ * and "latency" stat with request latency in nanoseconds.
+ *
+ * \param latency_threshold Latency threshold in nanoseconds, 0 to turn off
+ * \return Returns error code
+ */
+Q_EXTERN_C int react_set_flight_recorder_latency_threshold(int64_t latency_threshold);
+
+/*!
+ * \brief Installs handler of \a signal_number which requests flight recorder dump
+ *
+ * Handler only requests dump, see react_dump_flight_recorder(): each thread dumps
+ * its recorder at its next deactivation, so idle thread or thread stuck in a request dumps nothing until then.
+ *
+ * \param signal_number Signal which triggers dump, e.g. SIGUSR1
+ * \return Returns error code
+ */
+Q_EXTERN_C int react_set_flight_recorder_signal(int signal_number);
+
+/*!
+ * \brief Requests dump of flight recorders of all threads
+ *
+ * Current thread dumps its recorder immediately, other threads dump theirs at next deactivation,
+ * so that rings are never read concurrently with their updates. Idle threads and threads stuck
+ * in a request don't dump until they finish a request. Dumped trees have
+ * "flight_recorder" stat set to "dump".
+ *
+ * \return Returns error code
+ */
+Q_EXTERN_C int react_dump_flight_recorder();
+
 /*!
  * \brief Creates aggregator that can be passed to subthread in order to monitor it
  *          and merge result of monitoring with current thread context
@@ -95,4 +250,60 @@ Q_EXTERN_C void *react_create_subthread_aggregator();
  */
 Q_EXTERN_C int react_destroy_subthread_aggregator(void *subthread_aggregator);
 
+/*!
+ * \brief TLS model of react thread-local state
+ *
+ * If REACT_INITIAL_EXEC_TLS is defined (library is built with it by ENABLE_INITIAL_EXEC_TLS option),
+ * thread-local state is accessed with initial-exec model without __tls_get_addr() calls.
+ * Library built this way must be loaded at program startup, not by dlopen().
+ */
+#ifdef REACT_INITIAL_EXEC_TLS
+#  define REACT_TLS_MODEL __attribute__((tls_model("initial-exec")))
+#else
+#  define REACT_TLS_MODEL
+#endif
+
+/*!
+ * \brief Non-zero while react monitoring is turned on in current thread
+ *
+ * Exported only for inline fast path below and must not be changed by user.
+ */
+Q_EXTERN_C __thread int react_thread_is_active REACT_TLS_MODEL;
+
+/*
+ * Inline fast path: when react is not active in current thread, calls below cost
+ * one predictable branch instead of a call into the library, and their arguments
+ * are not evaluated. Define REACT_DISABLE_INLINE_FAST_PATH to always call the library.
+ */
+#if !defined(REACT_CPP) && !defined(REACT_DISABLE_INLINE_FAST_PATH)
+#  define REACT_IF_ACTIVE(call) (__builtin_expect(react_thread_is_active, 0) ? (call) : 0)
+
+#  define react_is_active() (react_thread_is_active)
+#  define react_start_action(action_code) REACT_IF_ACTIVE((react_start_action)(action_code))
+#  define react_stop_action(action_code) REACT_IF_ACTIVE((react_stop_action)(action_code))
+#  define react_add_stat_bool(key, value) REACT_IF_ACTIVE((react_add_stat_bool)(key, value))
+#  define react_add_stat_int(key, value) REACT_IF_ACTIVE((react_add_stat_int)(key, value))
+#  define react_add_stat_int64(key, value) REACT_IF_ACTIVE((react_add_stat_int64)(key, value))
+#  define react_add_stat_double(key, value) REACT_IF_ACTIVE((react_add_stat_double)(key, value))
+#  define react_add_stat_string(key, value) REACT_IF_ACTIVE((react_add_stat_string)(key, value))
+#  define react_add_key_stat_bool(key, value) REACT_IF_ACTIVE((react_add_key_stat_bool)(key, value))
+#  define react_add_key_stat_int(key, value) REACT_IF_ACTIVE((react_add_key_stat_int)(key, value))
+#  define react_add_key_stat_int64(key, value) REACT_IF_ACTIVE((react_add_key_stat_int64)(key, value))
+#  define react_add_key_stat_double(key, value) REACT_IF_ACTIVE((react_add_key_stat_double)(key, value))
+#  define react_add_key_stat_string(key, value) REACT_IF_ACTIVE((react_add_key_stat_string)(key, value))
+#  define react_add_node_stat_bool(key, value) REACT_IF_ACTIVE((react_add_node_stat_bool)(key, value))
+#  define react_add_node_stat_int(key, value) REACT_IF_ACTIVE((react_add_node_stat_int)(key, value))
+#  define react_add_node_stat_int64(key, value) REACT_IF_ACTIVE((react_add_node_stat_int64)(key, value))
+#  define react_add_node_stat_double(key, value) REACT_IF_ACTIVE((react_add_node_stat_double)(key, value))
+#  define react_add_node_stat_string(key, value) REACT_IF_ACTIVE((react_add_node_stat_string)(key, value))
+#  define react_add_node_key_stat_bool(key, value) REACT_IF_ACTIVE((react_add_node_key_stat_bool)(key, value))
+#  define react_add_node_key_stat_int(key, value) REACT_IF_ACTIVE((react_add_node_key_stat_int)(key, value))
+#  define react_add_node_key_stat_int64(key, value) REACT_IF_ACTIVE((react_add_node_key_stat_int64)(key, value))
+#  define react_add_node_key_stat_double(key, value) REACT_IF_ACTIVE((react_add_node_key_stat_double)(key, value))
+#  define react_add_node_key_stat_string(key, value) REACT_IF_ACTIVE((react_add_node_key_stat_string)(key, value))
+#  define react_add_node_counter(key, value) REACT_IF_ACTIVE((react_add_node_counter)(key, value))
+#  define react_add_node_key_counter(key, value) REACT_IF_ACTIVE((react_add_node_key_counter)(key, value))
+#  define react_submit_progress() REACT_IF_ACTIVE((react_submit_progress)())
+#endif
+
 #endif // REACT_H
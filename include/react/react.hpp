@@ -16,6 +16,7 @@
 #ifndef REACT_HPP
 #define REACT_HPP
 
+#include <cstring>
 #include <memory>
 
 #include "react/call_tree.hpp"
@@ -26,8 +27,70 @@
 
 namespace react {
 
+/*!
+ * \brief Defines new action with \a action_name in current context actions set
+ * \param action_name Name for new action
+ * \return Code of action with \a action_name
+ */
+int define_new_action(const std::string &action_name);
+
+/*!
+ * \brief Base class of actions declared by REACT_ACTION and REACT_NAMED_ACTION
+ *
+ * Action is defined once, either at static initialization of a translation unit
+ * which declares the action or on first use of code(), whichever comes first.
+ * This makes actions safe to use from other static initializers,
+ * and their codes are always valid, so start/stop doesn't validate them.
+ */
+template<typename Tag>
+struct action_t {
+	/*!
+	 * \brief Returns code of action represented by \a Tag
+	 * \return Action code
+	 */
+	static int code() {
+		static const int action_code = define_new_action(Tag::name());
+		return action_code;
+	}
+};
+
+/*!
+ * \brief Action object declared by REACT_ACTION, defines its action during static initialization
+ */
+template<typename Tag>
+struct action_registrar_t : public action_t<Tag> {
+	action_registrar_t() {
+		action_t<Tag>::code();
+	}
+};
+
+/*!
+ * \internal
+ *
+ * \brief Returns updater of current thread context or NULL if react is not active
+ */
+call_tree_updater_t *get_thread_updater();
+
+/*!
+ * \internal
+ *
+ * \brief Returns updater of current thread context or NULL if react is not active or request is not sampled
+ *
+ * Unsampled request is active under flight recorder only to record its actions, so stats are dropped.
+ */
+call_tree_updater_t *get_sampled_thread_updater();
+
+/*!
+ * \brief Interns stat key \a key_name in current context actions set
+ * \param key_name Name of stat key
+ * \return Code of stat key
+ */
+int define_stat_key(const std::string &key_name);
+
 /*!
  * \brief Wrapper for action_guard_t with binded updater from local context
+ *
+ * Guard state is stored inline, so guarding a scope doesn't allocate memory.
  */
 class action_guard {
 public:
@@ -37,6 +100,17 @@ public:
 	 */
 	explicit action_guard(int action_code);
 
+	/*!
+	 * \brief Creates action_guard and starts action declared by REACT_ACTION
+	 *
+	 * When react is not active, costs one check of thread-local flag.
+	 *
+	 * \param action Started action
+	 */
+	template<typename Tag>
+	explicit action_guard(const action_t<Tag> &action):
+		m_action_guard(react_thread_is_active ? get_thread_updater() : NULL, action.code(), false) {}
+
 	action_guard(const action_guard &other) = delete;
 
 	/*!
@@ -51,11 +125,50 @@ public:
 	 */
 	void stop();
 
+	/*!
+	 * \brief Sets stat with interned \a key of guarded action to \a value
+	 *
+	 * Stat is rendered inside action's node, e.g. {"name": "READ", ..., "stats": {"bytes": 4096}}.
+	 */
+	template<typename T>
+	void annotate(int key, const T &value) {
+		m_action_guard.annotate(key, value);
+	}
+
+	/*!
+	 * \brief Sets stat with \a key of guarded action to \a value, interns \a key on the way
+	 */
+	template<typename T>
+	void annotate(const std::string &key, const T &value) {
+		if (m_action_guard.has_updater()) {
+			m_action_guard.annotate(define_stat_key(key), value);
+		}
+	}
+
+	/*!
+	 * \brief Adds \a value to counter with interned \a key of guarded action
+	 *
+	 * Counters are summed in action's node, e.g. {"name": "READ", ..., "stats": {"bytes": 8192}},
+	 * and profile and histogram aggregators report their throughput.
+	 */
+	void count(int key, int64_t value) {
+		m_action_guard.count(key, value);
+	}
+
+	/*!
+	 * \brief Adds \a value to counter with \a key of guarded action, interns \a key on the way
+	 */
+	void count(const std::string &key, int64_t value) {
+		if (m_action_guard.has_updater()) {
+			m_action_guard.count(define_stat_key(key), value);
+		}
+	}
+
 private:
 	/*!
-	 * \brief Wrapped action_guard_t
+	 * \brief Wrapped action_guard_t, has no updater if react is not active
 	 */
-	std::unique_ptr<react::action_guard_t> m_action_guard;
+	react::action_guard_t m_action_guard;
 };
 
 /*!
@@ -68,23 +181,104 @@ const actions_set_t &get_actions_set();
  * \internal
  *
  * \brief Adds new stat to current call tree
- * \param key Name of stat
+ * \param key Interned key of stat
  * \param value Value of stat
  */
-void add_stat_impl(const std::string &key, const react::stat_value_t &value);
+void add_stat_impl(int key, bool value);
+void add_stat_impl(int key, int64_t value);
+void add_stat_impl(int key, double value);
+void add_stat_impl(int key, const char *value, size_t size);
 
 /*!
- * \brief Template wrapper for add_stat_impl. Avoids specifying value type manually.
+ * \brief Adds stat with interned \a key to current call tree
+ */
+inline void add_stat(int key, bool value) {
+	add_stat_impl(key, value);
+}
+
+inline void add_stat(int key, int value) {
+	add_stat_impl(key, static_cast<int64_t>(value));
+}
+
+inline void add_stat(int key, int64_t value) {
+	add_stat_impl(key, value);
+}
+
+inline void add_stat(int key, double value) {
+	add_stat_impl(key, value);
+}
+
+inline void add_stat(int key, const char *value) {
+	add_stat_impl(key, value, strlen(value));
+}
+
+inline void add_stat(int key, const std::string &value) {
+	add_stat_impl(key, value.data(), value.size());
+}
+
+/*!
+ * \brief Adds stat with \a key to current call tree. Avoids specifying value type manually.
+ *
+ * Key is looked up on every call, so frequent stats should be added by interned keys.
+ * Lookup doesn't lock, but interned keys are never released, so keys must not be built from request data.
  */
 template<typename T>
 void add_stat(const std::string &key, const T &value) {
-	add_stat_impl(key, react::stat_value_t(value));
+	if (react_thread_is_active) {
+		add_stat(define_stat_key(key), value);
+	}
 }
 
 /*!
  * \brief Template specification for add_stat that handles char* correctly.
  */
-void add_stat(const std::string &key, const char *value);
+inline void add_stat(const std::string &key, const char *value) {
+	if (react_thread_is_active) {
+		add_stat(define_stat_key(key), value);
+	}
+}
+
+/*!
+ * \brief Sets stat with interned \a key of current action to \a value
+ *
+ * Outside of any action stat is added to current call tree, see add_stat().
+ */
+template<typename T>
+void add_node_stat(int key, const T &value) {
+	if (call_tree_updater_t *updater = get_sampled_thread_updater()) {
+		updater->annotate(key, value);
+	}
+}
+
+/*!
+ * \brief Sets stat with \a key of current action to \a value, interns \a key on the way
+ */
+template<typename T>
+void add_node_stat(const std::string &key, const T &value) {
+	if (react_thread_is_active) {
+		add_node_stat(define_stat_key(key), value);
+	}
+}
+
+/*!
+ * \brief Adds \a value to counter with interned \a key of current action
+ *
+ * Outside of any action value is added to counter of current call tree.
+ */
+inline void add_node_counter(int key, int64_t value) {
+	if (call_tree_updater_t *updater = get_sampled_thread_updater()) {
+		updater->count(key, value);
+	}
+}
+
+/*!
+ * \brief Adds \a value to counter with \a key of current action, interns \a key on the way
+ */
+inline void add_node_counter(const std::string &key, int64_t value) {
+	if (react_thread_is_active) {
+		add_node_counter(define_stat_key(key), value);
+	}
+}
 
 /*!
  * \brief Creates aggregator that can be passed to subthread in order to monitor it
@@ -95,4 +289,28 @@ std::shared_ptr<aggregator_t> create_subthread_aggregator();
 
 } // namespace react
 
+/*!
+ * \brief Declares action object \a action with name \a action_name and its tag type react_action_tag_##action
+ *
+ * Tag name is prefixed, so that actions like "size" or "time" don't collide with standard typedefs.
+ *
+ * Usage: REACT_NAMED_ACTION(LOAD_FROM_DISK, "LOAD FROM DISK");
+ *        react::action_guard guard(LOAD_FROM_DISK);
+ */
+#define REACT_NAMED_ACTION(action, action_name)                   \
+	struct react_action_tag_##action {                            \
+		static const char *name() {                               \
+			return action_name;                                   \
+		}                                                         \
+	};                                                            \
+	static const react::action_registrar_t<react_action_tag_##action> action
+
+/*!
+ * \brief Declares action object \a action named after itself
+ *
+ * Usage: REACT_ACTION(READ);
+ *        react::action_guard guard(READ);
+ */
+#define REACT_ACTION(action) REACT_NAMED_ACTION(action, #action)
+
 #endif // REACT_HPP
@@ -0,0 +1,328 @@
+/*
+* 2013+ Copyright (c) Andrey Kashin <kashin.andrej@gmail.com>
+* All rights reserved.
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*/
+
+#ifndef REACT_SAMPLING_HPP
+#define REACT_SAMPLING_HPP
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+
+#include "aggregator.hpp"
+
+namespace react {
+
+/*!
+ * \brief Returns pseudo-random number uniformly distributed in [0, 1)
+ *
+ * Uses per-thread xorshift generator, so it is cheap enough to be called on every activation.
+ */
+inline double thread_random() {
+	static thread_local uint64_t state = 0;
+	if (state == 0) {
+		state = std::hash<std::thread::id>()(std::this_thread::get_id()) ^
+				static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+		state |= 1;
+	}
+
+	state ^= state >> 12;
+	state ^= state << 25;
+	state ^= state >> 27;
+	return (state * 2685821657736338717ULL >> 11) * (1. / (uint64_t(1) << 53));
+}
+
+/*!
+ * \brief Aggregator that traces only given fraction of requests (head-based sampling)
+ *
+ * Decision is made at activation, so unsampled requests are not traced at all.
+ * Sampled trees are passed to target aggregator, which can sample them further.
+ */
+class rate_sampling_aggregator_t : public aggregator_t {
+public:
+	/*!
+	 * \brief Constructs aggregator
+	 * \param target Aggregator which receives sampled trees
+	 * \param rate Fraction of requests that are traced, in range [0, 1]
+	 */
+	rate_sampling_aggregator_t(aggregator_t &target, double rate): target(target), rate(rate) {}
+
+	bool sample() {
+		return thread_random() < rate && target.sample();
+	}
+
+	void aggregate(const call_tree_t &call_tree) {
+		target.aggregate(call_tree);
+	}
+
+	void aggregate_owned(call_tree_t &&call_tree) {
+		target.aggregate_owned(std::move(call_tree));
+	}
+
+private:
+	/*!
+	 * \brief Aggregator which receives sampled trees
+	 */
+	aggregator_t &target;
+
+	/*!
+	 * \brief Fraction of requests that are traced
+	 */
+	const double rate;
+};
+
+/*!
+ * \brief Aggregator that decides which trees to keep after request is finished (tail-based sampling)
+ *
+ * All requests are traced, but only trees accepted by predicate, e.g. slow ones,
+ * are passed to target aggregator, so fast requests are never serialized.
+ */
+class tail_sampling_aggregator_t : public aggregator_t {
+public:
+	typedef std::function<bool (const call_tree_t &)> predicate_t;
+
+	/*!
+	 * \brief Constructs aggregator which keeps trees accepted by \a predicate
+	 * \param target Aggregator which receives kept trees
+	 * \param predicate Returns true for trees that should be kept
+	 */
+	tail_sampling_aggregator_t(aggregator_t &target, predicate_t predicate):
+		target(target), predicate(predicate), kept_trees_number(0), dropped_trees_number(0) {}
+
+	/*!
+	 * \brief Constructs aggregator which keeps trees slower than \a latency_threshold
+	 * \param target Aggregator which receives kept trees
+	 * \param latency_threshold Min duration of kept trees in nanoseconds
+	 */
+	tail_sampling_aggregator_t(aggregator_t &target, int64_t latency_threshold):
+		target(target), predicate(slower_than(latency_threshold)),
+		kept_trees_number(0), dropped_trees_number(0) {}
+
+	bool sample() {
+		return target.sample();
+	}
+
+	void aggregate(const call_tree_t &call_tree) {
+		if (keep(call_tree)) {
+			target.aggregate(call_tree);
+		}
+	}
+
+	void aggregate_owned(call_tree_t &&call_tree) {
+		if (keep(call_tree)) {
+			target.aggregate_owned(std::move(call_tree));
+		}
+	}
+
+	/*!
+	 * \brief Returns duration of tree from start of its first action till stop of the last one
+	 * \return Duration in nanoseconds, 0 for empty tree
+	 */
+	static int64_t get_tree_duration(const call_tree_t &call_tree) {
+		node_links_t links = call_tree.get_node_links(call_tree.root);
+		if (links.empty()) {
+			return 0;
+		}
+
+		int64_t start_time = call_tree.get_node_start_time(*links.begin());
+		int64_t stop_time = start_time;
+		for (auto it = links.begin(); it != links.end(); ++it) {
+			stop_time = std::max(stop_time, call_tree.get_node_stop_time(*it));
+		}
+		return tick_clock_t::duration_to_nanoseconds(stop_time - start_time);
+	}
+
+	/*!
+	 * \brief Returns predicate which accepts trees slower than \a latency_threshold nanoseconds
+	 */
+	static predicate_t slower_than(int64_t latency_threshold) {
+		return [latency_threshold] (const call_tree_t &call_tree) {
+			return get_tree_duration(call_tree) >= latency_threshold;
+		};
+	}
+
+	/*!
+	 * \brief Returns predicate which accepts trees with stat \a key
+	 */
+	static predicate_t has_stat(const std::string &key) {
+		return [key] (const call_tree_t &call_tree) {
+			return call_tree.has_stat(key);
+		};
+	}
+
+	size_t get_kept_trees_number() const {
+		return kept_trees_number.load(std::memory_order_relaxed);
+	}
+
+	size_t get_dropped_trees_number() const {
+		return dropped_trees_number.load(std::memory_order_relaxed);
+	}
+
+private:
+	/*!
+	 * \internal
+	 *
+	 * \brief Applies predicate and counts decision
+	 */
+	bool keep(const call_tree_t &call_tree) {
+		if (predicate(call_tree)) {
+			kept_trees_number.fetch_add(1, std::memory_order_relaxed);
+			return true;
+		}
+		dropped_trees_number.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	/*!
+	 * \brief Aggregator which receives kept trees
+	 */
+	aggregator_t &target;
+
+	/*!
+	 * \brief Returns true for trees that should be kept
+	 */
+	const predicate_t predicate;
+
+	std::atomic<size_t> kept_trees_number;
+	std::atomic<size_t> dropped_trees_number;
+};
+
+/*!
+ * \brief Aggregator that keeps uniform random sample of fixed number of trees
+ *
+ * Implements reservoir sampling: after N trees were aggregated,
+ * each of them is kept with probability capacity / N.
+ * Kept trees are passed to another aggregator by flush().
+ */
+class reservoir_aggregator_t : public aggregator_t {
+public:
+	/*!
+	 * \brief Constructs aggregator
+	 * \param capacity Max number of kept trees
+	 */
+	reservoir_aggregator_t(size_t capacity): capacity(capacity), seen_trees_number(0),
+		random_generator(std::random_device()()) {
+		trees.reserve(capacity);
+	}
+
+	void aggregate(const call_tree_t &call_tree) {
+		std::lock_guard<std::mutex> guard(reservoir_mutex);
+		size_t index = choose_index();
+		if (index < capacity) {
+			store(index, std::unique_ptr<call_tree_t>(new call_tree_t(call_tree)));
+		}
+	}
+
+	void aggregate_owned(call_tree_t &&call_tree) {
+		std::lock_guard<std::mutex> guard(reservoir_mutex);
+		size_t index = choose_index();
+		if (index < trees.size()) {
+			// Replaced tree's memory goes back to the caller
+			*trees[index] = std::move(call_tree);
+		} else if (index < capacity) {
+			store(index, std::unique_ptr<call_tree_t>(new call_tree_t(std::move(call_tree))));
+		}
+	}
+
+	/*!
+	 * \brief Passes kept trees to \a target and starts new sample
+	 * \param target Aggregator which receives kept trees
+	 */
+	void flush(aggregator_t &target) {
+		std::vector<std::unique_ptr<call_tree_t>> sample;
+		{
+			std::lock_guard<std::mutex> guard(reservoir_mutex);
+			sample.swap(trees);
+			trees.reserve(capacity);
+			seen_trees_number = 0;
+		}
+
+		for (auto it = sample.begin(); it != sample.end(); ++it) {
+			target.aggregate_owned(std::move(**it));
+		}
+	}
+
+	/*!
+	 * \brief Returns number of currently kept trees
+	 */
+	size_t get_trees_number() const {
+		std::lock_guard<std::mutex> guard(reservoir_mutex);
+		return trees.size();
+	}
+
+	/*!
+	 * \brief Returns number of trees aggregated since last flush
+	 */
+	size_t get_seen_trees_number() const {
+		std::lock_guard<std::mutex> guard(reservoir_mutex);
+		return seen_trees_number;
+	}
+
+private:
+	/*!
+	 * \internal
+	 *
+	 * \brief Returns position for new tree, tree is dropped if position is not less than capacity
+	 */
+	size_t choose_index() {
+		++seen_trees_number;
+		if (seen_trees_number <= capacity) {
+			return seen_trees_number - 1;
+		}
+		return std::uniform_int_distribution<size_t>(0, seen_trees_number - 1)(random_generator);
+	}
+
+	/*!
+	 * \internal
+	 *
+	 * \brief Puts \a call_tree to position \a index
+	 */
+	void store(size_t index, std::unique_ptr<call_tree_t> call_tree) {
+		if (index == trees.size()) {
+			trees.push_back(std::move(call_tree));
+		} else {
+			trees[index] = std::move(call_tree);
+		}
+	}
+
+	/*!
+	 * \brief Max number of kept trees
+	 */
+	const size_t capacity;
+
+	/*!
+	 * \brief Protects kept trees
+	 */
+	mutable std::mutex reservoir_mutex;
+
+	/*!
+	 * \brief Kept trees
+	 */
+	std::vector<std::unique_ptr<call_tree_t>> trees;
+
+	/*!
+	 * \brief Number of trees aggregated since last flush
+	 */
+	size_t seen_trees_number;
+
+	std::mt19937_64 random_generator;
+};
+
+} // namespace react
+
+#endif // REACT_SAMPLING_HPP
@@ -17,9 +17,12 @@
 #define REACT_UPDATER_HPP
 
 #include <stack>
+#include <vector>
 #include <stdexcept>
 
 #include "call_tree.hpp"
+#include "clock.hpp"
+#include "event_log.hpp"
 
 namespace react {
 
@@ -27,6 +30,8 @@ namespace react {
  * \brief Class for interactive building of call tree
  *
  *  Allows you to log actions in call-tree manner.
+ *  Updater is the owner of its call tree: it must be used from a single thread
+ *  and writes the tree without locking (see concurrent_call_tree_t).
  */
 class call_tree_updater_t {
 public:
@@ -36,23 +41,30 @@ public:
 	typedef call_tree_t::p_node_t p_node_t;
 
 	/*!
-	 * \brief Time point type
+	 * \brief Time point type, raw ticks of tick_clock_t
 	 */
-	typedef std::chrono::time_point<std::chrono::system_clock> time_point_t;
+	typedef tick_clock_t::ticks_t time_point_t;
 
 	/*!
 	 * \brief Default monitored call stack depth
 	 */
 	static const size_t DEFAULT_MAX_TRACE_DEPTH = -1;
 
+	/*!
+	 * \brief Default nodes budget of call tree, unlimited
+	 */
+	static const size_t DEFAULT_MAX_NODES_NUMBER = -1;
+
 	/*!
 	 * \brief Initializes updater without target tree
 	 * \param max_depth Maximum monitored depth of call stack
 	 */
 	call_tree_updater_t(const size_t max_depth = DEFAULT_MAX_TRACE_DEPTH):
 		current_node(+call_tree_t::NO_NODE), call_tree(NULL),
-		trace_depth(0), max_trace_depth(max_depth) {
-		measurements.emplace(std::chrono::system_clock::now(), +call_tree_t::NO_NODE);
+		trace_depth(0), max_trace_depth(max_depth), max_nodes_number(DEFAULT_MAX_NODES_NUMBER),
+		coalesce_siblings(false), event_log(NULL), flight_recorder(NULL) {
+		tick_clock_t::initialize();
+		measurements.emplace(tick_clock_t::now(), +call_tree_t::NO_NODE, nullptr);
 	}
 
 	/*!
@@ -63,9 +75,11 @@ public:
 	call_tree_updater_t(concurrent_call_tree_t &call_tree,
 			const size_t max_depth = DEFAULT_MAX_TRACE_DEPTH):
 		current_node(+call_tree_t::NO_NODE), call_tree(NULL),
-		trace_depth(0), max_trace_depth(max_depth) {
+		trace_depth(0), max_trace_depth(max_depth), max_nodes_number(DEFAULT_MAX_NODES_NUMBER),
+		coalesce_siblings(false), event_log(NULL), flight_recorder(NULL) {
+		tick_clock_t::initialize();
 		set_call_tree(call_tree);
-		measurements.emplace(std::chrono::system_clock::now(), +call_tree_t::NO_NODE);
+		measurements.emplace(tick_clock_t::now(), +call_tree_t::NO_NODE, nullptr);
 	}
 
 	/*!
@@ -113,7 +127,7 @@ public:
 	 * \param action_code Code of new action
 	 */
 	void start(const int action_code) {
-		start(action_code, std::chrono::system_clock::now());
+		start(action_code, tick_clock_t::now());
 	}
 
 	/*!
@@ -129,18 +143,51 @@ public:
 			);
 		}
 
+		start_unchecked(action_code, start_time);
+	}
+
+	/*!
+	 * \brief Starts new branch in tree with action \a action_code that is known to be valid
+	 *
+	 * Skips validation of \a action_code, so it must be registered in tree's actions set
+	 * and call tree must be set.
+	 *
+	 * \param action_code Code of new action
+	 * \param start_time Action start time
+	 */
+	void start_unchecked(const int action_code, const time_point_t& start_time = tick_clock_t::now()) {
 		++trace_depth;
 		if (get_trace_depth() > max_trace_depth) {
 			return;
 		}
 
-		p_node_t next_node = call_tree_t::NO_NODE;
-		{
-			std::lock_guard<concurrent_call_tree_t> guard(*call_tree);
-			next_node = call_tree->get_call_tree().add_new_link(current_node, action_code);
+		if (flight_recorder) {
+			flight_recorder->append(action_code, event_t::START, start_time);
 		}
 
-		measurements.emplace(start_time, current_node);
+		if (event_log) {
+			event_log->append(action_code, event_t::START, start_time);
+			return;
+		}
+
+		call_tree_t &tree = call_tree->get_call_tree();
+		p_node_t next_node;
+		node_summary_t *summary = NULL;
+		if (tree.get_nodes_number() >= max_nodes_number) {
+			next_node = tree.add_collapsed_link(current_node, action_code);
+			summary = tree.get_node_summary(next_node);
+		} else if (coalesce_siblings &&
+				(next_node = tree.get_coalescable_link(current_node, action_code)) != call_tree_t::NO_NODE) {
+			summary = &tree.add_node_summary(next_node);
+		} else {
+			next_node = tree.add_new_link_unchecked(current_node, action_code);
+		}
+		if (!summary || summary->calls == 0) {
+			// Node with start time but without stop time is known to be unfinished
+			tree.set_node_start_time(next_node, start_time);
+		}
+
+		measurements.emplace(start_time, current_node, summary);
 		current_node = next_node;
 	}
 
@@ -156,12 +203,31 @@ public:
 			);
 		}
 
+		stop_unchecked(action_code);
+	}
+
+	/*!
+	 * \brief Stops last action with \a action_code that is known to be valid
+	 *
+	 * Skips validation of \a action_code, but still checks that last started action is stopped.
+	 *
+	 * \param action_code Code of finished action
+	 */
+	void stop_unchecked(const int action_code) {
 		if (get_trace_depth() > max_trace_depth) {
 			--trace_depth;
 			return;
 		}
 
-		std::lock_guard<concurrent_call_tree_t> guard(*call_tree);
+		if (flight_recorder) {
+			flight_recorder->append(action_code, event_t::STOP, tick_clock_t::now());
+		}
+
+		if (event_log) {
+			event_log->append(action_code, event_t::STOP, tick_clock_t::now());
+			--trace_depth;
+			return;
+		}
 
 		int expected_code = call_tree->get_call_tree().get_node_action_code(current_node);
 		if (expected_code != action_code) {
@@ -170,6 +236,82 @@ public:
 			throw std::logic_error("Stopping wrong action. Expected: " + expected_action_name + ", Found: " + found_action_name);
 		}
 		pop_measurement();
+
+		if (call_tree->snapshot_is_requested()) {
+			call_tree->publish_snapshot();
+		}
+	}
+
+	/*!
+	 * \brief Sets stat with interned \a key of current action to \a value
+	 *
+	 * Outside of any action stat is added to the call tree itself.
+	 * Actions beyond max trace depth and actions recorded into event log have no nodes,
+	 * so their stats are dropped.
+	 *
+	 * \param key Stat key code, see actions_set_t::define_stat_key()
+	 * \param value Value of stat
+	 */
+	template<typename T>
+	void annotate(int key, const T &value) {
+		if (!current_node_is_traced()) {
+			return;
+		}
+
+		annotate(current_node, key, value);
+	}
+
+	/*!
+	 * \brief Sets stat with interned \a key of action represented by \a node to \a value
+	 *
+	 * Node may belong to already finished action. If it accumulates several calls,
+	 * the last value is kept.
+	 *
+	 * \param node Node of call tree
+	 * \param key Stat key code, see actions_set_t::define_stat_key()
+	 * \param value Value of stat
+	 */
+	template<typename T>
+	void annotate(p_node_t node, int key, const T &value) {
+		call_tree_t &tree = call_tree->get_call_tree();
+		if (node == tree.root) {
+			tree.add_stat(key, value);
+		} else {
+			tree.add_node_stat(node, key, value);
+		}
+	}
+
+	/*!
+	 * \brief Adds \a value to counter with interned \a key of current action
+	 *
+	 * Outside of any action value is added to counter of the call tree itself.
+	 * Actions beyond max trace depth and actions recorded into event log have no nodes,
+	 * so their counters are dropped.
+	 *
+	 * \param key Stat key code, see actions_set_t::define_stat_key()
+	 * \param value Value added to counter
+	 */
+	void count(int key, int64_t value) {
+		if (!current_node_is_traced()) {
+			return;
+		}
+
+		count(current_node, key, value);
+	}
+
+	/*!
+	 * \brief Adds \a value to counter with interned \a key of action represented by \a node
+	 * \param node Node of call tree
+	 * \param key Stat key code, see actions_set_t::define_stat_key()
+	 * \param value Value added to counter
+	 */
+	void count(p_node_t node, int key, int64_t value) {
+		call_tree_t &tree = call_tree->get_call_tree();
+		if (node == tree.root) {
+			tree.add_counter(key, value);
+		} else {
+			tree.add_node_counter(node, key, value);
+		}
 	}
 
 	/*!
@@ -192,6 +334,113 @@ public:
 		this->max_trace_depth = max_depth;
 	}
 
+	/*!
+	 * \brief Gets nodes budget of call tree
+	 * \return Max number of nodes after which actions are collapsed
+	 */
+	size_t get_max_nodes_number() const {
+		return max_nodes_number;
+	}
+
+	/*!
+	 * \brief Sets nodes budget of call tree to \a max_nodes
+	 *
+	 * When call tree has \a max_nodes nodes, further calls of each action under the same parent
+	 * are collapsed into one node with summary (see call_tree_t::add_collapsed_link()),
+	 * so memory consumed by a request stays bounded however many actions it makes.
+	 *
+	 * \param max_nodes Max number of nodes after which actions are collapsed
+	 */
+	void set_max_nodes_number(const size_t max_nodes) {
+		this->max_nodes_number = max_nodes;
+	}
+
+	/*!
+	 * \brief Checks whether consecutive calls of the same action are folded into one node
+	 * \return True if siblings coalescing is on
+	 */
+	bool get_coalesce_siblings() const {
+		return coalesce_siblings;
+	}
+
+	/*!
+	 * \brief Turns on or off folding of consecutive calls of the same action into one node
+	 *
+	 * When action is started right after finished call of the same action under the same parent,
+	 * it reuses node of the previous call and node gets summary with number of calls,
+	 * total, min and max time. Children of all folded calls are added to this node,
+	 * so they are coalesced in turn, e.g. 1000 iterations of loop with READ inside
+	 * produce two nodes.
+	 *
+	 * \param coalesce_siblings Whether siblings should be coalesced
+	 */
+	void set_coalesce_siblings(const bool coalesce_siblings) {
+		this->coalesce_siblings = coalesce_siblings;
+	}
+
+	/*!
+	 * \brief Returns event log which records actions instead of call tree or NULL
+	 */
+	event_log_t *get_event_log() const {
+		return event_log;
+	}
+
+	/*!
+	 * \brief Switches updater to recording start/stop events into \a event_log instead of call tree
+	 *
+	 * Appending event to preallocated ring is much cheaper than adding node to the tree,
+	 * but stops are not checked against started actions, actions have no nodes to annotate
+	 * until events are replayed by apply_event_log(), and nodes budget and siblings
+	 * coalescing are not applied.
+	 *
+	 * \param event_log Log for events, NULL to build call tree directly
+	 */
+	void set_event_log(event_log_t *event_log) {
+		if (trace_depth != 0) {
+			throw std::logic_error("can't change event log during update");
+		}
+
+		this->event_log = event_log;
+	}
+
+	/*!
+	 * \brief Reconstructs actions recorded in event log in call tree and clears the log
+	 *
+	 * Must not be called while actions are started, otherwise their stops are lost.
+	 * Number of overwritten events, if any, is added to the tree as "dropped_events" stat.
+	 */
+	void apply_event_log() {
+		if (!event_log || event_log->empty()) {
+			return;
+		}
+
+		call_tree_t &tree = call_tree->get_call_tree();
+		event_log->replay(tree, tree.root);
+		if (uint64_t dropped_events_number = event_log->get_dropped_events_number()) {
+			tree.add_stat("dropped_events", static_cast<int64_t>(dropped_events_number));
+		}
+		event_log->clear();
+	}
+
+	/*!
+	 * \brief Returns log which start/stop events are mirrored to or NULL
+	 */
+	event_log_t *get_flight_recorder() const {
+		return flight_recorder;
+	}
+
+	/*!
+	 * \brief Mirrors start/stop events into \a flight_recorder in addition to usual recording
+	 *
+	 * Unlike event log, flight recorder is never replayed or cleared by updater,
+	 * so it can keep events of several consecutive trees.
+	 *
+	 * \param flight_recorder Log for mirrored events, NULL to turn mirroring off
+	 */
+	void set_flight_recorder(event_log_t *flight_recorder) {
+		this->flight_recorder = flight_recorder;
+	}
+
 	/*!
 	 * \brief Gets current call stack depth
 	 * \return Current call stack depth
@@ -212,7 +461,7 @@ public:
 	 * \brief Returns name of action with \a action_code
 	 * \return Name of action with \a action_code
 	 */
-	std::string get_action_name(int action_code) const {
+	const std::string &get_action_name(int action_code) const {
 		if (!has_call_tree()) {
 			throw std::logic_error("Can't get action name: tree is not set");
 		}
@@ -244,7 +493,7 @@ public:
 	 * \brief Returns name of action in current node
 	 * \return Current's node action name
 	 */
-	std::string get_current_node_action_name() const {
+	const std::string &get_current_node_action_name() const {
 		if (!has_call_tree()) {
 			throw std::logic_error("Can't get action name: tree is not set");
 		}
@@ -253,16 +502,6 @@ public:
 	}
 
 private:
-	/*!
-	 * \internal
-	 *
-	 * \brief Returns delta between two time_points
-	 */
-	template<class Period = std::chrono::microseconds>
-	int64_t delta(const time_point_t& start, const time_point_t& end) const {
-		return (std::chrono::duration_cast<Period> (end - start)).count();
-	}
-
 	/*!
 	 * \internal
 	 *
@@ -273,6 +512,11 @@ private:
 			std::string error_message;
 			if (!call_tree) {
 				error_message = "~time_stats_updater(): extra measurements, tree is NULL\n";
+			} else if (event_log) {
+				error_message = "~time_stats_updater(): extra measurements: "
+						+ std::to_string(static_cast<long long>(get_trace_depth()))
+						+ " actions recorded into event log are not stopped\n";
+				trace_depth = 0;
 			} else {
 				error_message = "~time_stats_updater(): extra measurements:\n";
 				if (get_actual_trace_depth() != get_trace_depth()) {
@@ -289,6 +533,15 @@ private:
 		}
 	}
 
+	/*!
+	 * \internal
+	 *
+	 * \brief Checks whether current action has node in call tree
+	 */
+	bool current_node_is_traced() const {
+		return get_trace_depth() <= max_trace_depth && (!event_log || trace_depth == 0);
+	}
+
 	/*!
 	 * \brief Represents single call measurement
 	 */
@@ -297,9 +550,10 @@ private:
 		 * \brief Initializes measurement with specified start time and pointer to previous node in call stack
 		 * \param time Start time
 		 * \param previous_node Pointer to previous node in call stack
+		 * \param summary Summary of measured node if it accumulates several calls
 		 */
-		measurement(const time_point_t& time, p_node_t previous_node): start_time(time),
-			previous_node(previous_node) {}
+		measurement(const time_point_t& time, p_node_t previous_node, node_summary_t *summary):
+			start_time(time), previous_node(previous_node), summary(summary) {}
 
 		/*!
 		 * \brief Start time of the measurement
@@ -310,17 +564,25 @@ private:
 		 * \brief Pointer to previous node in call stack
 		 */
 		p_node_t previous_node;
+
+		/*!
+		 * \brief Summary of measured node, NULL if node represents single call
+		 */
+		node_summary_t *summary;
 	};
 
 	/*!
 	 * \brief Removes measurement from top of call stack and updates corresponding node in call-tree
 	 * \param stop_time End time of the measurement
 	 */
-	void pop_measurement(const time_point_t& stop_time = std::chrono::system_clock::now()) {
+	void pop_measurement(const time_point_t& stop_time = tick_clock_t::now()) {
 		measurement previous_measurement = measurements.top();
 		measurements.pop();
-		call_tree->get_call_tree().set_node_start_time(current_node, delta(time_point_t(), previous_measurement.start_time));
-		call_tree->get_call_tree().set_node_stop_time(current_node, delta(time_point_t(), stop_time));
+		call_tree_t &tree = call_tree->get_call_tree();
+		if (previous_measurement.summary) {
+			previous_measurement.summary->add(stop_time - previous_measurement.start_time);
+		}
+		tree.set_node_stop_time(current_node, stop_time);
 		current_node = previous_measurement.previous_node;
 		--trace_depth;
 	}
@@ -331,9 +593,9 @@ private:
 	p_node_t current_node;
 
 	/*!
-	 * \brief Call stack
+	 * \brief Call stack, vector-based to keep its memory between requests
 	 */
-	std::stack<measurement> measurements;
+	std::stack<measurement, std::vector<measurement>> measurements;
 
 	/*!
 	 * \brief Target call-tree
@@ -349,6 +611,26 @@ private:
 	 * \brief Maximum monitored call stack depth
 	 */
 	size_t max_trace_depth;
+
+	/*!
+	 * \brief Number of nodes of call tree after which actions are collapsed
+	 */
+	size_t max_nodes_number;
+
+	/*!
+	 * \brief Shows whether consecutive calls of the same action are folded into one node
+	 */
+	bool coalesce_siblings;
+
+	/*!
+	 * \brief Log which records actions instead of call tree, NULL if tree is built directly
+	 */
+	event_log_t *event_log;
+
+	/*!
+	 * \brief Log which start/stop events are mirrored to, NULL if mirroring is off
+	 */
+	event_log_t *flight_recorder;
 };
 
 /*!
@@ -360,11 +642,21 @@ public:
 	 * \brief Initializes guard and starts action with \a action_code
 	 * \param updater Updater whos start is called
 	 * \param action_code Code of new action
+	 * \param validate_code Whether \a action_code should be validated,
+	 *        false only for codes known to be registered (e.g. ones defined by REACT_ACTION)
 	 */
-	action_guard_t(call_tree_updater_t *updater, const int action_code):
-		updater(updater), action_code(action_code), is_stopped(false) {
+	action_guard_t(call_tree_updater_t *updater, const int action_code, const bool validate_code = true):
+		updater(updater), action_code(action_code), validate_code(validate_code), is_stopped(false),
+		node(+call_tree_t::NO_NODE) {
 		if (updater) {
-			updater->start(action_code);
+			if (validate_code) {
+				updater->start(action_code);
+			} else {
+				updater->start_unchecked(action_code);
+			}
+			if (updater->get_trace_depth() <= updater->get_max_trace_depth() && !updater->get_event_log()) {
+				node = updater->get_current_node();
+			}
 		}
 	}
 
@@ -373,7 +665,42 @@ public:
 	 */
 	~action_guard_t() {
 		if (!is_stopped && updater) {
-			updater->stop(action_code);
+			stop_action();
+		}
+	}
+
+	/*!
+	 * \brief Checks whether guard has updater
+	 * \return True if guard updates call tree
+	 */
+	bool has_updater() const {
+		return updater != NULL;
+	}
+
+	/*!
+	 * \brief Sets stat with interned \a key of guarded action to \a value
+	 *
+	 * Works after action is stopped too. Does nothing if guard has no updater
+	 * or action is beyond max trace depth.
+	 *
+	 * \param key Stat key code, see actions_set_t::define_stat_key()
+	 * \param value Value of stat
+	 */
+	template<typename T>
+	void annotate(int key, const T &value) {
+		if (updater && node != call_tree_t::NO_NODE) {
+			updater->annotate(node, key, value);
+		}
+	}
+
+	/*!
+	 * \brief Adds \a value to counter with interned \a key of guarded action
+	 * \param key Stat key code, see actions_set_t::define_stat_key()
+	 * \param value Value added to counter
+	 */
+	void count(int key, int64_t value) {
+		if (updater && node != call_tree_t::NO_NODE) {
+			updater->count(node, key, value);
 		}
 	}
 
@@ -398,12 +725,25 @@ public:
 		}
 
 		if (updater) {
-			updater->stop(action_code);
+			stop_action();
 		}
 		is_stopped = true;
 	}
 
 private:
+	/*!
+	 * \internal
+	 *
+	 * \brief Stops guarded action in updater
+	 */
+	void stop_action() {
+		if (validate_code) {
+			updater->stop(action_code);
+		} else {
+			updater->stop_unchecked(action_code);
+		}
+	}
+
 	/*!
 	 * \brief Updater whos start/stop are called
 	 */
@@ -414,10 +754,20 @@ private:
 	 */
 	const int action_code;
 
+	/*!
+	 * \brief Shows if action code should be validated on start and stop
+	 */
+	const bool validate_code;
+
 	/*!
 	 * \brief Shows if action is already stopped
 	 */
 	bool is_stopped;
+
+	/*!
+	 * \brief Node of guarded action, NO_NODE if action is not traced
+	 */
+	call_tree_updater_t::p_node_t node;
 };
 
 } // namespace react
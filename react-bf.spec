@@ -72,6 +72,7 @@ rm -rf %{buildroot}
 %files
 %defattr(-,root,root,-)
 %{_libdir}/libreact.so.*
+%{_bindir}/react_decode
 
 %files devel
 %defattr(-,root,root,-)
@@ -21,6 +21,12 @@
 #include <stdexcept>
 #include <iostream>
 #include <mutex>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+
+#include <pthread.h>
+#include <signal.h>
 
 using namespace react;
 
@@ -38,40 +44,314 @@ int react_define_new_action(const char *action_name) {
 	}
 }
 
+int react_define_stat_key(const char *key_name) {
+	try {
+		return actions_set().define_stat_key(key_name);
+	} catch (std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return -ENOMEM;
+	}
+}
+
+/*
+ * Keys of stats added by react itself
+ */
+static int complete_stat_key() {
+	static const int key = actions_set().define_stat_key("complete");
+	return key;
+}
+
+static int id_stat_key() {
+	static const int key = actions_set().define_stat_key("id");
+	return key;
+}
+
+static int flight_recorder_stat_key() {
+	static const int key = actions_set().define_stat_key("flight_recorder");
+	return key;
+}
+
+static int latency_stat_key() {
+	static const int key = actions_set().define_stat_key("latency");
+	return key;
+}
+
 struct react_context_t {
-	react_context_t(react::aggregator_t *aggregator):
-		call_tree(actions_set()), updater(call_tree), aggregator(aggregator) {}
+	react_context_t(react::aggregator_t *aggregator, bool sampled):
+		call_tree(actions_set()), updater(call_tree), aggregator(aggregator),
+		sampled(sampled), start_time(0) {}
+
+	/*!
+	 * \brief Prepares finished context for the next activation, keeping its memory
+	 */
+	void reset(react::aggregator_t *aggregator, bool sampled) {
+		call_tree.reset();
+		updater.set_call_tree(call_tree);
+		event_log.clear();
+		this->aggregator = aggregator;
+		this->sampled = sampled;
+		start_time = 0;
+	}
 
 	concurrent_call_tree_t call_tree;
 	call_tree_updater_t updater;
 	react::aggregator_t *aggregator;
+
+	/*!
+	 * \brief Whether request is traced, otherwise it is only recorded by flight recorder
+	 */
+	bool sampled;
+
+	/*!
+	 * \brief Activation time, used to check request latency against flight recorder threshold.
+	 * It is 0 if threshold was not set at activation.
+	 */
+	call_tree_updater_t::time_point_t start_time;
+
+	/*!
+	 * \brief Ring of start/stop events used instead of building tree directly if it is turned on
+	 */
+	event_log_t event_log;
+};
+
+__thread int react_thread_is_active REACT_TLS_MODEL = 0;
+
+static __thread react_context_t *thread_react_context REACT_TLS_MODEL = NULL;
+static __thread int thread_react_context_refcount REACT_TLS_MODEL = 0;
+
+/*
+ * Finished context is kept per thread and reused by the next activation,
+ * so that steady-state tracing doesn't allocate. Cached context is freed on thread exit.
+ * Aggregators which take ownership of trees (e.g. async_aggregator_t) take the tree's memory
+ * with it, then the next request of the thread allocates its tree again.
+ */
+static __thread react_context_t *thread_react_context_cache REACT_TLS_MODEL = NULL;
+
+static pthread_key_t react_context_cache_key;
+static pthread_once_t react_context_cache_key_once = PTHREAD_ONCE_INIT;
+
+static void destroy_cached_context(void *context) {
+	delete static_cast<react_context_t*>(context);
+}
+
+static void create_context_cache_key() {
+	pthread_key_create(&react_context_cache_key, destroy_cached_context);
+}
+
+/*
+ * Flight recorder keeps last start/stop events of the thread across requests,
+ * including unsampled ones. It is replayed into a call tree and passed to flight recorder
+ * aggregator on react_dump_flight_recorder(), signal or slow request.
+ */
+struct flight_recorder_t {
+	flight_recorder_t(): handled_dump_requests(0) {}
+
+	event_log_t events;
+
+	/*!
+	 * \brief Number of dump requests handled by the thread
+	 */
+	uint64_t handled_dump_requests;
 };
 
-static __thread react_context_t *thread_react_context = NULL;
-static __thread int thread_react_context_refcount = 0;
+static __thread flight_recorder_t *thread_flight_recorder REACT_TLS_MODEL = NULL;
+
+static pthread_key_t flight_recorder_key;
+static pthread_once_t flight_recorder_key_once = PTHREAD_ONCE_INIT;
+
+static void destroy_flight_recorder(void *flight_recorder) {
+	delete static_cast<flight_recorder_t*>(flight_recorder);
+}
+
+static void create_flight_recorder_key() {
+	pthread_key_create(&flight_recorder_key, destroy_flight_recorder);
+}
+
+/*
+ * Number of events kept by flight recorder of each thread, 0 if it is turned off
+ */
+static std::atomic<size_t> flight_recorder_capacity(0);
+
+static std::atomic<react::aggregator_t*> flight_recorder_aggregator(NULL);
+
+/*
+ * Requests slower than this number of nanoseconds dump flight recorder, 0 to turn off
+ */
+static std::atomic<int64_t> flight_recorder_latency_threshold(0);
+
+/*
+ * Number of requested dumps, each thread dumps its recorder when it sees a new one.
+ * Incremented from signal handler, so it must stay lock-free.
+ */
+static std::atomic<uint64_t> flight_recorder_dump_requests(0);
+
+/*
+ * Returns flight recorder of current thread with at least current capacity or NULL if it is turned off
+ */
+static flight_recorder_t *acquire_flight_recorder() {
+	size_t capacity = flight_recorder_capacity.load(std::memory_order_relaxed);
+	if (!capacity) {
+		return NULL;
+	}
+
+	flight_recorder_t *flight_recorder = thread_flight_recorder;
+	if (!flight_recorder) {
+		pthread_once(&flight_recorder_key_once, create_flight_recorder_key);
+		flight_recorder = new flight_recorder_t();
+		flight_recorder->handled_dump_requests = flight_recorder_dump_requests.load(std::memory_order_relaxed);
+		thread_flight_recorder = flight_recorder;
+		pthread_setspecific(flight_recorder_key, flight_recorder);
+	}
+	if (flight_recorder->events.get_capacity() < capacity) {
+		flight_recorder->events.set_capacity(capacity);
+	}
+	return flight_recorder;
+}
+
+/*
+ * Replays flight recorder of current thread into call tree and passes it to flight recorder aggregator
+ */
+static void dump_thread_flight_recorder(const char *reason, int64_t latency = 0) {
+	flight_recorder_t *flight_recorder = thread_flight_recorder;
+	react::aggregator_t *aggregator = flight_recorder_aggregator.load(std::memory_order_acquire);
+	if (!flight_recorder || !aggregator || flight_recorder->events.empty()) {
+		return;
+	}
+
+	call_tree_t call_tree(actions_set());
+	flight_recorder->events.replay(call_tree, call_tree.root);
+	call_tree.add_stat(flight_recorder_stat_key(), reason);
+	if (latency) {
+		call_tree.add_stat(latency_stat_key(), latency);
+	}
+	aggregator->aggregate_owned(std::move(call_tree));
+}
+
+/*
+ * Dumps flight recorder of current thread if a dump was requested since its last check
+ */
+static void handle_flight_recorder_dump_requests() {
+	flight_recorder_t *flight_recorder = thread_flight_recorder;
+	if (!flight_recorder) {
+		return;
+	}
+
+	uint64_t dump_requests = flight_recorder_dump_requests.load(std::memory_order_relaxed);
+	if (flight_recorder->handled_dump_requests != dump_requests) {
+		flight_recorder->handled_dump_requests = dump_requests;
+		dump_thread_flight_recorder("dump");
+	}
+}
+
+static void flight_recorder_signal_handler(int) {
+	flight_recorder_dump_requests.fetch_add(1, std::memory_order_relaxed);
+}
+
+/*
+ * Nodes budget applied to contexts at activation
+ */
+static std::atomic<size_t> max_nodes_number(+call_tree_updater_t::DEFAULT_MAX_NODES_NUMBER);
+
+/*
+ * Siblings coalescing mode applied to contexts at activation
+ */
+static std::atomic<bool> coalesce_siblings(false);
+
+/*
+ * Capacity of event log applied to contexts at activation, 0 if tree is built directly
+ */
+static std::atomic<size_t> event_log_capacity(0);
+
+static react_context_t *acquire_context(react::aggregator_t *aggregator, bool sampled,
+		flight_recorder_t *flight_recorder) {
+	react_context_t *context = thread_react_context_cache;
+	if (context) {
+		thread_react_context_cache = NULL;
+		pthread_setspecific(react_context_cache_key, NULL);
+		context->reset(aggregator, sampled);
+	} else {
+		context = new react_context_t(aggregator, sampled);
+	}
+
+	context->updater.set_max_nodes_number(max_nodes_number.load(std::memory_order_relaxed));
+	context->updater.set_coalesce_siblings(coalesce_siblings.load(std::memory_order_relaxed));
+	if (flight_recorder && flight_recorder_latency_threshold.load(std::memory_order_relaxed)) {
+		context->start_time = tick_clock_t::now();
+	}
+
+	if (!sampled) {
+		// Unsampled request has no tree to build, its events only go to flight recorder
+		context->updater.set_event_log(&flight_recorder->events);
+		context->updater.set_flight_recorder(NULL);
+		return context;
+	}
+
+	context->updater.set_flight_recorder(flight_recorder ? &flight_recorder->events : NULL);
+	size_t capacity = event_log_capacity.load(std::memory_order_relaxed);
+	if (capacity) {
+		if (context->event_log.get_capacity() < capacity) {
+			context->event_log.set_capacity(capacity);
+		}
+		context->updater.set_event_log(&context->event_log);
+	} else {
+		context->updater.set_event_log(NULL);
+	}
+	return context;
+}
+
+static void release_context(react_context_t *context) {
+	if (context->updater.get_trace_depth() != 0 || thread_react_context_cache) {
+		// Updater's destructor reports unfinished actions
+		delete context;
+		return;
+	}
+
+	pthread_once(&react_context_cache_key_once, create_context_cache_key);
+	thread_react_context_cache = context;
+	pthread_setspecific(react_context_cache_key, context);
+}
 
 int react_is_active() {
-	return thread_react_context != NULL;
+	return react_thread_is_active;
+}
+
+/*
+ * Checks whether request of current thread is traced. Unsampled request
+ * is active under flight recorder only to record its actions, its stats are dropped.
+ */
+static bool is_sampled() {
+	return thread_react_context && thread_react_context->sampled;
 }
 
 const size_t ID_LENGTH = 64;
 
-std::string generate_random_id() {
-	char id[ID_LENGTH + 1];
+/*
+ * Writes random id of ID_LENGTH hex digits and trailing zero into \a id
+ */
+static void generate_random_id(char *id) {
+	static const char digits[] = "0123456789abcdef";
 	for(size_t i = 0; i < ID_LENGTH; i++) {
-		sprintf(id + i, "%x", rand() % 16);
+		id[i] = digits[rand() % 16];
 	}
-	return std::string(id);
+	id[ID_LENGTH] = '\0';
 }
 
 int react_activate(void *react_aggregator) {
 	try {
 		if (!thread_react_context_refcount) {
-			thread_react_context = new react_context_t(
-						static_cast<react::aggregator_t*>(react_aggregator)
-			);
-			react::add_stat("complete", false);
-			react::add_stat("id", generate_random_id());
+			react::aggregator_t *aggregator = static_cast<react::aggregator_t*>(react_aggregator);
+			flight_recorder_t *flight_recorder = acquire_flight_recorder();
+			if (!aggregator || aggregator->sample()) {
+				thread_react_context = acquire_context(aggregator, true, flight_recorder);
+				react_thread_is_active = 1;
+				react::add_stat(complete_stat_key(), false);
+				char id[ID_LENGTH + 1];
+				generate_random_id(id);
+				react::add_stat(id_stat_key(), static_cast<const char *>(id));
+			} else if (flight_recorder) {
+				thread_react_context = acquire_context(NULL, false, flight_recorder);
+				react_thread_is_active = 1;
+			}
 		}
 		++thread_react_context_refcount;
 	} catch (std::exception &e) {
@@ -91,13 +371,35 @@ int react_deactivate() {
 			throw std::runtime_error(error_message);
 		}
 
-		if (thread_react_context_refcount == 1) {
-			react::add_stat("complete", true);
+		if (thread_react_context_refcount == 1 && thread_react_context) {
+			if (thread_react_context->sampled) {
+				react::add_stat(complete_stat_key(), true);
+				thread_react_context->updater.apply_event_log();
+				thread_react_context->call_tree.apply_pending_merges();
+			}
 			if (thread_react_context->aggregator) {
-				thread_react_context->aggregator->aggregate(thread_react_context->call_tree.get_call_tree());
+				call_tree_t &call_tree = thread_react_context->call_tree.get_call_tree();
+				if (thread_react_context->updater.get_trace_depth() == 0) {
+					thread_react_context->aggregator->aggregate_owned(std::move(call_tree));
+				} else {
+					// Updater still refers to unfinished actions' nodes to report them
+					thread_react_context->aggregator->aggregate(call_tree);
+				}
+			}
+
+			int64_t latency_threshold = flight_recorder_latency_threshold.load(std::memory_order_relaxed);
+			if (latency_threshold && thread_react_context->start_time) {
+				int64_t latency = tick_clock_t::duration_to_nanoseconds(
+						tick_clock_t::now() - thread_react_context->start_time);
+				if (latency > latency_threshold) {
+					dump_thread_flight_recorder("latency", latency);
+				}
 			}
-			delete thread_react_context;
+			handle_flight_recorder_dump_requests();
+
+			release_context(thread_react_context);
 			thread_react_context = NULL;
+			react_thread_is_active = 0;
 		}
 		--thread_react_context_refcount;
 	} catch (std::exception &e) {
@@ -135,13 +437,20 @@ int react_stop_action(int action_code) {
 	return 0;
 }
 
+/*
+ * Interns key of stat added by name without copying it into std::string
+ */
+static int stat_key(const char *key) {
+	return actions_set().define_stat_key(key);
+}
+
 #define DEFINE_STAT_TYPE(name, type)                     \
 int react_add_stat_##name(const char *key, type value) { \
 	try {                                                \
-		if (!react_is_active()) {                        \
+		if (!is_sampled()) {                             \
 			return 0;                                    \
 		}                                                \
-		react::add_stat(std::string(key), value);        \
+		react::add_stat(stat_key(key), value);           \
 	} catch (std::exception& e) {                        \
 		std::cerr << e.what() << std::endl;              \
 		return -EINVAL;                                  \
@@ -151,17 +460,113 @@ int react_add_stat_##name(const char *key, type value) { \
 
 DEFINE_STAT_TYPE(bool,   bool)
 DEFINE_STAT_TYPE(int,    int)
+DEFINE_STAT_TYPE(int64,  int64_t)
 DEFINE_STAT_TYPE(double, double)
 DEFINE_STAT_TYPE(string, const char *)
 
+#define DEFINE_KEY_STAT_TYPE(name, type)                    \
+int react_add_key_stat_##name(int key, type value) {        \
+	try {                                                   \
+		if (!is_sampled()) {                                \
+			return 0;                                       \
+		}                                                   \
+		react::add_stat(key, value);                        \
+	} catch (std::exception& e) {                           \
+		std::cerr << e.what() << std::endl;                 \
+		return -EINVAL;                                     \
+	}                                                       \
+	return 0;                                               \
+}
+
+DEFINE_KEY_STAT_TYPE(bool,   bool)
+DEFINE_KEY_STAT_TYPE(int,    int)
+DEFINE_KEY_STAT_TYPE(int64,  int64_t)
+DEFINE_KEY_STAT_TYPE(double, double)
+DEFINE_KEY_STAT_TYPE(string, const char *)
+
+#define DEFINE_NODE_STAT_TYPE(name, type)                     \
+int react_add_node_stat_##name(const char *key, type value) { \
+	try {                                                     \
+		if (!is_sampled()) {                                  \
+			return 0;                                         \
+		}                                                     \
+		react::add_node_stat(stat_key(key), value);           \
+	} catch (std::exception& e) {                             \
+		std::cerr << e.what() << std::endl;                   \
+		return -EINVAL;                                       \
+	}                                                         \
+	return 0;                                                 \
+}
+
+DEFINE_NODE_STAT_TYPE(bool,   bool)
+DEFINE_NODE_STAT_TYPE(int,    int)
+DEFINE_NODE_STAT_TYPE(int64,  int64_t)
+DEFINE_NODE_STAT_TYPE(double, double)
+DEFINE_NODE_STAT_TYPE(string, const char *)
+
+#define DEFINE_NODE_KEY_STAT_TYPE(name, type)                    \
+int react_add_node_key_stat_##name(int key, type value) {        \
+	try {                                                        \
+		if (!is_sampled()) {                                     \
+			return 0;                                            \
+		}                                                        \
+		react::add_node_stat(key, value);                        \
+	} catch (std::exception& e) {                                \
+		std::cerr << e.what() << std::endl;                      \
+		return -EINVAL;                                          \
+	}                                                            \
+	return 0;                                                    \
+}
+
+DEFINE_NODE_KEY_STAT_TYPE(bool,   bool)
+DEFINE_NODE_KEY_STAT_TYPE(int,    int)
+DEFINE_NODE_KEY_STAT_TYPE(int64,  int64_t)
+DEFINE_NODE_KEY_STAT_TYPE(double, double)
+DEFINE_NODE_KEY_STAT_TYPE(string, const char *)
+
+int react_add_node_counter(const char *key, int64_t value) {
+	try {
+		if (!is_sampled()) {
+			return 0;
+		}
+		react::add_node_counter(stat_key(key), value);
+	} catch (std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return -EINVAL;
+	}
+	return 0;
+}
+
+int react_add_node_key_counter(int key, int64_t value) {
+	try {
+		if (!is_sampled()) {
+			return 0;
+		}
+		react::add_node_counter(key, value);
+	} catch (std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return -EINVAL;
+	}
+	return 0;
+}
+
 int react_submit_progress() {
 	try {
-		if (!react_is_active()) {
+		if (!is_sampled()) {
 			return 0;
 		}
 
+		thread_react_context->call_tree.apply_pending_merges();
 		if (thread_react_context->aggregator) {
-			thread_react_context->aggregator->aggregate(thread_react_context->call_tree.get_call_tree());
+			const call_tree_t &call_tree = thread_react_context->call_tree.get_call_tree();
+			if (event_log_t *event_log = thread_react_context->updater.get_event_log()) {
+				// Log keeps events of started actions, so it is replayed into a copy
+				call_tree_t call_tree_snapshot(call_tree);
+				event_log->replay(call_tree_snapshot, call_tree_snapshot.root);
+				thread_react_context->aggregator->aggregate(call_tree_snapshot);
+			} else {
+				thread_react_context->aggregator->aggregate(call_tree);
+			}
 		}
 	} catch (std::exception& e) {
 		std::cerr << e.what() << std::endl;
@@ -170,21 +575,81 @@ int react_submit_progress() {
 	return 0;
 }
 
-namespace react {
+int react_set_max_nodes_number(size_t max_nodes_number) {
+	::max_nodes_number.store(max_nodes_number, std::memory_order_relaxed);
+	return 0;
+}
+
+int react_set_event_log_capacity(size_t capacity) {
+	::event_log_capacity.store(capacity, std::memory_order_relaxed);
+	return 0;
+}
+
+int react_set_coalesce_siblings(int coalesce_siblings) {
+	::coalesce_siblings.store(coalesce_siblings != 0, std::memory_order_relaxed);
+	return 0;
+}
+
+int react_set_flight_recorder(size_t capacity, void *react_aggregator) {
+	flight_recorder_aggregator.store(static_cast<react::aggregator_t*>(react_aggregator), std::memory_order_release);
+	flight_recorder_capacity.store(react_aggregator ? capacity : 0, std::memory_order_relaxed);
+	return 0;
+}
+
+int react_set_flight_recorder_latency_threshold(int64_t latency_threshold) {
+	if (latency_threshold < 0) {
+		return -EINVAL;
+	}
 
-action_guard::action_guard(int action_code) {
-	if (react_is_active()) {
-		m_action_guard.reset(
-					new action_guard_t(&thread_react_context->updater, action_code)
-		);
+	flight_recorder_latency_threshold.store(latency_threshold, std::memory_order_relaxed);
+	return 0;
+}
+
+int react_set_flight_recorder_signal(int signal_number) {
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = flight_recorder_signal_handler;
+	sigemptyset(&action.sa_mask);
+	action.sa_flags = SA_RESTART;
+	if (sigaction(signal_number, &action, NULL)) {
+		return -errno;
+	}
+	return 0;
+}
+
+int react_dump_flight_recorder() {
+	try {
+		flight_recorder_dump_requests.fetch_add(1, std::memory_order_relaxed);
+		handle_flight_recorder_dump_requests();
+	} catch (std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return -ENOMEM;
 	}
+	return 0;
 }
 
+namespace react {
+
+int define_new_action(const std::string &action_name) {
+	return actions_set().define_new_action(action_name);
+}
+
+call_tree_updater_t *get_thread_updater() {
+	return react_is_active() ? &thread_react_context->updater : NULL;
+}
+
+call_tree_updater_t *get_sampled_thread_updater() {
+	return is_sampled() ? &thread_react_context->updater : NULL;
+}
+
+action_guard::action_guard(int action_code):
+	m_action_guard(get_thread_updater(), action_code) {}
+
 action_guard::~action_guard() {}
 
 void react::action_guard::stop() {
-	if (m_action_guard) {
-		m_action_guard->stop();
+	if (m_action_guard.has_updater()) {
+		m_action_guard.stop();
 	}
 }
 
@@ -192,46 +657,96 @@ const actions_set_t &get_actions_set() {
 	return actions_set();
 }
 
-void add_stat(const std::string &key, const char *value) {
-	add_stat_impl(key, react::stat_value_t(std::string(value)));
+int define_stat_key(const std::string &key_name) {
+	return actions_set().define_stat_key(key_name);
+}
+
+void add_stat_impl(int key, bool value) {
+	if (is_sampled()) {
+		thread_react_context->call_tree.get_call_tree().add_stat(key, value);
+	}
+}
+
+void add_stat_impl(int key, int64_t value) {
+	if (is_sampled()) {
+		thread_react_context->call_tree.get_call_tree().add_stat(key, value);
+	}
 }
 
-void add_stat_impl(const std::string &key, const react::stat_value_t &value) {
-	if (thread_react_context) {
+void add_stat_impl(int key, double value) {
+	if (is_sampled()) {
 		thread_react_context->call_tree.get_call_tree().add_stat(key, value);
 	}
 }
 
+void add_stat_impl(int key, const char *value, size_t size) {
+	if (is_sampled()) {
+		thread_react_context->call_tree.get_call_tree().add_stat(key, value, size);
+	}
+}
+
 class subthread_aggregator_t : public aggregator_t {
 public:
-	subthread_aggregator_t(): parent_context(thread_react_context) {
+	subthread_aggregator_t(): parent_context(thread_react_context),
+		parent_sampled(parent_context != NULL && parent_context->sampled) {
 		if (parent_context) {
 			parent_node = parent_context->updater.get_current_node();
+			parent_generation = parent_context->call_tree.get_generation();
 		}
 	}
 	~subthread_aggregator_t() {}
 
+	/*!
+	 * \brief Subthreads of unsampled request are not sampled too
+	 */
+	bool sample() {
+		return parent_sampled;
+	}
+
 	void aggregate(const call_tree_t &call_tree) {
 		if (!parent_context)
 			return;
 
-		if (call_tree.get_stat<bool>("complete") == false) {
+		if (call_tree.get_stat<bool>(complete_stat_key()) == false) {
 			parent_context->aggregator->aggregate(call_tree);
 		} else {
-			std::lock_guard<concurrent_call_tree_t> guard(parent_context->call_tree);
-			thread_react_context->call_tree.get_call_tree().merge_into(
-				parent_node, parent_context->call_tree.get_call_tree()
-			);
+			parent_context->call_tree.merge_later(parent_node, call_tree, parent_generation);
+		}
+	}
+
+	/*!
+	 * \brief Completed subthread tree is handed to parent without copying
+	 */
+	void aggregate_owned(call_tree_t &&call_tree) {
+		if (!parent_context)
+			return;
+
+		if (call_tree.get_stat<bool>(complete_stat_key()) == false) {
+			parent_context->aggregator->aggregate_owned(std::move(call_tree));
+		} else {
+			parent_context->call_tree.merge_later(parent_node, std::move(call_tree), parent_generation);
 		}
 	}
 
 private:
 	react_context_t *parent_context;
+
+	/*!
+	 * \brief Whether parent request is sampled, captured at creation since
+	 * parent rewrites its context for the next request
+	 */
+	bool parent_sampled;
+
 	call_tree_t::p_node_t parent_node;
+
+	/*!
+	 * \brief Generation of parent tree, merges into later requests of parent context are dropped
+	 */
+	uint64_t parent_generation;
 };
 
 std::shared_ptr<aggregator_t> create_subthread_aggregator() {
-	if (!react_is_active()) {
+	if (!thread_react_context_refcount) {
 		throw std::runtime_error("Can't create subthread aggregator: React is not active");
 	}
 
@@ -242,7 +757,7 @@ std::shared_ptr<aggregator_t> create_subthread_aggregator() {
 
 void *react_create_subthread_aggregator() {
 	try {
-		if (!react_is_active()) {
+		if (!thread_react_context_refcount) {
 			return NULL;
 		}
 
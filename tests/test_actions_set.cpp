@@ -1,4 +1,6 @@
 #include <stdexcept>
+#include <thread>
+#include <vector>
 
 #include "tests.hpp"
 
@@ -74,7 +76,102 @@ BOOST_AUTO_TEST_CASE( get_action_name_no_action_test )
 	actions_set_t actions_set;
 
 	BOOST_CHECK_THROW( actions_set.get_action_name(actions_set_t::NO_ACTION),
-					   std::invalid_argument )
+					   std::invalid_argument );
+}
+
+BOOST_AUTO_TEST_CASE( define_new_action_many_actions_test )
+{
+	actions_set_t actions_set;
+	const int ACTIONS_NUMBER = 10000;
+
+	for (int i = 0; i < ACTIONS_NUMBER; ++i)
+	{
+		actions_set.define_new_action("ACTION" + std::to_string(static_cast<long long>(i)));
+	}
+
+	for (int i = 0; i < ACTIONS_NUMBER; ++i)
+	{
+		BOOST_CHECK_EQUAL( actions_set.get_action_name(i), "ACTION" + std::to_string(static_cast<long long>(i)) );
+	}
+	BOOST_CHECK( !actions_set.code_is_valid(ACTIONS_NUMBER) );
+}
+
+BOOST_AUTO_TEST_CASE( define_new_action_concurrent_test )
+{
+	actions_set_t actions_set;
+	const int THREADS_NUMBER = 4;
+	const int ACTIONS_NUMBER = 1000;
+
+	std::vector<std::vector<int>> codes(THREADS_NUMBER, std::vector<int>(ACTIONS_NUMBER));
+	std::vector<std::thread> threads;
+	for (int thread = 0; thread < THREADS_NUMBER; ++thread)
+	{
+		threads.emplace_back([&actions_set, &codes, thread] () {
+			for (int i = 0; i < ACTIONS_NUMBER; ++i) {
+				codes[thread][i] = actions_set.define_new_action("ACTION" + std::to_string(static_cast<long long>(i)));
+				actions_set.get_action_name(codes[thread][i]);
+			}
+		});
+	}
+	for (auto it = threads.begin(); it != threads.end(); ++it)
+	{
+		it->join();
+	}
+
+	for (int i = 0; i < ACTIONS_NUMBER; ++i)
+	{
+		for (int thread = 1; thread < THREADS_NUMBER; ++thread)
+		{
+			BOOST_CHECK_EQUAL( codes[thread][i], codes[0][i] );
+		}
+		BOOST_CHECK_EQUAL( actions_set.get_action_name(codes[0][i]), "ACTION" + std::to_string(static_cast<long long>(i)) );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( define_stat_key_concurrent_test )
+{
+	actions_set_t actions_set;
+	const int THREADS_NUMBER = 4;
+	const int KEYS_NUMBER = 1000;
+
+	BOOST_CHECK_EQUAL( actions_set.find_stat_key("key0"), +actions_set_t::NO_STAT_KEY );
+	int first_key = actions_set.define_stat_key("key0");
+	BOOST_CHECK_EQUAL( actions_set.define_stat_key(std::string("key0")), first_key );
+
+	// Lookups of defined keys run concurrently with growth of the table
+	std::vector<std::vector<int>> codes(THREADS_NUMBER, std::vector<int>(KEYS_NUMBER));
+	std::vector<int> lookup_failures(THREADS_NUMBER, 0);
+	std::vector<std::thread> threads;
+	for (int thread = 0; thread < THREADS_NUMBER; ++thread)
+	{
+		threads.emplace_back([&actions_set, &codes, &lookup_failures, first_key, thread] () {
+			for (int i = 0; i < KEYS_NUMBER; ++i) {
+				std::string name = "key" + std::to_string(static_cast<long long>(i));
+				codes[thread][i] = actions_set.define_stat_key(name);
+				lookup_failures[thread] += actions_set.find_stat_key(name) != codes[thread][i];
+				lookup_failures[thread] += actions_set.find_stat_key("key0") != first_key;
+			}
+		});
+	}
+	for (auto it = threads.begin(); it != threads.end(); ++it)
+	{
+		it->join();
+	}
+
+	for (int thread = 0; thread < THREADS_NUMBER; ++thread)
+	{
+		BOOST_CHECK_EQUAL( lookup_failures[thread], 0 );
+	}
+	for (int i = 0; i < KEYS_NUMBER; ++i)
+	{
+		for (int thread = 1; thread < THREADS_NUMBER; ++thread)
+		{
+			BOOST_CHECK_EQUAL( codes[thread][i], codes[0][i] );
+		}
+		BOOST_CHECK_EQUAL( actions_set.get_stat_key_name(codes[0][i]), "key" + std::to_string(static_cast<long long>(i)) );
+	}
+	BOOST_CHECK( !actions_set.stat_key_is_valid(KEYS_NUMBER) );
+	BOOST_CHECK_EQUAL( actions_set.find_stat_key("key"), +actions_set_t::NO_STAT_KEY );
 }
 
 BOOST_AUTO_TEST_SUITE_END()
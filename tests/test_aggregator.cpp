@@ -0,0 +1,640 @@
+#include <sstream>
+#include <thread>
+
+#include "tests.hpp"
+
+#include "react/aggregator.hpp"
+#include "react/async_aggregator.hpp"
+#include "react/profile_aggregator.hpp"
+#include "react/histogram_aggregator.hpp"
+#include "react/sampling.hpp"
+#include "react/updater.hpp"
+
+BOOST_AUTO_TEST_SUITE( aggregator_suite )
+
+using namespace react;
+
+/*!
+ * Counts aggregated trees, blocks in aggregate while gate is closed
+ */
+class gated_aggregator_t : public aggregator_t {
+public:
+	gated_aggregator_t(): is_open(true), is_waiting(false), trees_number(0), owned_trees_number(0) {}
+
+	void aggregate(const call_tree_t &) {
+		wait_for_gate();
+		++trees_number;
+	}
+
+	void aggregate_owned(call_tree_t &&call_tree) {
+		wait_for_gate();
+		call_tree_t owned_call_tree(std::move(call_tree));
+		++trees_number;
+		++owned_trees_number;
+	}
+
+	void close() {
+		std::lock_guard<std::mutex> guard(mutex);
+		is_open = false;
+	}
+
+	void open() {
+		{
+			std::lock_guard<std::mutex> guard(mutex);
+			is_open = true;
+		}
+		condition.notify_all();
+	}
+
+	void wait_for_waiter() {
+		std::unique_lock<std::mutex> lock(mutex);
+		condition.wait(lock, [this] () { return is_waiting; });
+	}
+
+	bool is_open;
+	bool is_waiting;
+	size_t trees_number;
+	size_t owned_trees_number;
+
+private:
+	void wait_for_gate() {
+		std::unique_lock<std::mutex> lock(mutex);
+		is_waiting = true;
+		condition.notify_all();
+		condition.wait(lock, [this] () { return is_open; });
+		is_waiting = false;
+	}
+
+	std::mutex mutex;
+	std::condition_variable condition;
+};
+
+BOOST_AUTO_TEST_CASE( stream_aggregator_test )
+{
+	actions_set_t actions_set;
+	int action_code = actions_set.define_new_action("ACTION");
+	call_tree_t call_tree(actions_set);
+	call_tree.add_new_link(call_tree.root, action_code);
+
+	std::ostringstream output;
+	stream_aggregator_t aggregator(output);
+	aggregator.aggregate(call_tree);
+	aggregator.aggregate(call_tree);
+
+	rapidjson::StringBuffer buffer;
+	rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+	call_tree.write_json(writer);
+	std::string expected_line = buffer.GetString();
+
+	std::istringstream input(output.str());
+	std::string line;
+	size_t lines_number = 0;
+	while (std::getline(input, line)) {
+		BOOST_CHECK_EQUAL( line, expected_line );
+		++lines_number;
+	}
+	BOOST_CHECK_EQUAL( lines_number, 2 );
+	BOOST_CHECK( expected_line.find("\"name\":\"ACTION\"") != std::string::npos );
+}
+
+BOOST_AUTO_TEST_CASE( async_aggregator_test )
+{
+	actions_set_t actions_set;
+	int action_code = actions_set.define_new_action("ACTION");
+
+	gated_aggregator_t target;
+	async_aggregator_t aggregator(target);
+
+	for (int i = 0; i < 10; ++i) {
+		call_tree_t call_tree(actions_set);
+		call_tree.add_new_link(call_tree.root, action_code);
+		if (i % 2) {
+			aggregator.aggregate(call_tree);
+			BOOST_CHECK_EQUAL( call_tree.get_nodes_number(), 2 );
+		} else {
+			aggregator.aggregate_owned(std::move(call_tree));
+			BOOST_CHECK_EQUAL( call_tree.get_nodes_number(), 0 );
+		}
+	}
+
+	aggregator.flush();
+	BOOST_CHECK_EQUAL( target.trees_number, 10 );
+	BOOST_CHECK_EQUAL( target.owned_trees_number, 10 );
+	BOOST_CHECK_EQUAL( aggregator.get_aggregated_trees_number(), 10 );
+	BOOST_CHECK_EQUAL( aggregator.get_dropped_trees_number(), 0 );
+}
+
+BOOST_AUTO_TEST_CASE( async_aggregator_drop_newest_test )
+{
+	actions_set_t actions_set;
+	call_tree_t call_tree(actions_set);
+
+	gated_aggregator_t target;
+	target.close();
+	async_aggregator_t aggregator(target, 1, async_aggregator_t::DROP_NEWEST);
+
+	aggregator.aggregate(call_tree);
+	target.wait_for_waiter();
+
+	aggregator.aggregate(call_tree); // Queued
+	aggregator.aggregate(call_tree); // Dropped
+	BOOST_CHECK_EQUAL( aggregator.get_dropped_trees_number(), 1 );
+
+	target.open();
+	aggregator.flush();
+	BOOST_CHECK_EQUAL( target.trees_number, 2 );
+	BOOST_CHECK_EQUAL( aggregator.get_aggregated_trees_number(), 2 );
+}
+
+BOOST_AUTO_TEST_CASE( async_aggregator_sample_test )
+{
+	gated_aggregator_t target;
+	rate_sampling_aggregator_t never(target, 0.);
+	async_aggregator_t never_aggregator(never);
+	BOOST_CHECK( !never_aggregator.sample() );
+
+	async_aggregator_t always_aggregator(target);
+	BOOST_CHECK( always_aggregator.sample() );
+}
+
+BOOST_AUTO_TEST_CASE( async_aggregator_destructor_drains_queue_test )
+{
+	actions_set_t actions_set;
+	call_tree_t call_tree(actions_set);
+
+	gated_aggregator_t target;
+	{
+		async_aggregator_t aggregator(target, 100, async_aggregator_t::BLOCK);
+		for (int i = 0; i < 100; ++i) {
+			aggregator.aggregate(call_tree);
+		}
+	}
+	BOOST_CHECK_EQUAL( target.trees_number, 100 );
+}
+
+BOOST_AUTO_TEST_CASE( profile_aggregator_test )
+{
+	actions_set_t actions_set;
+	int read_code = actions_set.define_new_action("READ");
+	int disk_code = actions_set.define_new_action("DISK");
+
+	profile_aggregator_t aggregator;
+	for (int i = 1; i <= 3; ++i) {
+		call_tree_t call_tree(actions_set);
+		call_tree_t::p_node_t read_node = call_tree.add_new_link(call_tree.root, read_code);
+		call_tree.set_node_start_time(read_node, 1000);
+		call_tree.set_node_stop_time(read_node, 1000 + 100 * i);
+		call_tree_t::p_node_t disk_node = call_tree.add_new_link(read_node, disk_code);
+		call_tree.set_node_start_time(disk_node, 1010);
+		call_tree.set_node_stop_time(disk_node, 1020);
+		call_tree_t::p_node_t unfinished_node = call_tree.add_new_link(read_node, disk_code);
+		call_tree.set_node_start_time(unfinished_node, 1030);
+		aggregator.aggregate(call_tree);
+	}
+
+	std::vector<profile_aggregator_t::profile_node_t> nodes = aggregator.get_nodes();
+	BOOST_REQUIRE_EQUAL( nodes.size(), 3 );
+	BOOST_CHECK_EQUAL( nodes[profile_aggregator_t::root].calls, 3 );
+
+	const profile_aggregator_t::profile_node_t &read = nodes[nodes[profile_aggregator_t::root].first_child];
+	BOOST_CHECK_EQUAL( read.action_code, read_code );
+	BOOST_CHECK_EQUAL( read.calls, 3 );
+	BOOST_CHECK_EQUAL( read.total_time, tick_clock_t::duration_to_nanoseconds(100) + tick_clock_t::duration_to_nanoseconds(200) +
+			tick_clock_t::duration_to_nanoseconds(300) );
+	BOOST_CHECK_EQUAL( read.min_time, tick_clock_t::duration_to_nanoseconds(100) );
+	BOOST_CHECK_EQUAL( read.max_time, tick_clock_t::duration_to_nanoseconds(300) );
+	BOOST_CHECK_EQUAL( read.self_time, read.total_time - 3 * tick_clock_t::duration_to_nanoseconds(10) );
+
+	const profile_aggregator_t::profile_node_t &disk = nodes[read.first_child];
+	BOOST_CHECK_EQUAL( disk.action_code, disk_code );
+	BOOST_CHECK_EQUAL( disk.calls, 3 );
+	BOOST_CHECK_EQUAL( disk.self_time, disk.total_time );
+	BOOST_CHECK_EQUAL( disk.next_sibling, +call_tree_t::NO_NODE );
+	BOOST_CHECK_EQUAL( aggregator.get_action_name(disk_code), "DISK" );
+
+	rapidjson::StringBuffer buffer;
+	rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+	aggregator.write_json(writer);
+	std::string json = buffer.GetString();
+	BOOST_CHECK_EQUAL( json.find("{\"trees\":3,"), 0 );
+	BOOST_CHECK( json.find("\"actions\":[{\"name\":\"READ\",\"calls\":3,") != std::string::npos );
+	BOOST_CHECK( json.find("\"actions\":[{\"name\":\"DISK\",\"calls\":3,") != std::string::npos );
+
+	aggregator.reset();
+	BOOST_CHECK_EQUAL( aggregator.get_nodes().size(), 1 );
+}
+
+BOOST_AUTO_TEST_CASE( profile_aggregator_counters_test )
+{
+	actions_set_t actions_set;
+	int read_code = actions_set.define_new_action("READ");
+	int bytes_key = actions_set.define_stat_key("bytes");
+	int items_key = actions_set.define_stat_key("items");
+
+	profile_aggregator_t aggregator;
+	for (int i = 1; i <= 2; ++i) {
+		call_tree_t call_tree(actions_set);
+		call_tree_t::p_node_t read_node = call_tree.add_new_link(call_tree.root, read_code);
+		call_tree.set_node_start_time(read_node, 1000);
+		call_tree.set_node_stop_time(read_node, 1000 + 100 * i);
+		call_tree.add_node_counter(read_node, bytes_key, 4096);
+		call_tree.add_node_counter(read_node, bytes_key, 4096);
+		call_tree.add_node_stat(read_node, "status", 200);
+		if (i == 2) {
+			call_tree.add_node_counter(read_node, items_key, 3);
+		}
+		aggregator.aggregate(call_tree);
+	}
+
+	std::vector<profile_aggregator_t::profile_node_t> nodes = aggregator.get_nodes();
+	const profile_aggregator_t::profile_node_t &read = nodes[nodes[profile_aggregator_t::root].first_child];
+	BOOST_REQUIRE_EQUAL( read.counters.size(), 2 );
+	BOOST_CHECK_EQUAL( read.counters[0].first, bytes_key );
+	BOOST_CHECK_EQUAL( read.counters[0].second, 4 * 4096 );
+	BOOST_CHECK_EQUAL( read.counters[1].first, items_key );
+	BOOST_CHECK_EQUAL( read.counters[1].second, 3 );
+	BOOST_CHECK_CLOSE( read.get_throughput(read.counters[0].second), 4 * 4096 * 1e9 / read.total_time, 1e-9 );
+	BOOST_CHECK_EQUAL( aggregator.get_counter_name(items_key), "items" );
+
+	rapidjson::StringBuffer buffer;
+	rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+	aggregator.write_json(writer);
+	std::string json = buffer.GetString();
+	BOOST_CHECK( json.find("\"counters\":{\"bytes\":{\"total\":16384,\"per_second\":") != std::string::npos );
+	BOOST_CHECK( json.find("\"items\":{\"total\":3,") != std::string::npos );
+	BOOST_CHECK( json.find("status") == std::string::npos );
+}
+
+BOOST_AUTO_TEST_CASE( profile_aggregator_unfinished_actions_test )
+{
+	actions_set_t actions_set;
+	int action_code = actions_set.define_new_action("ACTION");
+	int inner_action_code = actions_set.define_new_action("INNER_ACTION");
+	concurrent_call_tree_t call_tree(actions_set);
+	call_tree_updater_t updater(call_tree);
+
+	// Progress is submitted while ACTION is running
+	profile_aggregator_t aggregator;
+	updater.start(action_code);
+	updater.start(inner_action_code);
+	updater.stop(inner_action_code);
+	updater.start(inner_action_code);
+	BOOST_CHECK( !call_tree.get_call_tree().node_is_finished(1) );
+	BOOST_CHECK( call_tree.get_call_tree().node_is_finished(2) );
+	aggregator.aggregate(call_tree.get_call_tree());
+	updater.stop(inner_action_code);
+	updater.stop(action_code);
+
+	std::vector<profile_aggregator_t::profile_node_t> nodes = aggregator.get_nodes();
+	BOOST_CHECK_EQUAL( nodes.size(), 1 );
+	BOOST_CHECK_EQUAL( nodes[profile_aggregator_t::root].calls, 1 );
+	BOOST_CHECK_EQUAL( nodes[profile_aggregator_t::root].total_time, 0 );
+
+	aggregator.aggregate(call_tree.get_call_tree());
+	nodes = aggregator.get_nodes();
+	BOOST_REQUIRE_EQUAL( nodes.size(), 3 );
+	const profile_aggregator_t::profile_node_t &action = nodes[nodes[profile_aggregator_t::root].first_child];
+	BOOST_CHECK_EQUAL( action.calls, 1 );
+	BOOST_CHECK_GE( action.self_time, 0 );
+}
+
+BOOST_AUTO_TEST_CASE( profile_aggregator_empty_summary_test )
+{
+	actions_set_t actions_set;
+	int action_code = actions_set.define_new_action("ACTION");
+	int inner_action_code = actions_set.define_new_action("INNER_ACTION");
+
+	// Collapsed node without calls and its subtree are not added to profile
+	call_tree_t call_tree(actions_set);
+	call_tree_t::p_node_t node = call_tree.add_collapsed_link(call_tree.root, action_code);
+	call_tree.add_new_link(node, inner_action_code);
+	BOOST_REQUIRE( call_tree.node_is_finished(node) );
+	BOOST_REQUIRE_EQUAL( call_tree.get_node_summary(node)->calls, 0 );
+
+	profile_aggregator_t aggregator;
+	aggregator.aggregate(call_tree);
+	std::vector<profile_aggregator_t::profile_node_t> nodes = aggregator.get_nodes();
+	BOOST_CHECK_EQUAL( nodes.size(), 1 );
+	BOOST_CHECK_EQUAL( nodes[profile_aggregator_t::root].first_child, +call_tree_t::NO_NODE );
+}
+
+BOOST_AUTO_TEST_CASE( latency_histogram_test )
+{
+	for (int64_t value = 0; value < 100000; value += 7) {
+		size_t index = latency_histogram_t::bucket_index(value);
+		BOOST_REQUIRE_LE( value, latency_histogram_t::bucket_upper_bound(index) );
+		BOOST_REQUIRE_LE( latency_histogram_t::bucket_upper_bound(index), value + value / 16 );
+		if (index > 0) {
+			BOOST_REQUIRE_LT( latency_histogram_t::bucket_upper_bound(index - 1), value );
+		}
+	}
+	BOOST_CHECK_EQUAL( latency_histogram_t::bucket_index(-1), 0 );
+	BOOST_CHECK_EQUAL( latency_histogram_t::bucket_index(int64_t(1) << 50), latency_histogram_t::BUCKETS_NUMBER - 1 );
+
+	latency_histogram_t histogram;
+	BOOST_CHECK_EQUAL( histogram.get_quantile(0.5), 0 );
+	for (int value = 1; value <= 10; ++value) {
+		histogram.record(value);
+	}
+	histogram.record(1000);
+
+	latency_histogram_t other_histogram;
+	other_histogram.record(5, 9);
+	histogram.merge(other_histogram);
+
+	BOOST_CHECK_EQUAL( histogram.get_count(), 20 );
+	BOOST_CHECK_EQUAL( histogram.get_quantile(0.5), 5 );
+	BOOST_CHECK_EQUAL( histogram.get_quantile(0.9), 9 );
+	BOOST_CHECK_EQUAL( histogram.get_quantile(1.),
+			latency_histogram_t::bucket_upper_bound(latency_histogram_t::bucket_index(1000)) );
+}
+
+BOOST_AUTO_TEST_CASE( histogram_aggregator_test )
+{
+	actions_set_t actions_set;
+	int action_code = actions_set.define_new_action("ACTION");
+	int another_action_code = actions_set.define_new_action("ANOTHER_ACTION");
+
+	call_tree_t call_tree(actions_set);
+	call_tree_t::p_node_t node = call_tree.add_new_link(call_tree.root, action_code);
+	call_tree.set_node_start_time(node, 100);
+	call_tree.set_node_stop_time(node, 110);
+	call_tree_t::p_node_t unfinished_node = call_tree.add_new_link(node, another_action_code);
+	call_tree.set_node_start_time(unfinished_node, 105);
+
+	histogram_aggregator_t aggregator;
+	const int THREADS_NUMBER = 4;
+	const int TREES_NUMBER = 1000;
+	std::vector<std::thread> threads;
+	for (int i = 0; i < THREADS_NUMBER; ++i) {
+		threads.push_back(std::thread([&] () {
+			for (int j = 0; j < TREES_NUMBER; ++j) {
+				aggregator.aggregate(call_tree);
+			}
+		}));
+	}
+	for (size_t i = 0; i < threads.size(); ++i) {
+		threads[i].join();
+	}
+
+	latency_histogram_t histogram = aggregator.get_histogram(action_code);
+	BOOST_CHECK_EQUAL( histogram.get_count(), THREADS_NUMBER * TREES_NUMBER );
+	BOOST_CHECK_EQUAL( aggregator.get_quantile(action_code, 0.99),
+			latency_histogram_t::bucket_upper_bound(latency_histogram_t::bucket_index(
+				tick_clock_t::duration_to_nanoseconds(10))) );
+	BOOST_CHECK_EQUAL( aggregator.get_histogram(another_action_code).get_count(), 0 );
+
+	rapidjson::StringBuffer buffer;
+	rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+	aggregator.write_json(writer, true);
+	std::string json = buffer.GetString();
+	BOOST_CHECK_EQUAL( json.find("{\"ACTION\":{\"calls\":4000,\"50%\":"), 0 );
+	BOOST_CHECK( json.find("ANOTHER_ACTION") == std::string::npos );
+
+	BOOST_CHECK_EQUAL( aggregator.get_histogram(action_code).get_count(), 0 );
+}
+
+BOOST_AUTO_TEST_CASE( histogram_aggregator_unfinished_actions_test )
+{
+	actions_set_t actions_set;
+	int action_code = actions_set.define_new_action("ACTION");
+	int inner_action_code = actions_set.define_new_action("INNER_ACTION");
+	concurrent_call_tree_t call_tree(actions_set);
+	call_tree_updater_t updater(call_tree);
+
+	// Progress is submitted while ACTION is running
+	histogram_aggregator_t aggregator;
+	updater.start(action_code);
+	updater.start(inner_action_code);
+	updater.stop(inner_action_code);
+	aggregator.aggregate(call_tree.get_call_tree());
+	updater.stop(action_code);
+
+	BOOST_CHECK_EQUAL( aggregator.get_histogram(action_code).get_count(), 0 );
+	BOOST_CHECK_EQUAL( aggregator.get_histogram(inner_action_code).get_count(), 1 );
+
+	aggregator.aggregate(call_tree.get_call_tree());
+	BOOST_CHECK_EQUAL( aggregator.get_histogram(action_code).get_count(), 1 );
+}
+
+BOOST_AUTO_TEST_CASE( histogram_aggregator_throughput_test )
+{
+	actions_set_t actions_set;
+	int action_code = actions_set.define_new_action("ACTION");
+	int another_action_code = actions_set.define_new_action("ANOTHER_ACTION");
+	int key = actions_set.define_stat_key("bytes");
+
+	call_tree_t call_tree(actions_set);
+	call_tree_t::p_node_t node = call_tree.add_new_link(call_tree.root, action_code);
+	call_tree.set_node_start_time(node, 0);
+	call_tree.set_node_stop_time(node, 1000);
+	call_tree.add_node_counter(node, key, 1000000);
+	call_tree_t::p_node_t another_node = call_tree.add_new_link(call_tree.root, another_action_code);
+	call_tree.set_node_start_time(another_node, 0);
+	call_tree.set_node_stop_time(another_node, 1000);
+
+	histogram_aggregator_t aggregator;
+	aggregator.aggregate(call_tree);
+	aggregator.aggregate(call_tree);
+
+	int64_t throughput = static_cast<int64_t>(1000000 * 1e9 / tick_clock_t::duration_to_nanoseconds(1000));
+	latency_histogram_t histogram = aggregator.get_throughput_histogram(action_code, key);
+	BOOST_CHECK_EQUAL( histogram.get_count(), 2 );
+	BOOST_CHECK_EQUAL( histogram.get_quantile(0.5),
+			latency_histogram_t::bucket_upper_bound(latency_histogram_t::bucket_index(throughput)) );
+	BOOST_CHECK_EQUAL( aggregator.get_throughput_histogram(another_action_code, key).get_count(), 0 );
+
+	rapidjson::StringBuffer buffer;
+	rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+	aggregator.write_json(writer, true);
+	std::string json = buffer.GetString();
+	BOOST_CHECK( json.find("\"throughput\":{\"bytes\":{\"calls\":2,\"50%\":") != std::string::npos );
+	BOOST_CHECK_EQUAL( json.find("throughput"), json.rfind("throughput") );
+	BOOST_CHECK_EQUAL( aggregator.get_throughput_histogram(action_code, key).get_count(), 0 );
+}
+
+BOOST_AUTO_TEST_CASE( thread_shards_test )
+{
+	thread_shards_t<int> shards;
+	shards.local() = 1;
+	BOOST_CHECK_EQUAL( &shards.local(), &shards.local() );
+
+	std::thread thread([&] () {
+		shards.local() = 2;
+	});
+	thread.join();
+
+	int sum = 0;
+	size_t shards_number = 0;
+	shards.for_each([&] (int &shard) {
+		sum += shard;
+		++shards_number;
+	});
+	BOOST_CHECK_EQUAL( shards_number, 2 );
+	BOOST_CHECK_EQUAL( sum, 3 );
+
+	// Only shard of exited thread is reclaimed
+	int reclaimed_sum = 0;
+	shards.reclaim_retired([&] (int &shard) {
+		reclaimed_sum += shard;
+	});
+	BOOST_CHECK_EQUAL( reclaimed_sum, 2 );
+	shards_number = 0;
+	shards.for_each([&] (int &shard) {
+		BOOST_CHECK_EQUAL( shard, 1 );
+		++shards_number;
+	});
+	BOOST_CHECK_EQUAL( shards_number, 1 );
+	BOOST_CHECK_EQUAL( &shards.local(), &shards.local() );
+}
+
+BOOST_AUTO_TEST_CASE( aggregators_reclaim_exited_threads_test )
+{
+	actions_set_t actions_set;
+	int action_code = actions_set.define_new_action("ACTION");
+
+	call_tree_t call_tree(actions_set);
+	call_tree_t::p_node_t node = call_tree.add_new_link(call_tree.root, action_code);
+	call_tree.set_node_start_time(node, 0);
+	call_tree.set_node_stop_time(node, 1000);
+
+	profile_aggregator_t profile_aggregator;
+	histogram_aggregator_t histogram_aggregator;
+	for (int i = 0; i < 3; ++i) {
+		std::thread thread([&] () {
+			profile_aggregator.aggregate(call_tree);
+			histogram_aggregator.aggregate(call_tree);
+		});
+		thread.join();
+	}
+
+	// Values of exited threads are kept after their shards are freed
+	std::vector<profile_aggregator_t::profile_node_t> nodes = profile_aggregator.get_nodes();
+	BOOST_REQUIRE_EQUAL( nodes.size(), 2 );
+	BOOST_CHECK_EQUAL( nodes[profile_aggregator_t::root].calls, 3 );
+	BOOST_CHECK_EQUAL( profile_aggregator.get_nodes()[profile_aggregator_t::root].calls, 3 );
+	BOOST_CHECK_EQUAL( histogram_aggregator.get_histogram(action_code).get_count(), 3 );
+	BOOST_CHECK_EQUAL( histogram_aggregator.get_histograms(true)[action_code].get_count(), 3 );
+	BOOST_CHECK_EQUAL( histogram_aggregator.get_histogram(action_code).get_count(), 0 );
+}
+
+BOOST_AUTO_TEST_CASE( sharded_profile_aggregator_test )
+{
+	actions_set_t actions_set;
+	int action_code = actions_set.define_new_action("ACTION");
+	int another_action_code = actions_set.define_new_action("ANOTHER_ACTION");
+
+	call_tree_t call_tree(actions_set);
+	call_tree_t::p_node_t node = call_tree.add_new_link(call_tree.root, action_code);
+	call_tree.add_new_link(node, another_action_code);
+
+	profile_aggregator_t aggregator;
+	const int THREADS_NUMBER = 4;
+	const int TREES_NUMBER = 1000;
+	{
+		periodic_collector_t collector(std::bind(&profile_aggregator_t::collect, &aggregator),
+				std::chrono::milliseconds(1));
+
+		std::vector<std::thread> threads;
+		for (int i = 0; i < THREADS_NUMBER; ++i) {
+			threads.push_back(std::thread([&] () {
+				for (int j = 0; j < TREES_NUMBER; ++j) {
+					aggregator.aggregate(call_tree);
+				}
+			}));
+		}
+		for (size_t i = 0; i < threads.size(); ++i) {
+			threads[i].join();
+		}
+	}
+
+	std::vector<profile_aggregator_t::profile_node_t> nodes = aggregator.get_nodes();
+	BOOST_REQUIRE_EQUAL( nodes.size(), 3 );
+	BOOST_CHECK_EQUAL( nodes[profile_aggregator_t::root].calls, THREADS_NUMBER * TREES_NUMBER );
+	const profile_aggregator_t::profile_node_t &action = nodes[nodes[profile_aggregator_t::root].first_child];
+	BOOST_CHECK_EQUAL( action.calls, THREADS_NUMBER * TREES_NUMBER );
+	BOOST_CHECK_EQUAL( nodes[action.first_child].calls, THREADS_NUMBER * TREES_NUMBER );
+	BOOST_CHECK_EQUAL( nodes[action.first_child].next_sibling, +call_tree_t::NO_NODE );
+}
+
+BOOST_AUTO_TEST_CASE( rate_sampling_aggregator_test )
+{
+	gated_aggregator_t target;
+	rate_sampling_aggregator_t never(target, 0.);
+	rate_sampling_aggregator_t always(target, 1.);
+	rate_sampling_aggregator_t half(target, 0.5);
+
+	size_t sampled_number = 0;
+	for (int i = 0; i < 10000; ++i) {
+		BOOST_REQUIRE( !never.sample() );
+		BOOST_REQUIRE( always.sample() );
+		sampled_number += half.sample();
+	}
+	BOOST_CHECK_GT( sampled_number, 4000 );
+	BOOST_CHECK_LT( sampled_number, 6000 );
+}
+
+BOOST_AUTO_TEST_CASE( tail_sampling_aggregator_test )
+{
+	actions_set_t actions_set;
+	int action_code = actions_set.define_new_action("ACTION");
+
+	call_tree_t fast_call_tree(actions_set);
+	call_tree_t::p_node_t node = fast_call_tree.add_new_link(fast_call_tree.root, action_code);
+	fast_call_tree.set_node_start_time(node, 0);
+	fast_call_tree.set_node_stop_time(node, 10);
+
+	call_tree_t slow_call_tree(actions_set);
+	node = slow_call_tree.add_new_link(slow_call_tree.root, action_code);
+	slow_call_tree.set_node_start_time(node, 0);
+	slow_call_tree.set_node_stop_time(node, 10);
+	node = slow_call_tree.add_new_link(slow_call_tree.root, action_code);
+	slow_call_tree.set_node_start_time(node, 10);
+	slow_call_tree.set_node_stop_time(node, 1000000);
+	slow_call_tree.add_stat("error", true);
+
+	BOOST_CHECK_EQUAL( tail_sampling_aggregator_t::get_tree_duration(slow_call_tree),
+			tick_clock_t::duration_to_nanoseconds(1000000) );
+
+	gated_aggregator_t target;
+	tail_sampling_aggregator_t aggregator(target, tick_clock_t::duration_to_nanoseconds(100));
+	aggregator.aggregate(fast_call_tree);
+	aggregator.aggregate(slow_call_tree);
+	aggregator.aggregate_owned(call_tree_t(slow_call_tree));
+	BOOST_CHECK_EQUAL( target.trees_number, 2 );
+	BOOST_CHECK_EQUAL( target.owned_trees_number, 1 );
+	BOOST_CHECK_EQUAL( aggregator.get_kept_trees_number(), 2 );
+	BOOST_CHECK_EQUAL( aggregator.get_dropped_trees_number(), 1 );
+
+	gated_aggregator_t stat_target;
+	tail_sampling_aggregator_t stat_aggregator(stat_target, tail_sampling_aggregator_t::has_stat("error"));
+	stat_aggregator.aggregate(fast_call_tree);
+	stat_aggregator.aggregate(slow_call_tree);
+	BOOST_CHECK_EQUAL( stat_target.trees_number, 1 );
+}
+
+BOOST_AUTO_TEST_CASE( reservoir_aggregator_test )
+{
+	actions_set_t actions_set;
+	call_tree_t call_tree(actions_set);
+
+	reservoir_aggregator_t aggregator(10);
+	for (int i = 0; i < 5; ++i) {
+		aggregator.aggregate(call_tree);
+	}
+	BOOST_CHECK_EQUAL( aggregator.get_trees_number(), 5 );
+
+	for (int i = 0; i < 1000; ++i) {
+		aggregator.aggregate_owned(call_tree_t(call_tree));
+	}
+	BOOST_CHECK_EQUAL( aggregator.get_trees_number(), 10 );
+	BOOST_CHECK_EQUAL( aggregator.get_seen_trees_number(), 1005 );
+
+	gated_aggregator_t target;
+	aggregator.flush(target);
+	BOOST_CHECK_EQUAL( target.owned_trees_number, 10 );
+	BOOST_CHECK_EQUAL( aggregator.get_trees_number(), 0 );
+	BOOST_CHECK_EQUAL( aggregator.get_seen_trees_number(), 0 );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,177 @@
+#include <sstream>
+
+#include "tests.hpp"
+
+#include "react/binary.hpp"
+#include "react/updater.hpp"
+
+BOOST_AUTO_TEST_SUITE( binary_suite )
+
+using namespace react;
+
+static std::string to_json(const call_tree_t &call_tree) {
+	rapidjson::StringBuffer buffer;
+	rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+	call_tree.write_json(writer);
+	return buffer.GetString();
+}
+
+BOOST_AUTO_TEST_CASE( binary_round_trip_test )
+{
+	actions_set_t actions_set;
+	int action_code = actions_set.define_new_action("ACTION");
+	int another_action_code = actions_set.define_new_action("ANOTHER_ACTION");
+	actions_set.define_new_action("UNUSED_ACTION");
+
+	call_tree_t call_tree(actions_set);
+	call_tree.add_stat("bool", true);
+	call_tree.add_stat("int", -42);
+	call_tree.add_stat("double", 0.5);
+	call_tree.add_stat("string", "value");
+
+	call_tree_t::p_node_t node = call_tree.add_new_link(call_tree.root, action_code);
+	call_tree.set_node_start_time(node, 100);
+	call_tree.set_node_stop_time(node, 200);
+	call_tree_t::p_node_t inner_node = call_tree.add_new_link(node, another_action_code);
+	call_tree.set_node_start_time(inner_node, 110);
+	call_tree.set_node_stop_time(inner_node, 150);
+	call_tree.add_new_link(inner_node, action_code);
+	call_tree.add_new_link(call_tree.root, another_action_code);
+
+	call_tree_t empty_call_tree(actions_set);
+
+	std::stringstream stream;
+	binary_writer_t binary_writer(stream);
+	binary_writer.write(call_tree);
+	binary_writer.write(empty_call_tree);
+	binary_writer.write(call_tree);
+
+	// Stats keys are written once per stream like actions names
+	const std::string data = stream.str();
+	BOOST_CHECK_EQUAL( data.find("double"), data.rfind("double") );
+	BOOST_CHECK_EQUAL( data.find("ANOTHER_ACTION"), data.rfind("ANOTHER_ACTION") );
+
+	binary_reader_t binary_reader(stream);
+	rapidjson::StringBuffer buffer;
+	rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+
+	BOOST_REQUIRE( binary_reader.read_tree(writer) );
+	BOOST_CHECK_EQUAL( std::string(buffer.GetString()), to_json(call_tree) );
+
+	buffer.Clear();
+	BOOST_REQUIRE( binary_reader.read_tree(writer) );
+	BOOST_CHECK_EQUAL( std::string(buffer.GetString()), "{}" );
+
+	buffer.Clear();
+	BOOST_REQUIRE( binary_reader.read_tree(writer) );
+	BOOST_CHECK_EQUAL( std::string(buffer.GetString()), to_json(call_tree) );
+
+	BOOST_CHECK( !binary_reader.read_tree(writer) );
+}
+
+BOOST_AUTO_TEST_CASE( binary_collapsed_round_trip_test )
+{
+	actions_set_t actions_set;
+	int action_code = actions_set.define_new_action("ACTION");
+	concurrent_call_tree_t call_tree(actions_set);
+	call_tree_updater_t updater(call_tree);
+	updater.set_max_nodes_number(2);
+	for (int i = 0; i < 5; ++i) {
+		updater.start(action_code);
+		updater.stop(action_code);
+	}
+
+	std::string json = to_json(call_tree.get_call_tree());
+	BOOST_CHECK( json.find("\"collapsed_actions\":4") != std::string::npos );
+	BOOST_CHECK( json.find("\"calls\":4") != std::string::npos );
+
+	std::stringstream stream;
+	binary_writer_t binary_writer(stream);
+	binary_writer.write(call_tree.get_call_tree());
+
+	binary_reader_t binary_reader(stream);
+	rapidjson::StringBuffer buffer;
+	rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+	BOOST_REQUIRE( binary_reader.read_tree(writer) );
+	BOOST_CHECK_EQUAL( std::string(buffer.GetString()), json );
+}
+
+BOOST_AUTO_TEST_CASE( binary_node_stats_round_trip_test )
+{
+	actions_set_t actions_set;
+	int action_code = actions_set.define_new_action("ACTION");
+	actions_set.define_stat_key("unused");
+	call_tree_t call_tree(actions_set);
+	call_tree.add_stat("tree", 1);
+	call_tree_t::p_node_t node = call_tree.add_new_link(call_tree.root, action_code);
+	call_tree.add_node_stat(node, "bytes", 4096);
+	call_tree.add_node_stat(node, "ratio", 0.25);
+	call_tree.add_node_counter(node, actions_set.define_stat_key("items"), 3);
+	call_tree_t::p_node_t inner_node = call_tree.add_new_link(node, action_code);
+	call_tree.add_node_stat(inner_node, "cached", true);
+	call_tree.add_node_stat(inner_node, "bytes", "none");
+
+	std::stringstream stream;
+	binary_writer_t binary_writer(stream);
+	binary_writer.write(call_tree);
+	binary_writer.write(call_tree);
+
+	binary_reader_t binary_reader(stream);
+	rapidjson::StringBuffer buffer;
+	rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+	for (int i = 0; i < 2; ++i) {
+		buffer.Clear();
+		BOOST_REQUIRE( binary_reader.read_tree(writer) );
+		BOOST_CHECK_EQUAL( std::string(buffer.GetString()), to_json(call_tree) );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( binary_aggregator_test )
+{
+	actions_set_t actions_set;
+	int action_code = actions_set.define_new_action("ACTION");
+	call_tree_t call_tree(actions_set);
+	call_tree.add_new_link(call_tree.root, action_code);
+
+	std::stringstream binary_stream;
+	std::stringstream json_stream;
+	{
+		binary_aggregator_t binary_aggregator(binary_stream);
+		stream_aggregator_t stream_aggregator(json_stream);
+		binary_aggregator.aggregate(call_tree);
+		stream_aggregator.aggregate(call_tree);
+	}
+
+	std::string json = json_stream.str();
+	BOOST_CHECK_LT( binary_stream.str().size(), json.size() );
+
+	binary_reader_t binary_reader(binary_stream);
+	rapidjson::StringBuffer buffer;
+	rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+	BOOST_REQUIRE( binary_reader.read_tree(writer) );
+	BOOST_CHECK_EQUAL( std::string(buffer.GetString()) + "\n", json );
+}
+
+BOOST_AUTO_TEST_CASE( binary_reader_errors_test )
+{
+	std::stringstream bad_magic("JSON");
+	BOOST_CHECK_THROW( binary_reader_t reader(bad_magic), std::runtime_error );
+
+	actions_set_t actions_set;
+	int action_code = actions_set.define_new_action("ACTION");
+	call_tree_t call_tree(actions_set);
+	call_tree.add_new_link(call_tree.root, action_code);
+
+	std::stringstream stream;
+	binary_writer_t binary_writer(stream);
+	binary_writer.write(call_tree);
+
+	std::string data = stream.str();
+	std::stringstream truncated(data.substr(0, data.size() - 1));
+	binary_reader_t binary_reader(truncated);
+	rapidjson::StringBuffer buffer;
+	rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+	BOOST_CHECK_THROW( binary_reader.read_tree(writer), std::runtime_error );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
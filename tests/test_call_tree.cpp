@@ -1,3 +1,8 @@
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
 #include "tests.hpp"
 
 #include "react/call_tree.hpp"
@@ -12,7 +17,9 @@ BOOST_AUTO_TEST_CASE( node_constructors_test )
 	BOOST_CHECK_EQUAL( node.action_code, 42 );
 	BOOST_CHECK_EQUAL( node.start_time, 0 );
 	BOOST_CHECK_EQUAL( node.stop_time, 0 );
-	BOOST_CHECK( node.links.empty() );
+	BOOST_CHECK_EQUAL( node.first_child, +node_t::NO_NODE );
+	BOOST_CHECK_EQUAL( node.last_child, +node_t::NO_NODE );
+	BOOST_CHECK_EQUAL( node.next_sibling, +node_t::NO_NODE );
 }
 
 BOOST_AUTO_TEST_CASE( call_tree_constructors_test )
@@ -61,6 +68,91 @@ BOOST_AUTO_TEST_CASE( call_tree_add_new_link_test )
 	}
 }
 
+BOOST_AUTO_TEST_CASE( call_tree_get_node_links_test )
+{
+	actions_set_t actions_set;
+	int action_code = actions_set.define_new_action("ACTION");
+	int another_action_code = actions_set.define_new_action("ANOTHER_ACTION");
+	call_tree_t call_tree(actions_set);
+
+	std::vector<call_tree_t::p_node_t> children;
+	for (int i = 0; i < 10; ++i) {
+		children.push_back(call_tree.add_new_link(call_tree.root, i % 2 ? action_code : another_action_code));
+	}
+	call_tree.add_new_link(children.front(), action_code);
+
+	node_links_t links = call_tree.get_node_links(call_tree.root);
+	BOOST_CHECK_EQUAL( links.size(), children.size() );
+	BOOST_CHECK_EQUAL_COLLECTIONS( links.begin(), links.end(), children.begin(), children.end() );
+	BOOST_CHECK_EQUAL( call_tree.get_node_links(children.front()).size(), 1 );
+	BOOST_CHECK( call_tree.get_node_links(children.back()).empty() );
+}
+
+BOOST_AUTO_TEST_CASE( call_tree_write_json_test )
+{
+	actions_set_t actions_set;
+	int action_code = actions_set.define_new_action("ACTION");
+	int another_action_code = actions_set.define_new_action("ANOTHER_ACTION");
+	call_tree_t call_tree(actions_set);
+
+	call_tree.add_stat("bool", true);
+	call_tree.add_stat("int", 42);
+	call_tree.add_stat("string", "value");
+
+	call_tree_t::p_node_t node = call_tree.add_new_link(call_tree.root, action_code);
+	call_tree.add_new_link(node, another_action_code);
+	call_tree_t::p_node_t inner_node = call_tree.add_new_link(node, action_code);
+	call_tree.add_new_link(inner_node, action_code);
+	call_tree.add_new_link(call_tree.root, another_action_code);
+
+	rapidjson::Document doc;
+	doc.SetObject();
+	call_tree.to_json(doc, doc.GetAllocator());
+	rapidjson::StringBuffer dom_buffer;
+	rapidjson::Writer<rapidjson::StringBuffer> dom_writer(dom_buffer);
+	doc.Accept(dom_writer);
+
+	rapidjson::StringBuffer sax_buffer;
+	rapidjson::Writer<rapidjson::StringBuffer> sax_writer(sax_buffer);
+	call_tree.write_json(sax_writer);
+
+	BOOST_CHECK_EQUAL( std::string(sax_buffer.GetString()), std::string(dom_buffer.GetString()) );
+}
+
+BOOST_AUTO_TEST_CASE( call_tree_write_json_empty_test )
+{
+	actions_set_t actions_set;
+	call_tree_t call_tree(actions_set);
+
+	rapidjson::StringBuffer buffer;
+	rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+	call_tree.write_json(writer);
+
+	BOOST_CHECK_EQUAL( std::string(buffer.GetString()), "{}" );
+}
+
+BOOST_AUTO_TEST_CASE( call_tree_reset_test )
+{
+	actions_set_t actions_set;
+	int action_code = actions_set.define_new_action("ACTION");
+	call_tree_t call_tree(actions_set);
+
+	call_tree_t::p_node_t node = call_tree.add_new_link(call_tree.root, action_code);
+	call_tree.set_node_start_time(node, 42);
+	call_tree.add_stat("int", 42);
+	BOOST_CHECK_EQUAL( call_tree.get_nodes_number(), 2 );
+
+	call_tree.reset();
+	BOOST_CHECK_EQUAL( call_tree.get_nodes_number(), 1 );
+	BOOST_CHECK( call_tree.get_node_links(call_tree.root).empty() );
+	BOOST_CHECK( !call_tree.has_stat("int") );
+
+	// Reused node is reinitialized
+	node = call_tree.add_new_link(call_tree.root, action_code);
+	BOOST_CHECK_EQUAL( call_tree.get_node_start_time(node), 0 );
+	BOOST_CHECK( call_tree.get_node_links(node).empty() );
+}
+
 BOOST_AUTO_TEST_CASE( concurrent_call_tree_inner_tree_test )
 {
 	actions_set_t actions_set;
@@ -75,4 +167,151 @@ BOOST_AUTO_TEST_CASE( concurrent_call_tree_inner_tree_test )
 	BOOST_CHECK_EQUAL( tree_copy.get_node_action_code(node), action_code );
 }
 
+BOOST_AUTO_TEST_CASE( call_tree_assignment_test )
+{
+	actions_set_t actions_set;
+	int action_code = actions_set.define_new_action("ACTION");
+	actions_set_t another_actions_set;
+
+	call_tree_t call_tree(actions_set);
+	call_tree_t::p_node_t node = call_tree.add_new_link(call_tree.root, action_code);
+	call_tree.set_node_start_time(node, 100);
+	call_tree.add_stat("int", 42);
+
+	call_tree_t tree_copy(another_actions_set);
+	tree_copy = call_tree;
+	BOOST_CHECK_EQUAL( &tree_copy.get_actions_set(), &actions_set );
+	BOOST_CHECK_EQUAL( tree_copy.get_nodes_number(), 2 );
+	BOOST_CHECK_EQUAL( tree_copy.get_node_start_time(node), 100 );
+	BOOST_CHECK_EQUAL( tree_copy.get_stat<int>("int"), 42 );
+
+	call_tree_t moved_tree(another_actions_set);
+	moved_tree = std::move(call_tree);
+	BOOST_CHECK_EQUAL( &moved_tree.get_actions_set(), &actions_set );
+	BOOST_CHECK_EQUAL( moved_tree.get_nodes_number(), 2 );
+	BOOST_CHECK_EQUAL( moved_tree.get_node_action_code(node), action_code );
+	BOOST_CHECK( moved_tree.has_stat("int") );
+
+	// Moved-from tree gets previous contents of target and is usable after reset
+	BOOST_CHECK_EQUAL( &call_tree.get_actions_set(), &another_actions_set );
+	call_tree.reset();
+	BOOST_CHECK_EQUAL( call_tree.get_nodes_number(), 1 );
+	BOOST_CHECK( !call_tree.has_stat("int") );
+}
+
+BOOST_AUTO_TEST_CASE( concurrent_call_tree_take_call_tree_test )
+{
+	actions_set_t actions_set;
+	int action_code = actions_set.define_new_action("ACTION");
+	concurrent_call_tree_t concurrent_call_tree(actions_set);
+	call_tree_t &inner_tree = concurrent_call_tree.get_call_tree();
+	call_tree_t::p_node_t node = inner_tree.add_new_link(inner_tree.root, action_code);
+	inner_tree.add_stat("int", 42);
+
+	call_tree_t taken_tree = concurrent_call_tree.take_call_tree();
+	BOOST_CHECK_EQUAL( taken_tree.get_nodes_number(), 2 );
+	BOOST_CHECK_EQUAL( taken_tree.get_node_action_code(node), action_code );
+	BOOST_CHECK( taken_tree.has_stat("int") );
+
+	BOOST_CHECK_EQUAL( inner_tree.get_nodes_number(), 1 );
+	BOOST_CHECK( inner_tree.get_node_links(inner_tree.root).empty() );
+	BOOST_CHECK( !inner_tree.has_stat("int") );
+}
+
+BOOST_AUTO_TEST_CASE( concurrent_call_tree_merge_later_test )
+{
+	actions_set_t actions_set;
+	int action_code = actions_set.define_new_action("ACTION");
+	concurrent_call_tree_t concurrent_call_tree(actions_set);
+	call_tree_t::p_node_t root =
+			concurrent_call_tree.get_call_tree().root;
+
+	call_tree_t subtree(actions_set);
+	subtree.add_new_link(subtree.root, action_code);
+
+	BOOST_CHECK( !concurrent_call_tree.has_pending_merges() );
+	concurrent_call_tree.merge_later(root, subtree);
+	BOOST_CHECK( concurrent_call_tree.has_pending_merges() );
+	BOOST_CHECK( concurrent_call_tree.get_call_tree().get_node_links(root).empty() );
+
+	concurrent_call_tree.apply_pending_merges();
+	BOOST_CHECK( !concurrent_call_tree.has_pending_merges() );
+	BOOST_CHECK_EQUAL( concurrent_call_tree.get_call_tree().get_node_links(root).size(), 1 );
+}
+
+BOOST_AUTO_TEST_CASE( concurrent_call_tree_merge_later_owned_test )
+{
+	actions_set_t actions_set;
+	int action_code = actions_set.define_new_action("ACTION");
+	concurrent_call_tree_t concurrent_call_tree(actions_set);
+	call_tree_t::p_node_t root =
+			concurrent_call_tree.get_call_tree().root;
+
+	call_tree_t subtree(actions_set);
+	subtree.add_new_link(subtree.root, action_code);
+	subtree.add_new_link(subtree.root, action_code);
+
+	concurrent_call_tree.merge_later(root, std::move(subtree));
+	BOOST_CHECK_EQUAL( subtree.get_nodes_number(), 0 );
+	BOOST_CHECK( concurrent_call_tree.has_pending_merges() );
+
+	concurrent_call_tree.apply_pending_merges();
+	BOOST_CHECK_EQUAL( concurrent_call_tree.get_call_tree().get_node_links(root).size(), 2 );
+}
+
+BOOST_AUTO_TEST_CASE( concurrent_call_tree_reset_drops_merges_test )
+{
+	actions_set_t actions_set;
+	int action_code = actions_set.define_new_action("ACTION");
+	concurrent_call_tree_t concurrent_call_tree(actions_set);
+	call_tree_t::p_node_t root =
+			concurrent_call_tree.get_call_tree().root;
+
+	call_tree_t subtree(actions_set);
+	subtree.add_new_link(subtree.root, action_code);
+
+	uint64_t generation = concurrent_call_tree.get_generation();
+	BOOST_CHECK( concurrent_call_tree.merge_later(root, subtree, generation) );
+	concurrent_call_tree.reset();
+	BOOST_CHECK( !concurrent_call_tree.has_pending_merges() );
+	BOOST_CHECK_NE( concurrent_call_tree.get_generation(), generation );
+
+	// Merge scheduled by subthread of the previous request
+	BOOST_CHECK( !concurrent_call_tree.merge_later(root, subtree, generation) );
+	BOOST_CHECK( !concurrent_call_tree.merge_later(root, std::move(subtree), generation) );
+	BOOST_CHECK( !concurrent_call_tree.has_pending_merges() );
+	concurrent_call_tree.apply_pending_merges();
+	BOOST_CHECK( concurrent_call_tree.get_call_tree().get_node_links(root).empty() );
+}
+
+BOOST_AUTO_TEST_CASE( call_tree_add_stat_concurrent_define_test )
+{
+	actions_set_t actions_set;
+	const int THREADS_NUMBER = 2;
+	const int KEYS_NUMBER = 10000;
+
+	// Key found by one thread right after another defined it must be valid
+	std::vector<int> failures(THREADS_NUMBER, 0);
+	std::vector<std::thread> threads;
+	for (int thread = 0; thread < THREADS_NUMBER; ++thread) {
+		threads.emplace_back([&actions_set, &failures, thread] () {
+			call_tree_t call_tree(actions_set);
+			for (int i = 0; i < KEYS_NUMBER; ++i) {
+				try {
+					call_tree.add_stat(actions_set.define_stat_key("key" + std::to_string(static_cast<long long>(i))), i);
+				} catch (std::invalid_argument &) {
+					++failures[thread];
+				}
+			}
+		});
+	}
+	for (auto it = threads.begin(); it != threads.end(); ++it) {
+		it->join();
+	}
+
+	for (int thread = 0; thread < THREADS_NUMBER; ++thread) {
+		BOOST_CHECK_EQUAL( failures[thread], 0 );
+	}
+}
+
 BOOST_AUTO_TEST_SUITE_END()
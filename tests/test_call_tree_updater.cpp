@@ -1,6 +1,7 @@
 #include "tests.hpp"
 
 #include <array>
+#include <thread>
 
 #include "react/updater.hpp"
 
@@ -211,6 +212,210 @@ BOOST_AUTO_TEST_CASE( call_tree_updater_start_stop_max_depth_test )
 	BOOST_CHECK_EQUAL( updater.get_actual_trace_depth(), 0 );
 }
 
+BOOST_AUTO_TEST_CASE( call_tree_updater_max_nodes_number_test )
+{
+	actions_set_t actions_set;
+	int action_code = actions_set.define_new_action("ACTION");
+	int inner_action_code = actions_set.define_new_action("INNER_ACTION");
+	concurrent_call_tree_t call_tree(actions_set);
+	call_tree_updater_t updater(call_tree);
+	const call_tree_t &tree = call_tree.get_call_tree();
+
+	BOOST_CHECK_EQUAL( updater.get_max_nodes_number(), +call_tree_updater_t::DEFAULT_MAX_NODES_NUMBER );
+	updater.set_max_nodes_number(3);
+
+	for (int i = 0; i < 2; ++i) {
+		updater.start(action_code);
+		updater.stop(action_code);
+	}
+	BOOST_CHECK_EQUAL( tree.get_nodes_number(), 3 );
+	BOOST_CHECK( tree.get_node_summary(1) == NULL );
+	BOOST_CHECK( tree.get_node_summary(2) == NULL );
+
+	const int COLLAPSED_CALLS_NUMBER = 10;
+	for (int i = 0; i < COLLAPSED_CALLS_NUMBER; ++i) {
+		updater.start(action_code);
+		updater.start(inner_action_code);
+		updater.stop(inner_action_code);
+		updater.stop(action_code);
+	}
+
+	// One collapsed node per action code and parent
+	BOOST_CHECK_EQUAL( tree.get_nodes_number(), 5 );
+	BOOST_CHECK_EQUAL( tree.get_node_links(tree.root).size(), 3 );
+	BOOST_CHECK_EQUAL( tree.get_collapsed_actions_number(), 2 * COLLAPSED_CALLS_NUMBER );
+
+	const node_summary_t *summary = tree.get_node_summary(3);
+	BOOST_REQUIRE( summary != NULL );
+	BOOST_CHECK_EQUAL( tree.get_node_action_code(3), action_code );
+	BOOST_CHECK_EQUAL( summary->calls, COLLAPSED_CALLS_NUMBER );
+	BOOST_CHECK( summary->min_time <= summary->max_time );
+	BOOST_CHECK( summary->max_time <= summary->total_time );
+	BOOST_CHECK( tree.get_node_start_time(3) <= tree.get_node_stop_time(3) );
+
+	const node_summary_t *inner_summary = tree.get_node_summary(4);
+	BOOST_REQUIRE( inner_summary != NULL );
+	BOOST_CHECK_EQUAL( tree.get_node_action_code(4), inner_action_code );
+	BOOST_CHECK_EQUAL( inner_summary->calls, COLLAPSED_CALLS_NUMBER );
+	BOOST_CHECK( inner_summary->total_time <= summary->total_time );
+
+	call_tree.get_call_tree().reset();
+	updater.set_call_tree(call_tree);
+	BOOST_CHECK_EQUAL( tree.get_collapsed_actions_number(), 0 );
+	BOOST_CHECK( tree.get_node_summary(1) == NULL );
+}
+
+BOOST_AUTO_TEST_CASE( call_tree_updater_coalesce_siblings_test )
+{
+	actions_set_t actions_set;
+	int action_code = actions_set.define_new_action("ACTION");
+	int inner_action_code = actions_set.define_new_action("INNER_ACTION");
+	concurrent_call_tree_t call_tree(actions_set);
+	call_tree_updater_t updater(call_tree);
+	const call_tree_t &tree = call_tree.get_call_tree();
+
+	BOOST_CHECK( !updater.get_coalesce_siblings() );
+	updater.set_coalesce_siblings(true);
+
+	const int CALLS_NUMBER = 1000;
+	for (int i = 0; i < CALLS_NUMBER; ++i) {
+		updater.start(action_code);
+		updater.start(inner_action_code);
+		updater.stop(inner_action_code);
+		updater.stop(action_code);
+	}
+
+	BOOST_CHECK_EQUAL( tree.get_nodes_number(), 3 );
+	BOOST_CHECK_EQUAL( tree.get_collapsed_actions_number(), 0 );
+
+	const node_summary_t *summary = tree.get_node_summary(1);
+	BOOST_REQUIRE( summary != NULL );
+	BOOST_CHECK_EQUAL( summary->calls, CALLS_NUMBER );
+	BOOST_CHECK( summary->min_time <= summary->max_time );
+	BOOST_CHECK( summary->total_time <= tree.get_node_stop_time(1) - tree.get_node_start_time(1) );
+
+	const node_summary_t *inner_summary = tree.get_node_summary(2);
+	BOOST_REQUIRE( inner_summary != NULL );
+	BOOST_CHECK_EQUAL( inner_summary->calls, CALLS_NUMBER );
+
+	// Only consecutive calls are coalesced
+	updater.start(inner_action_code);
+	updater.stop(inner_action_code);
+	updater.start(action_code);
+	updater.stop(action_code);
+	BOOST_CHECK_EQUAL( tree.get_nodes_number(), 5 );
+	BOOST_CHECK( tree.get_node_summary(3) == NULL );
+	BOOST_CHECK( tree.get_node_summary(4) == NULL );
+
+	updater.start(action_code);
+	updater.stop(action_code);
+	BOOST_CHECK_EQUAL( tree.get_nodes_number(), 5 );
+	BOOST_REQUIRE( tree.get_node_summary(4) != NULL );
+	BOOST_CHECK_EQUAL( tree.get_node_summary(4)->calls, 2 );
+}
+
+BOOST_AUTO_TEST_CASE( call_tree_updater_coalesce_open_siblings_test )
+{
+	actions_set_t actions_set;
+	int action_code = actions_set.define_new_action("ACTION");
+	int inner_action_code = actions_set.define_new_action("INNER_ACTION");
+	concurrent_call_tree_t call_tree(actions_set);
+	call_tree_updater_t updater(call_tree);
+	updater.set_coalesce_siblings(true);
+	const call_tree_t &tree = call_tree.get_call_tree();
+
+	// Running action is never a target for coalescing
+	updater.start(action_code);
+	BOOST_CHECK_EQUAL( tree.get_coalescable_link(tree.root, action_code), +call_tree_t::NO_NODE );
+	updater.start(inner_action_code);
+	BOOST_CHECK_EQUAL( tree.get_coalescable_link(1, inner_action_code), +call_tree_t::NO_NODE );
+	updater.stop(inner_action_code);
+	BOOST_CHECK_EQUAL( tree.get_coalescable_link(1, inner_action_code), 2 );
+
+	// Nested open sibling after coalesced calls
+	updater.start(inner_action_code);
+	updater.start(inner_action_code);
+	BOOST_CHECK_EQUAL( tree.get_coalescable_link(2, inner_action_code), +call_tree_t::NO_NODE );
+	updater.stop(inner_action_code);
+	updater.start(inner_action_code);
+	BOOST_CHECK_EQUAL( tree.get_nodes_number(), 4 );
+	BOOST_CHECK_EQUAL( tree.get_node_summary(3)->calls, 1 );
+	updater.stop(inner_action_code);
+	updater.stop(inner_action_code);
+	updater.stop(action_code);
+
+	BOOST_CHECK_EQUAL( tree.get_coalescable_link(tree.root, action_code), 1 );
+	BOOST_CHECK_EQUAL( tree.get_nodes_number(), 4 );
+	BOOST_CHECK_EQUAL( tree.get_node_summary(2)->calls, 2 );
+	BOOST_CHECK_EQUAL( tree.get_node_summary(3)->calls, 2 );
+}
+
+BOOST_AUTO_TEST_CASE( call_tree_updater_count_test )
+{
+	actions_set_t actions_set;
+	int action_code = actions_set.define_new_action("ACTION");
+	int key = actions_set.define_stat_key("bytes");
+	concurrent_call_tree_t call_tree(actions_set);
+	call_tree_updater_t updater(call_tree, 1);
+	updater.set_coalesce_siblings(true);
+	const call_tree_t &tree = call_tree.get_call_tree();
+
+	updater.count(key, 1);
+	for (int i = 0; i < 100; ++i) {
+		updater.start(action_code);
+		updater.count(key, 10);
+		// Beyond max depth
+		updater.start(action_code);
+		updater.count(key, 1000);
+		updater.stop(action_code);
+		updater.stop(action_code);
+	}
+
+	BOOST_CHECK_EQUAL( tree.get_nodes_number(), 2 );
+	BOOST_CHECK_EQUAL( tree.get_node_stat<int64_t>(1, key), 1000 );
+	BOOST_CHECK_EQUAL( tree.get_stat<int64_t>(key), 1 );
+
+	{
+		action_guard_t guard(&updater, action_code);
+		guard.count(key, 5);
+	}
+	BOOST_CHECK_EQUAL( tree.get_node_stat<int>(1, key), 1005 );
+}
+
+BOOST_AUTO_TEST_CASE( call_tree_updater_snapshot_test )
+{
+	actions_set_t actions_set;
+	int action_code = actions_set.define_new_action("ACTION");
+	concurrent_call_tree_t call_tree(actions_set);
+	call_tree_updater_t updater(call_tree);
+
+	call_tree_t snapshot(actions_set);
+	BOOST_CHECK_EQUAL( call_tree.get_snapshot(snapshot), 0 );
+
+	updater.start(action_code);
+	updater.start(action_code);
+	std::thread reader([&call_tree] () {
+		call_tree.request_snapshot();
+	});
+	reader.join();
+	BOOST_CHECK( call_tree.snapshot_is_requested() );
+	BOOST_CHECK_EQUAL( call_tree.get_snapshot(snapshot), 0 );
+
+	// Owner publishes snapshot at the next stop
+	updater.stop(action_code);
+	BOOST_CHECK( !call_tree.snapshot_is_requested() );
+	uint64_t epoch = 0;
+	std::thread snapshot_reader([&call_tree, &snapshot, &epoch] () {
+		epoch = call_tree.get_snapshot(snapshot);
+	});
+	snapshot_reader.join();
+	BOOST_CHECK_EQUAL( epoch, 1 );
+	BOOST_CHECK_EQUAL( snapshot.get_nodes_number(), 3 );
+
+	updater.stop(action_code);
+	BOOST_CHECK_EQUAL( call_tree.get_snapshot(snapshot), 1 );
+}
+
 BOOST_AUTO_TEST_CASE( action_guard_constructors_test )
 {
 	{
@@ -240,7 +445,7 @@ BOOST_AUTO_TEST_CASE( action_guard_stop_test )
 	{
 		action_guard_t action_guard(NULL, NO_ACTION);
 		action_guard.stop();
-		BOOST_CHECK_THROW( action_guard.stop(), std::logic_error )
+		BOOST_CHECK_THROW( action_guard.stop(), std::logic_error );
 	}
 
 	{
@@ -251,7 +456,7 @@ BOOST_AUTO_TEST_CASE( action_guard_stop_test )
 
 		action_guard_t action_guard(&updater, action_code);
 		action_guard.stop();
-		BOOST_CHECK_THROW( action_guard.stop(), std::logic_error )
+		BOOST_CHECK_THROW( action_guard.stop(), std::logic_error );
 	}
 }
 
@@ -0,0 +1,47 @@
+#include "tests.hpp"
+
+#include "react/clock.hpp"
+
+BOOST_AUTO_TEST_SUITE( clock_suite )
+
+using namespace react;
+
+BOOST_AUTO_TEST_CASE( tick_clock_now_test )
+{
+	tick_clock_t::initialize();
+
+	tick_clock_t::ticks_t first = tick_clock_t::now();
+	tick_clock_t::ticks_t second = tick_clock_t::now();
+	BOOST_CHECK_LE( first, second );
+	BOOST_CHECK_GE( tick_clock_t::duration_to_nanoseconds(second - first), 0 );
+}
+
+BOOST_AUTO_TEST_CASE( tick_clock_source_test )
+{
+	tick_clock_t::initialize();
+
+	if (tick_clock_t::tsc_is_available()) {
+		BOOST_CHECK_EQUAL( tick_clock_t::get_source(), tick_clock_t::TSC_CLOCK );
+	} else {
+		BOOST_CHECK_EQUAL( tick_clock_t::get_source(), tick_clock_t::STEADY_CLOCK );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( tick_clock_to_nanoseconds_test )
+{
+	tick_clock_t::initialize();
+
+	int64_t system_time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::system_clock::now().time_since_epoch()
+	).count();
+	int64_t tick_time = tick_clock_t::to_nanoseconds(tick_clock_t::now());
+
+	// Converted time is close to system time
+	const int64_t EPSILON = 1000000000;
+	BOOST_CHECK_LT( std::abs(tick_time - system_time), EPSILON );
+
+	// Unset time is not shifted by calibration epoch
+	BOOST_CHECK_EQUAL( tick_clock_t::to_nanoseconds(0), 0 );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
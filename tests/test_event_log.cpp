@@ -0,0 +1,175 @@
+#include "tests.hpp"
+
+#include "react/event_log.hpp"
+#include "react/updater.hpp"
+
+BOOST_AUTO_TEST_SUITE( event_log_suite )
+
+using namespace react;
+
+BOOST_AUTO_TEST_CASE( event_log_ring_test )
+{
+	BOOST_CHECK_EQUAL( sizeof(event_t), 16 );
+
+	event_log_t event_log(5);
+	BOOST_CHECK_EQUAL( event_log.get_capacity(), 8 );
+	BOOST_CHECK( event_log.empty() );
+
+	for (int i = 0; i < 10; ++i) {
+		event_log.append(i, event_t::START, i * 10);
+	}
+	BOOST_CHECK_EQUAL( event_log.size(), 8 );
+	BOOST_CHECK_EQUAL( event_log.get_dropped_events_number(), 2 );
+	BOOST_CHECK_EQUAL( event_log[0].action_code, 2 );
+	BOOST_CHECK_EQUAL( event_log[7].action_code, 9 );
+	BOOST_CHECK_EQUAL( event_log[7].time, 90 );
+
+	event_log.clear();
+	BOOST_CHECK( event_log.empty() );
+	BOOST_CHECK_EQUAL( event_log.size(), 0 );
+	BOOST_CHECK_EQUAL( event_log.get_capacity(), 8 );
+}
+
+BOOST_AUTO_TEST_CASE( event_log_replay_test )
+{
+	actions_set_t actions_set;
+	int action_code = actions_set.define_new_action("ACTION");
+	int inner_action_code = actions_set.define_new_action("INNER_ACTION");
+
+	event_log_t event_log(16);
+	event_log.append(action_code, event_t::START, 100);
+	event_log.append(inner_action_code, event_t::START, 110);
+	event_log.append(inner_action_code, event_t::STOP, 120);
+	event_log.append(inner_action_code, event_t::START, 130);
+	event_log.append(inner_action_code, event_t::STOP, 140);
+	event_log.append(action_code, event_t::STOP, 150);
+	event_log.append(action_code, event_t::START, 160);
+
+	call_tree_t call_tree(actions_set);
+	event_log.replay(call_tree, call_tree.root);
+
+	BOOST_REQUIRE_EQUAL( call_tree.get_nodes_number(), 5 );
+	BOOST_REQUIRE_EQUAL( call_tree.get_node_links(call_tree.root).size(), 2 );
+	call_tree_t::p_node_t node = *call_tree.get_node_links(call_tree.root).begin();
+	BOOST_CHECK_EQUAL( call_tree.get_node_action_code(node), action_code );
+	BOOST_CHECK_EQUAL( call_tree.get_node_start_time(node), 100 );
+	BOOST_CHECK_EQUAL( call_tree.get_node_stop_time(node), 150 );
+	BOOST_CHECK_EQUAL( call_tree.get_node_links(node).size(), 2 );
+	call_tree_t::p_node_t inner_node = *call_tree.get_node_links(node).begin();
+	BOOST_CHECK_EQUAL( call_tree.get_node_action_code(inner_node), inner_action_code );
+	BOOST_CHECK_EQUAL( call_tree.get_node_stop_time(inner_node), 120 );
+
+	// The last action is not finished
+	BOOST_CHECK_EQUAL( call_tree.get_node_start_time(4), 160 );
+	BOOST_CHECK( call_tree.get_node_stop_time(4) < call_tree.get_node_start_time(4) );
+}
+
+BOOST_AUTO_TEST_CASE( event_log_wrapped_replay_test )
+{
+	actions_set_t actions_set;
+	int action_code = actions_set.define_new_action("ACTION");
+	int inner_action_code = actions_set.define_new_action("INNER_ACTION");
+
+	event_log_t event_log(4);
+	event_log.append(action_code, event_t::START, 100);
+	for (int i = 0; i < 3; ++i) {
+		event_log.append(inner_action_code, event_t::START, 110 + i);
+		event_log.append(inner_action_code, event_t::STOP, 120 + i);
+	}
+	event_log.append(action_code, event_t::STOP, 150);
+
+	// Start of ACTION and the first inner actions were overwritten
+	call_tree_t call_tree(actions_set);
+	event_log.replay(call_tree, call_tree.root);
+	BOOST_CHECK_EQUAL( event_log.get_dropped_events_number(), 4 );
+	BOOST_REQUIRE_EQUAL( call_tree.get_nodes_number(), 2 );
+	BOOST_CHECK_EQUAL( call_tree.get_node_action_code(1), inner_action_code );
+	BOOST_CHECK_EQUAL( call_tree.get_node_start_time(1), 112 );
+	BOOST_CHECK_EQUAL( call_tree.get_node_stop_time(1), 122 );
+}
+
+BOOST_AUTO_TEST_CASE( call_tree_updater_event_log_test )
+{
+	actions_set_t actions_set;
+	int action_code = actions_set.define_new_action("ACTION");
+	int inner_action_code = actions_set.define_new_action("INNER_ACTION");
+	int key = actions_set.define_stat_key("key");
+	concurrent_call_tree_t call_tree(actions_set);
+	call_tree_updater_t updater(call_tree);
+	const call_tree_t &tree = call_tree.get_call_tree();
+
+	event_log_t event_log(16);
+	updater.set_event_log(&event_log);
+	BOOST_CHECK_EQUAL( updater.get_event_log(), &event_log );
+
+	updater.start(action_code);
+	BOOST_CHECK_THROW( updater.set_event_log(NULL), std::logic_error );
+	{
+		action_guard_t guard(&updater, inner_action_code);
+		guard.annotate(key, 1);
+		updater.count(key, 1);
+	}
+	updater.stop(action_code);
+
+	BOOST_CHECK_EQUAL( event_log.size(), 4 );
+	BOOST_CHECK_EQUAL( tree.get_nodes_number(), 1 );
+	BOOST_CHECK( !tree.has_stat(key) );
+
+	updater.apply_event_log();
+	BOOST_CHECK( event_log.empty() );
+	BOOST_REQUIRE_EQUAL( tree.get_nodes_number(), 3 );
+	BOOST_CHECK_EQUAL( tree.get_node_action_code(1), action_code );
+	BOOST_CHECK_EQUAL( tree.get_node_action_code(2), inner_action_code );
+	BOOST_CHECK( tree.get_node_start_time(1) <= tree.get_node_start_time(2) );
+	BOOST_CHECK( tree.get_node_stop_time(2) <= tree.get_node_stop_time(1) );
+	BOOST_CHECK( !tree.node_has_stats(2) );
+	BOOST_CHECK( !tree.has_stat("dropped_events") );
+
+	for (int i = 0; i < 10; ++i) {
+		updater.start(action_code);
+		updater.stop(action_code);
+	}
+	updater.apply_event_log();
+	BOOST_CHECK_EQUAL( tree.get_nodes_number(), 3 + 8 );
+	BOOST_CHECK_EQUAL( tree.get_stat<int64_t>("dropped_events"), 4 );
+
+	updater.set_event_log(NULL);
+	updater.start(action_code);
+	updater.stop(action_code);
+	BOOST_CHECK_EQUAL( tree.get_nodes_number(), 3 + 8 + 1 );
+}
+
+BOOST_AUTO_TEST_CASE( call_tree_updater_flight_recorder_test )
+{
+	actions_set_t actions_set;
+	int action_code = actions_set.define_new_action("ACTION");
+	concurrent_call_tree_t call_tree(actions_set);
+	call_tree_updater_t updater(call_tree);
+	const call_tree_t &tree = call_tree.get_call_tree();
+
+	event_log_t flight_recorder(16);
+	updater.set_flight_recorder(&flight_recorder);
+	BOOST_CHECK_EQUAL( updater.get_flight_recorder(), &flight_recorder );
+	for (int i = 0; i < 2; ++i) {
+		updater.start(action_code);
+		updater.stop(action_code);
+	}
+	BOOST_CHECK_EQUAL( tree.get_nodes_number(), 3 );
+	BOOST_CHECK_EQUAL( flight_recorder.size(), 4 );
+
+	// Flight recorder is kept when event log is applied
+	event_log_t event_log(16);
+	updater.set_event_log(&event_log);
+	updater.start(action_code);
+	updater.stop(action_code);
+	updater.apply_event_log();
+	BOOST_CHECK_EQUAL( tree.get_nodes_number(), 4 );
+	BOOST_CHECK_EQUAL( flight_recorder.size(), 6 );
+
+	call_tree_t replayed_tree(actions_set);
+	flight_recorder.replay(replayed_tree, replayed_tree.root);
+	BOOST_CHECK_EQUAL( replayed_tree.get_nodes_number(), 4 );
+	BOOST_CHECK_EQUAL( replayed_tree.get_node_start_time(3), tree.get_node_start_time(3) );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
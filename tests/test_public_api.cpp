@@ -2,9 +2,43 @@
 
 #include "react/react.hpp"
 #include "react/actions_set.hpp"
+#include "react/async_aggregator.hpp"
+#include "react/sampling.hpp"
+
+#include <cstdlib>
+#include <new>
+
+#include <signal.h>
+
+/*
+ * Counts allocations of current thread while counting is on
+ */
+static __thread bool count_allocations = false;
+static __thread size_t allocations_number = 0;
+
+void *operator new(size_t size) {
+	if (count_allocations) {
+		++allocations_number;
+	}
+	void *pointer = malloc(size ? size : 1);
+	if (!pointer) {
+		throw std::bad_alloc();
+	}
+	return pointer;
+}
+
+void operator delete(void *pointer) noexcept {
+	free(pointer);
+}
 
 BOOST_AUTO_TEST_SUITE( public_api_suite )
 
+REACT_ACTION(TYPED_ACTION);
+REACT_NAMED_ACTION(NAMED_TYPED_ACTION, "NAMED TYPED ACTION");
+// Tag types of these actions must not collide with size_t and off_t
+REACT_ACTION(size);
+REACT_ACTION(off);
+
 BOOST_AUTO_TEST_CASE( react_define_new_action_test )
 {
 	int action_code = react_define_new_action("ACTION");
@@ -49,6 +83,22 @@ BOOST_AUTO_TEST_CASE( react_double_activate_test )
 
 }
 
+BOOST_AUTO_TEST_CASE( react_reactivate_test )
+{
+	boost::test_tools::output_test_stream error_output;
+	cerr_redirect guard(error_output.rdbuf());
+
+	int action_code = react_define_new_action("ACTION");
+	for (int i = 0; i < 3; ++i) {
+		react_activate(NULL);
+		BOOST_CHECK_EQUAL( react_start_action(action_code), 0 );
+		BOOST_CHECK_EQUAL( react_stop_action(action_code), 0 );
+		BOOST_CHECK_EQUAL( react_deactivate(), 0 );
+	}
+
+	BOOST_CHECK( error_output.is_empty() );
+}
+
 BOOST_AUTO_TEST_CASE( react_not_active_deactivate_test )
 {
 	boost::test_tools::output_test_stream error_output;
@@ -155,6 +205,25 @@ BOOST_AUTO_TEST_CASE( react_add_stat_test_c )
 	react_deactivate();
 }
 
+BOOST_AUTO_TEST_CASE( react_add_key_stat_test_c )
+{
+	int key = react_define_stat_key("key");
+	BOOST_CHECK( key >= 0 );
+	BOOST_CHECK_EQUAL( react_define_stat_key("key"), key );
+
+	react_activate(NULL);
+	BOOST_CHECK_EQUAL( react_add_key_stat_bool(key, bool()), 0 );
+	BOOST_CHECK_EQUAL( react_add_key_stat_int(key, int()), 0 );
+	BOOST_CHECK_EQUAL( react_add_key_stat_int64(key, int64_t()), 0 );
+	BOOST_CHECK_EQUAL( react_add_key_stat_double(key, double()), 0 );
+	BOOST_CHECK_EQUAL( react_add_key_stat_string(key, ""), 0 );
+	BOOST_CHECK_EQUAL( react_add_stat_int64("int64", int64_t()), 0 );
+	BOOST_CHECK_EQUAL( react_add_key_stat_int(-1, int()), -EINVAL );
+	react_deactivate();
+
+	BOOST_CHECK_EQUAL( react_add_key_stat_int(key, int()), 0 );
+}
+
 BOOST_AUTO_TEST_CASE( react_not_active_add_stat_test_c )
 {
 	// Forgot to activate react
@@ -260,4 +329,364 @@ BOOST_AUTO_TEST_CASE( action_guard_stop_test )
 	react_deactivate();
 }
 
+BOOST_AUTO_TEST_CASE( react_not_active_action_guard_stop_test )
+{
+	int action_code = react_define_new_action("ACTION");
+	react::action_guard guard(action_code);
+	BOOST_CHECK_NO_THROW( guard.stop() );
+	BOOST_CHECK_NO_THROW( guard.stop() );
+}
+
+BOOST_AUTO_TEST_CASE( typed_action_test )
+{
+	BOOST_CHECK_EQUAL( TYPED_ACTION.code(), react_define_new_action("TYPED_ACTION") );
+	BOOST_CHECK_EQUAL( NAMED_TYPED_ACTION.code(), react_define_new_action("NAMED TYPED ACTION") );
+	BOOST_CHECK_EQUAL( size.code(), react_define_new_action("size") );
+	BOOST_CHECK_NE( off.code(), size.code() );
+	BOOST_CHECK( react::get_actions_set().code_is_valid(TYPED_ACTION.code()) );
+}
+
+BOOST_AUTO_TEST_CASE( typed_action_guard_test )
+{
+	boost::test_tools::output_test_stream error_output;
+	cerr_redirect guard(error_output.rdbuf());
+
+	react_activate(NULL);
+	{
+		react::action_guard typed_guard(TYPED_ACTION);
+		react::action_guard named_typed_guard(NAMED_TYPED_ACTION);
+		named_typed_guard.stop();
+	}
+	react_deactivate();
+
+	BOOST_CHECK( error_output.is_empty() );
+}
+
+BOOST_AUTO_TEST_CASE( react_not_active_typed_action_guard_test )
+{
+	react::action_guard guard(TYPED_ACTION);
+	BOOST_CHECK_NO_THROW( guard.stop() );
+}
+
+BOOST_AUTO_TEST_CASE( react_async_aggregator_test )
+{
+	std::ostringstream output;
+	react::stream_aggregator_t stream_aggregator(output);
+	react::async_aggregator_t aggregator(stream_aggregator);
+
+	int action_code = react_define_new_action("ACTION");
+	for (int i = 0; i < 3; ++i) {
+		react_activate(&aggregator);
+		react_start_action(action_code);
+		react_stop_action(action_code);
+		react_deactivate();
+	}
+
+	aggregator.flush();
+	BOOST_CHECK_EQUAL( aggregator.get_aggregated_trees_number(), 3 );
+	std::string text = output.str();
+	BOOST_CHECK_EQUAL( std::count(text.begin(), text.end(), '\n'), 3 );
+}
+
+BOOST_AUTO_TEST_CASE( react_unsampled_activation_test )
+{
+	std::ostringstream output;
+	react::stream_aggregator_t stream_aggregator(output);
+	react::rate_sampling_aggregator_t aggregator(stream_aggregator, 0.);
+
+	int action_code = react_define_new_action("ACTION");
+	react_activate(&aggregator);
+	BOOST_CHECK( !react_is_active() );
+	BOOST_CHECK_EQUAL( react_start_action(action_code), 0 );
+	{
+		react::action_guard guard(action_code);
+	}
+	BOOST_CHECK_EQUAL( react_stop_action(action_code), 0 );
+	BOOST_CHECK_EQUAL( react_add_stat_int("int", 42), 0 );
+
+	void *subthread_aggregator = react_create_subthread_aggregator();
+	BOOST_REQUIRE( subthread_aggregator != NULL );
+	BOOST_CHECK( !static_cast<react::aggregator_t*>(subthread_aggregator)->sample() );
+	react_destroy_subthread_aggregator(subthread_aggregator);
+
+	BOOST_CHECK_EQUAL( react_deactivate(), 0 );
+	BOOST_CHECK( output.str().empty() );
+	BOOST_CHECK( !react_is_active() );
+}
+
+BOOST_AUTO_TEST_CASE( react_inline_fast_path_test )
+{
+	int action_code = react_define_new_action("ACTION");
+	int evaluations_number = 0;
+
+	BOOST_CHECK_EQUAL( react_start_action((++evaluations_number, action_code)), 0 );
+	BOOST_CHECK_EQUAL( evaluations_number, 0 );
+	BOOST_CHECK_EQUAL( (react_is_active)(), 0 );
+
+	react_activate(NULL);
+	BOOST_CHECK( react_is_active() );
+	BOOST_CHECK( (react_is_active)() );
+	BOOST_CHECK_EQUAL( react_start_action((++evaluations_number, action_code)), 0 );
+	BOOST_CHECK_EQUAL( evaluations_number, 1 );
+	BOOST_CHECK_EQUAL( react::get_thread_updater()->get_trace_depth(), 1 );
+	BOOST_CHECK_EQUAL( (react_stop_action)(action_code), 0 );
+	react_deactivate();
+
+	BOOST_CHECK( !react_is_active() );
+}
+
+BOOST_AUTO_TEST_CASE( react_set_max_nodes_number_test )
+{
+	std::ostringstream output;
+	react::stream_aggregator_t aggregator(output);
+	int action_code = react_define_new_action("ACTION");
+
+	BOOST_CHECK_EQUAL( react_set_max_nodes_number(2), 0 );
+	react_activate(&aggregator);
+	BOOST_CHECK_EQUAL( react::get_thread_updater()->get_max_nodes_number(), 2 );
+	for (int i = 0; i < 100; ++i) {
+		react_start_action(action_code);
+		react_stop_action(action_code);
+	}
+	react_deactivate();
+	BOOST_CHECK_EQUAL( react_set_max_nodes_number(-1), 0 );
+
+	BOOST_CHECK( output.str().find("\"collapsed_actions\":99") != std::string::npos );
+	BOOST_CHECK( output.str().find("\"calls\":99") != std::string::npos );
+}
+
+BOOST_AUTO_TEST_CASE( react_set_coalesce_siblings_test )
+{
+	std::ostringstream output;
+	react::stream_aggregator_t aggregator(output);
+	int action_code = react_define_new_action("ACTION");
+
+	BOOST_CHECK_EQUAL( react_set_coalesce_siblings(1), 0 );
+	react_activate(&aggregator);
+	BOOST_CHECK( react::get_thread_updater()->get_coalesce_siblings() );
+	for (int i = 0; i < 100; ++i) {
+		react_start_action(action_code);
+		react_stop_action(action_code);
+	}
+	react_deactivate();
+	BOOST_CHECK_EQUAL( react_set_coalesce_siblings(0), 0 );
+
+	BOOST_CHECK( output.str().find("\"calls\":100") != std::string::npos );
+	BOOST_CHECK( output.str().find("collapsed_actions") == std::string::npos );
+}
+
+BOOST_AUTO_TEST_CASE( react_add_node_stat_test )
+{
+	std::ostringstream output;
+	react::stream_aggregator_t aggregator(output);
+	int action_code = react_define_new_action("ACTION");
+	int key = react_define_stat_key("items");
+
+	react_activate(&aggregator);
+	BOOST_CHECK_EQUAL( react_add_node_stat_string("outside", "tree"), 0 );
+	react_start_action(action_code);
+	BOOST_CHECK_EQUAL( react_add_node_stat_int64("bytes", 4096), 0 );
+	BOOST_CHECK_EQUAL( react_add_node_key_stat_int(key, 3), 0 );
+	BOOST_CHECK_EQUAL( react_add_node_key_stat_int(-1, 3), -EINVAL );
+	react_stop_action(action_code);
+	{
+		react::action_guard guard(action_code);
+		guard.annotate("hit", true);
+		guard.stop();
+		guard.annotate(key, 0.5);
+	}
+	react_deactivate();
+
+	BOOST_CHECK( output.str().find("\"outside\":\"tree\"") != std::string::npos );
+	BOOST_CHECK( output.str().find("\"stats\":{\"bytes\":4096,\"items\":3}") != std::string::npos );
+	BOOST_CHECK( output.str().find("\"stats\":{\"hit\":true,\"items\":0.5}") != std::string::npos );
+
+	// Forgot to activate react
+	react::action_guard guard(action_code);
+	BOOST_CHECK_NO_THROW( guard.annotate("hit", true) );
+	BOOST_CHECK_EQUAL( react_add_node_stat_bool("hit", true), 0 );
+}
+
+BOOST_AUTO_TEST_CASE( react_add_node_counter_test )
+{
+	std::ostringstream output;
+	react::stream_aggregator_t aggregator(output);
+	int action_code = react_define_new_action("ACTION");
+	int key = react_define_stat_key("items");
+
+	react_activate(&aggregator);
+	react_start_action(action_code);
+	BOOST_CHECK_EQUAL( react_add_node_counter("bytes", 4096), 0 );
+	BOOST_CHECK_EQUAL( react_add_node_counter("bytes", 4096), 0 );
+	BOOST_CHECK_EQUAL( react_add_node_key_counter(key, 1), 0 );
+	react::add_node_counter(key, 2);
+	react_stop_action(action_code);
+	{
+		react::action_guard guard(action_code);
+		guard.count("bytes", 1);
+	}
+	react_deactivate();
+
+	BOOST_CHECK( output.str().find("\"stats\":{\"bytes\":8192,\"items\":3}") != std::string::npos );
+	BOOST_CHECK( output.str().find("\"stats\":{\"bytes\":1}") != std::string::npos );
+	BOOST_CHECK_EQUAL( react_add_node_counter("bytes", 1), 0 );
+}
+
+BOOST_AUTO_TEST_CASE( react_set_event_log_capacity_test )
+{
+	std::ostringstream output;
+	react::stream_aggregator_t aggregator(output);
+	int action_code = react_define_new_action("ACTION");
+	int inner_action_code = react_define_new_action("INNER_ACTION");
+
+	BOOST_CHECK_EQUAL( react_set_event_log_capacity(64), 0 );
+	react_activate(&aggregator);
+	BOOST_CHECK( react::get_thread_updater()->get_event_log() != NULL );
+	{
+		react::action_guard guard(action_code);
+		react_start_action(inner_action_code);
+		react_stop_action(inner_action_code);
+	}
+	react_deactivate();
+	BOOST_CHECK_EQUAL( react_set_event_log_capacity(0), 0 );
+
+	BOOST_CHECK( output.str().find("\"name\":\"ACTION\"") != std::string::npos );
+	BOOST_CHECK( output.str().find("\"name\":\"INNER_ACTION\"") != std::string::npos );
+	BOOST_CHECK( output.str().find("dropped_events") == std::string::npos );
+
+	output.str("");
+	react_activate(&aggregator);
+	BOOST_CHECK( react::get_thread_updater()->get_event_log() == NULL );
+	react_deactivate();
+}
+
+BOOST_AUTO_TEST_CASE( react_flight_recorder_test )
+{
+	std::ostringstream output;
+	react::stream_aggregator_t stream_aggregator(output);
+	react::rate_sampling_aggregator_t aggregator(stream_aggregator, 0.);
+	std::ostringstream dump_output;
+	react::stream_aggregator_t dump_aggregator(dump_output);
+	int action_code = react_define_new_action("ACTION");
+	int unsampled_action_code = react_define_new_action("UNSAMPLED_ACTION");
+
+	BOOST_CHECK_EQUAL( react_set_flight_recorder(64, &dump_aggregator), 0 );
+
+	// Unsampled request is recorded but not traced
+	react_activate(&aggregator);
+	BOOST_CHECK( react_is_active() );
+	BOOST_CHECK( react::get_thread_updater() != NULL );
+	BOOST_CHECK( react::get_sampled_thread_updater() == NULL );
+	{
+		react::action_guard guard(unsampled_action_code);
+		BOOST_CHECK_EQUAL( react_add_stat_int("unsampled_stat", 1), 0 );
+		BOOST_CHECK_EQUAL( react_add_node_stat_int("unsampled_stat", 1), 0 );
+		BOOST_CHECK_EQUAL( react_add_node_counter("unsampled_stat", 1), 0 );
+		react::add_node_stat(react_define_stat_key("unsampled_stat"), 1);
+	}
+	react::add_stat("unsampled_stat", 1);
+	react::add_node_counter(react_define_stat_key("unsampled_stat"), 1);
+	void *subthread_aggregator = react_create_subthread_aggregator();
+	BOOST_CHECK( !static_cast<react::aggregator_t*>(subthread_aggregator)->sample() );
+	react_destroy_subthread_aggregator(subthread_aggregator);
+	react_deactivate();
+	BOOST_CHECK( output.str().empty() );
+
+	react_activate(&stream_aggregator);
+	react_start_action(action_code);
+	react_stop_action(action_code);
+	react_deactivate();
+	BOOST_CHECK( output.str().find("UNSAMPLED_ACTION") == std::string::npos );
+	BOOST_CHECK( dump_output.str().empty() );
+
+	BOOST_CHECK_EQUAL( react_dump_flight_recorder(), 0 );
+	BOOST_CHECK( dump_output.str().find("\"flight_recorder\":\"dump\"") != std::string::npos );
+	BOOST_CHECK( dump_output.str().find("\"name\":\"UNSAMPLED_ACTION\"") != std::string::npos );
+	BOOST_CHECK( dump_output.str().find("\"name\":\"ACTION\"") != std::string::npos );
+
+	// Slow request
+	dump_output.str("");
+	BOOST_CHECK_EQUAL( react_set_flight_recorder_latency_threshold(-1), -EINVAL );
+	BOOST_CHECK_EQUAL( react_set_flight_recorder_latency_threshold(1), 0 );
+	react_activate(&aggregator);
+	react_start_action(action_code);
+	react_stop_action(action_code);
+	react_deactivate();
+	BOOST_CHECK_EQUAL( react_set_flight_recorder_latency_threshold(0), 0 );
+	BOOST_CHECK( dump_output.str().find("\"flight_recorder\":\"latency\"") != std::string::npos );
+	BOOST_CHECK( dump_output.str().find("\"latency\":") != std::string::npos );
+
+	// Dump requested by signal is done at next deactivation
+	dump_output.str("");
+	BOOST_CHECK_EQUAL( react_set_flight_recorder_signal(SIGUSR1), 0 );
+	raise(SIGUSR1);
+	signal(SIGUSR1, SIG_DFL);
+	BOOST_CHECK( dump_output.str().empty() );
+	react_activate(&aggregator);
+	react_deactivate();
+	BOOST_CHECK( dump_output.str().find("\"flight_recorder\":\"dump\"") != std::string::npos );
+
+	BOOST_CHECK_EQUAL( react_set_flight_recorder(0, NULL), 0 );
+	react_activate(&aggregator);
+	BOOST_CHECK( !react_is_active() );
+	react_deactivate();
+}
+
+BOOST_AUTO_TEST_CASE( react_subthread_aggregator_sample_test )
+{
+	std::ostringstream output;
+	react::stream_aggregator_t stream_aggregator(output);
+	react::rate_sampling_aggregator_t aggregator(stream_aggregator, 0.);
+	std::ostringstream dump_output;
+	react::stream_aggregator_t dump_aggregator(dump_output);
+	BOOST_CHECK_EQUAL( react_set_flight_recorder(64, &dump_aggregator), 0 );
+
+	react_activate(&stream_aggregator);
+	void *subthread_aggregator = react_create_subthread_aggregator();
+	react_deactivate();
+
+	// Context of sampled request is reused by the next, unsampled one
+	react_activate(&aggregator);
+	BOOST_CHECK( react_is_active() );
+	BOOST_CHECK( static_cast<react::aggregator_t*>(subthread_aggregator)->sample() );
+	react_deactivate();
+	react_destroy_subthread_aggregator(subthread_aggregator);
+
+	BOOST_CHECK_EQUAL( react_set_flight_recorder(0, NULL), 0 );
+}
+
+BOOST_AUTO_TEST_CASE( react_steady_state_allocations_test )
+{
+	struct null_aggregator_t : public react::aggregator_t {
+		null_aggregator_t(): trees_number(0) {}
+		void aggregate(const react::call_tree_t &) {
+			++trees_number;
+		}
+		size_t trees_number;
+	} aggregator;
+	int action_code = react_define_new_action("ACTION");
+	int inner_action_code = react_define_new_action("INNER_ACTION");
+	int key = react_define_stat_key("items");
+	int string_key = react_define_stat_key("long_string");
+
+	for (int i = 0; i < 13; ++i) {
+		count_allocations = (i >= 3);
+		react_activate(&aggregator);
+		{
+			react::action_guard guard(action_code);
+			for (int j = 0; j < 10; ++j) {
+				react_start_action(inner_action_code);
+				react_stop_action(inner_action_code);
+			}
+			react_add_key_stat_int(key, i);
+			react_add_key_stat_string(string_key, "string which doesn't fit inline");
+		}
+		react_deactivate();
+	}
+	count_allocations = false;
+
+	BOOST_CHECK_EQUAL( aggregator.trees_number, 13 );
+	BOOST_CHECK_EQUAL( allocations_number, 0 );
+}
+
 BOOST_AUTO_TEST_SUITE_END()
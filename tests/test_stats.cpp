@@ -41,6 +41,116 @@ BOOST_AUTO_TEST_CASE( get_stat_test )
 	BOOST_REQUIRE_EQUAL( call_tree.get_stat<std::string>("char*"), "" );
 }
 
+BOOST_AUTO_TEST_CASE( interned_stat_key_test )
+{
+	actions_set_t actions_set;
+	call_tree_t call_tree(actions_set);
+
+	int key = actions_set.define_stat_key("key");
+	BOOST_CHECK_EQUAL( actions_set.define_stat_key("key"), key );
+	BOOST_CHECK_EQUAL( actions_set.find_stat_key("key"), key );
+	BOOST_CHECK_EQUAL( actions_set.find_stat_key("unknown"), +actions_set_t::NO_STAT_KEY );
+	BOOST_CHECK_EQUAL( actions_set.get_stat_key_name(key), "key" );
+	BOOST_CHECK_THROW( actions_set.get_stat_key_name(key + 1), std::invalid_argument );
+
+	BOOST_CHECK( !call_tree.has_stat(key) );
+	call_tree.add_stat(key, 42);
+	BOOST_CHECK( call_tree.has_stat(key) );
+	BOOST_CHECK( call_tree.has_stat("key") );
+	BOOST_CHECK_EQUAL( call_tree.get_stat<int>(key), 42 );
+	BOOST_CHECK_EQUAL( call_tree.get_stat<int>("key"), 42 );
+
+	BOOST_CHECK_THROW( call_tree.add_stat(key + 1, true), std::invalid_argument );
+	BOOST_CHECK_THROW( call_tree.get_stat<int>("unknown"), std::out_of_range );
+	BOOST_CHECK_THROW( call_tree.get_stat<bool>(key), std::invalid_argument );
+}
+
+BOOST_AUTO_TEST_CASE( typed_stat_test )
+{
+	actions_set_t actions_set;
+	call_tree_t call_tree(actions_set);
+
+	const int64_t BIG_VALUE = int64_t(1) << 40;
+	call_tree.add_stat("int64", BIG_VALUE);
+	BOOST_CHECK_EQUAL( call_tree.get_stat<int64_t>("int64"), BIG_VALUE );
+
+	const std::string SHORT_STRING(stat_t::INLINE_STRING_CAPACITY, 's');
+	const std::string LONG_STRING(stat_t::INLINE_STRING_CAPACITY + 1, 'l');
+	call_tree.add_stat("short", SHORT_STRING);
+	call_tree.add_stat("long", LONG_STRING);
+	BOOST_CHECK_EQUAL( call_tree.get_stat<std::string>("short"), SHORT_STRING );
+	BOOST_CHECK_EQUAL( call_tree.get_stat<std::string>("long"), LONG_STRING );
+
+	// Stat can change its type
+	call_tree.add_stat("long", "another " + LONG_STRING);
+	BOOST_CHECK_EQUAL( call_tree.get_stat<std::string>("long"), "another " + LONG_STRING );
+	call_tree.add_stat("long", 0.5);
+	BOOST_CHECK_EQUAL( call_tree.get_stat<double>("long"), 0.5 );
+	call_tree.add_stat("long", LONG_STRING);
+	BOOST_CHECK_EQUAL( call_tree.get_stat<std::string>("long"), LONG_STRING );
+	BOOST_CHECK_EQUAL( call_tree.get_stats().size(), 3 );
+
+	call_tree_t tree_copy(call_tree);
+	BOOST_CHECK_EQUAL( tree_copy.get_stat<std::string>("long"), LONG_STRING );
+
+	rapidjson::StringBuffer buffer;
+	rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+	call_tree.write_json(writer);
+	BOOST_CHECK_EQUAL( std::string(buffer.GetString()),
+			"{\"int64\":1099511627776,\"short\":\"" + SHORT_STRING + "\",\"long\":\"" + LONG_STRING + "\"}" );
+}
+
+BOOST_AUTO_TEST_CASE( node_stat_test )
+{
+	actions_set_t actions_set;
+	int action_code = actions_set.define_new_action("ACTION");
+	int key = actions_set.define_stat_key("bytes");
+	call_tree_t call_tree(actions_set);
+	call_tree_t::p_node_t node = call_tree.add_new_link(call_tree.root, action_code);
+	call_tree_t::p_node_t another_node = call_tree.add_new_link(call_tree.root, action_code);
+
+	BOOST_CHECK( !call_tree.node_has_stats(node) );
+	call_tree.add_node_stat(node, key, 4096);
+	call_tree.add_node_stat(another_node, "status", "ok");
+	call_tree.add_node_stat(node, "path", std::string(stat_t::INLINE_STRING_CAPACITY + 1, 'p'));
+	call_tree.add_node_stat(node, key, 8192);
+
+	BOOST_CHECK( call_tree.has_node_stat(node, key) );
+	BOOST_CHECK( !call_tree.has_node_stat(node, "status") );
+	BOOST_CHECK( !call_tree.has_stat(key) );
+	BOOST_CHECK_EQUAL( call_tree.get_node_stat<int>(node, "bytes"), 8192 );
+	BOOST_CHECK_EQUAL( call_tree.get_node_stat<std::string>(another_node, "status"), "ok" );
+	BOOST_CHECK_THROW( call_tree.get_node_stat<int>(another_node, key), std::out_of_range );
+	BOOST_CHECK_THROW( call_tree.get_node_stat<bool>(node, key), std::invalid_argument );
+	BOOST_CHECK_THROW( call_tree.add_node_stat(node, -1, true), std::invalid_argument );
+
+	size_t stats_number = 0;
+	call_tree.for_each_node_stat(node, [&] (const stat_t &) {
+		++stats_number;
+	});
+	BOOST_CHECK_EQUAL( stats_number, 2 );
+
+	rapidjson::StringBuffer buffer;
+	rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+	call_tree.write_json(writer);
+	std::string json = buffer.GetString();
+	BOOST_CHECK( json.find(",\"stats\":{\"bytes\":8192,\"path\":\"ppppppppppppppppp\"}}")
+			!= std::string::npos );
+	BOOST_CHECK( json.find("\"stats\":{\"status\":\"ok\"}") != std::string::npos );
+
+	call_tree_t tree_copy(call_tree);
+	BOOST_CHECK_EQUAL( tree_copy.get_node_stat<int>(node, key), 8192 );
+
+	call_tree_t merged_tree(actions_set);
+	call_tree.merge_into(merged_tree.root, merged_tree);
+	BOOST_CHECK_EQUAL( merged_tree.get_node_stat<int>(node, key), 8192 );
+	BOOST_CHECK_EQUAL( merged_tree.get_node_stat<std::string>(node, "path"),
+			std::string(stat_t::INLINE_STRING_CAPACITY + 1, 'p') );
+
+	call_tree.reset();
+	BOOST_CHECK( !call_tree.node_has_stats(node) );
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 
@@ -0,0 +1,59 @@
+/*
+* 2013+ Copyright (c) Andrey Kashin <kashin.andrej@gmail.com>
+* All rights reserved.
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*/
+
+#include <iostream>
+#include <fstream>
+
+#include "react/binary.hpp"
+
+/*!
+ * Converts binary trace written by binary_aggregator_t into json,
+ * one tree per line as written by stream_aggregator_t.
+ *
+ * Usage: react_decode [trace_file], trace is read from stdin if file is not given.
+ */
+int main(int argc, char *argv[]) {
+	if (argc > 2) {
+		std::cerr << "Usage: " << argv[0] << " [trace_file]" << std::endl;
+		return 1;
+	}
+
+	std::ifstream file;
+	if (argc == 2) {
+		file.open(argv[1], std::ios::binary);
+		if (!file) {
+			std::cerr << "Can't open " << argv[1] << std::endl;
+			return 1;
+		}
+	}
+	std::istream &is = (argc == 2) ? file : std::cin;
+
+	try {
+		react::binary_reader_t reader(is);
+		rapidjson::StringBuffer buffer;
+		rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+
+		while (reader.read_tree(writer)) {
+			buffer.Put('\n');
+			std::cout.write(buffer.GetString(), buffer.Size());
+			buffer.Clear();
+		}
+	} catch (std::exception &e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -19,6 +19,11 @@ def get_trees(html):
     return tree_dict['call_tree']['react_aggregator']
 
 
+def get_histograms(html):
+    tree_dict = json.loads(html, object_pairs_hook=collections.OrderedDict)
+    return tree_dict['call_tree'].get('react_histograms')
+
+
 def get_page():
     try:
         response = urllib2.urlopen('http://{}/{}'.format(monitored_host, 'call_tree'))
@@ -30,6 +35,7 @@ def get_page():
 trees = {}
 last_actions_trees = {}
 actions_with_name = {}
+histograms_with_name = {}
 min_timestamp = None
 max_timestamp = None
 
@@ -63,11 +69,14 @@ def process_tree(tree):
 
 
 
+NANOSECONDS_IN_MICROSECOND = 1000
+
+
 def get_actions(tree, actions, delta, root):
     if not root:
         actions.append({"name": tree['name'],
-                        "startTime": tree['start_time'] - delta,
-                        "endTime": tree['stop_time'] - delta,
+                        "startTime": (tree['start_time'] - delta) // NANOSECONDS_IN_MICROSECOND,
+                        "endTime": (tree['stop_time'] - delta) // NANOSECONDS_IN_MICROSECOND,
                         "color": "#%06x" % randint(0, 0xFFFFFF)})
 
     if 'actions' in tree:
@@ -86,7 +95,7 @@ def render_tree(tree):
 
 quantiles = [
     (0.5, '50%'),
-    (0.7, '75%'),
+    (0.75, '75%'),
     (0.9, '90%'),
     (0.95, '95%'),
     (0.99, '99%')
@@ -107,6 +116,17 @@ def quintiles_measurement(previous_bucket, bucket_actions_times):
     return measurement
 
 
+def process_histograms(histograms):
+    # Snapshot of react::histogram_aggregator_t taken with reset,
+    # quantiles are already computed by the monitored process
+    timestamp = int(time.time() * 1000)
+    for name, histogram in histograms.items():
+        measurement = {'timestamp': timestamp, 'calls': histogram['calls']}
+        for quantile in quantiles:
+            measurement[quantile[1]] = histogram[quantile[1]] // NANOSECONDS_IN_MICROSECOND
+        histograms_with_name.setdefault(name, []).append(measurement)
+
+
 def build_stacked_histogram(name, actions):
     histogram_json = []
     previous_bucket = 0
@@ -136,6 +156,13 @@ def build_stacked_histogram(name, actions):
 
 def render_stacked_histograms():
     rendered_histograms = []
+    if histograms_with_name:
+        for name in sorted(histograms_with_name.keys()):
+            rendered_histograms.append(render_template("stacked_histogram.html", title=name,
+                                       div_name="Stacked_histogram_" + name,
+                                       data_provider=json.dumps(histograms_with_name[name])))
+        return rendered_histograms
+
     for name in sorted(actions_with_name.keys()):
         actions_with_name[name] = sorted(actions_with_name[name], key=lambda x: x['startTime'])
         rendered_histograms.append(build_stacked_histogram(name, actions_with_name[name]))
@@ -148,7 +175,11 @@ import time
 def update_trees(delay):
     while True:
         try:
-            for tree in get_trees(get_page()):
+            page = get_page()
+            histograms = get_histograms(page)
+            if histograms is not None:
+                process_histograms(histograms)
+            for tree in get_trees(page):
                 process_tree(tree)
         except:
             print('Failed to download')